@@ -0,0 +1,48 @@
+# Fails a heap-free build if a driver object calls an allocator. The poison
+# pragma of DRIVER_HEAP_POISON only covers the driver's own source text after
+# its registration; this checks what the objects actually reference.
+#
+#   cmake -DNM=<nm> -DOBJECTS=<objects> -P driver_heap.cmake
+#
+# Only objects under hw/driver/ except the registry (driver.c) are drivers.
+# Allocations inside the bus layer they call, e.g. i2c_master_bus_add_device()
+# on attach, are outside the check.
+
+set(allocators
+    malloc calloc realloc free strdup
+    "heap_caps_[a-z_]+"
+    pvPortMalloc vPortFree
+    xQueueGenericCreate xQueueCreateMutex xQueueCreateCountingSemaphore
+    xEventGroupCreate xTimerCreate "xTaskCreate[A-Za-z]*")
+list(JOIN allocators "|" pattern)
+
+set(checked 0)
+set(failed FALSE)
+
+foreach(object IN LISTS OBJECTS)
+    if(NOT object MATCHES "/hw/driver/" OR object MATCHES "/hw/driver/include/driver\\.c")
+        continue()
+    endif()
+
+    execute_process(COMMAND ${NM} -u ${object}
+                    OUTPUT_VARIABLE symbols
+                    RESULT_VARIABLE result)
+    if(result)
+        message(FATAL_ERROR "Cannot read symbols of ${object}")
+    endif()
+    math(EXPR checked "${checked} + 1")
+
+    string(REPLACE "\n" ";" symbols "${symbols}")
+    foreach(line IN LISTS symbols)
+        if(line MATCHES "^ *U (${pattern})$")
+            get_filename_component(name ${object} NAME)
+            message(SEND_ERROR "Driver object ${name} calls ${CMAKE_MATCH_1} in a heap-free build")
+            set(failed TRUE)
+        endif()
+    endforeach()
+endforeach()
+
+if(failed)
+    message(FATAL_ERROR "Heap-free drivers must not allocate")
+endif()
+message("Drivers: ${checked} objects reference no allocator")
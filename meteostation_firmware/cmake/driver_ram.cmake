@@ -0,0 +1,42 @@
+# Prints the static RAM of every driver in a heap-free build: its descriptor
+# plus the context storage DEFINE_DRIVER_REGISTER reserved for it. That the
+# driver objects call no allocator is checked by driver_heap.cmake.
+#
+#   cmake -DNM=<nm> -DELF=<firmware.elf> -P driver_ram.cmake
+
+execute_process(COMMAND ${NM} -S ${ELF}
+                OUTPUT_VARIABLE symbols
+                RESULT_VARIABLE result)
+if(result)
+    message(FATAL_ERROR "Cannot read symbols of ${ELF}")
+endif()
+
+string(REPLACE "\n" ";" symbols "${symbols}")
+set(names)
+
+foreach(line IN LISTS symbols)
+    if(NOT line MATCHES "^[0-9a-fA-F]+ ([0-9a-fA-F]+) [bBdD] (.+)_(driver|ctx_storage)$")
+        continue()
+    endif()
+    set(name ${CMAKE_MATCH_2})
+    set(kind ${CMAKE_MATCH_3})
+    math(EXPR ${kind}_${name} "0x${CMAKE_MATCH_1}")
+    list(APPEND names ${name})
+endforeach()
+
+list(REMOVE_DUPLICATES names)
+list(SORT names)
+set(total 0)
+
+# Only symbols with context storage next to them are drivers.
+foreach(name IN LISTS names)
+    if(NOT DEFINED ctx_storage_${name} OR NOT DEFINED driver_${name})
+        continue()
+    endif()
+    math(EXPR ram "${driver_${name}} + ${ctx_storage_${name}}")
+    math(EXPR total "${total} + ${ram}")
+    message("Driver ${name}: ${ram} bytes static RAM (descriptor ${driver_${name}}, context ${ctx_storage_${name}})")
+endforeach()
+
+# Contexts and descriptors only; the bus layer still allocates on attach.
+message("Drivers: ${total} bytes static RAM for contexts and descriptors")
@@ -0,0 +1,298 @@
+#include <sdkconfig.h>
+#include <esp_log.h>
+#include <freertos/semphr.h>
+#include "acquisition.h"
+#include "../util/clock.h"
+#include "../hw/driver/bme280/bme_280.h"
+
+#define ACQ_TASK_STACK 4096
+#define ACQ_SEQ_MASK   0xFFFFFF
+
+static const char *TAG = "ACQUISITION";
+
+static acq_sample_t ring_storage[CONFIG_METEO_ACQ_RING_LEN];
+static sample_ring_t ring;
+
+static acq_config_t cfg;
+static TaskHandle_t task_handle = NULL;
+
+static volatile uint32_t sample_count = 0;
+static volatile uint32_t read_errors = 0;
+
+/*
+ * Per-instance state of the current round. Completions carry the round
+ * sequence above the instance number, so one arriving after its round timed
+ * out is dropped instead of being counted against the next round. Until it
+ * has arrived the bus still owns raw, so the instance sits rounds out.
+ */
+typedef struct {
+    uint8_t raw[BME280_RAW_LEN];
+    volatile esp_err_t result;
+    volatile bool in_flight;
+    uint8_t fail_streak;
+} acq_slot_t;
+
+static acq_slot_t slots[BME280_INSTANCES];
+static SemaphoreHandle_t round_done = NULL;
+static volatile uint32_t round_seq = 0;
+
+/*
+ * vTaskDelay(n) ends on the nth tick interrupt from now, which may be only
+ * a little over n - 1 tick periods away. Rounding up and adding one tick
+ * makes sure the read never lands before the conversion has finished.
+ */
+static TickType_t measure_ticks(uint32_t wait_us)
+{
+#ifdef CONFIG_METEO_REPLAY
+    /* The simulated sensor has the replayed sample ready at once. */
+    return 0;
+#else
+    const uint32_t tick_us = 1000000 / configTICK_RATE_HZ;
+    return (wait_us + tick_us - 1) / tick_us + 1;
+#endif
+}
+
+static void acq_bus_done(esp_err_t result, void *arg)
+{
+    uint32_t tag = (uint32_t)(uintptr_t)arg;
+    acq_slot_t *slot = &slots[tag & 0xFF];
+
+    slot->in_flight = false;
+    if ((tag >> 8) != round_seq)
+        return;
+
+    slot->result = result;
+
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(round_done, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/*
+ * Queues the start command or the data read on every pending instance, then
+ * waits for all of them. Instances on different controllers overlap on the
+ * wire; instances sharing one queue back to back.
+ */
+static void acq_submit(bool start, const bool *pending, uint32_t *wait_us)
+{
+    round_seq = (round_seq + 1) & ACQ_SEQ_MASK;
+    while (xSemaphoreTake(round_done, 0) == pdTRUE)
+        ;
+
+    uint32_t queued = 0;
+    for (uint8_t i = 0; i < BME280_INSTANCES; i++) {
+        if (!pending[i])
+            continue;
+
+        void *tag = (void *)(uintptr_t)((round_seq << 8) | i);
+        uint32_t wait = 0;
+
+        slots[i].result = ESP_ERR_TIMEOUT;
+        if (slots[i].in_flight)
+            continue;
+
+        slots[i].in_flight = true;
+        esp_err_t err = start ? bme280_submit_start(i, &wait, acq_bus_done, tag)
+                              : bme280_submit_read(i, slots[i].raw, acq_bus_done, tag);
+        if (err != ESP_OK) {
+            slots[i].in_flight = false;
+            slots[i].result = err;
+            continue;
+        }
+
+        if (wait_us && wait > *wait_us)
+            *wait_us = wait;
+        queued++;
+    }
+
+    for (; queued; queued--) {
+        if (xSemaphoreTake(round_done, pdMS_TO_TICKS(BUS_TIMEOUT_MS) + 1) != pdTRUE)
+            break;
+    }
+}
+
+/*
+ * One phase for every instance still in the round. Transactions that came
+ * back with a transient error go out again under the bus policy; one that
+ * has not come back at all still owns its buffers and is left alone.
+ */
+static void acq_run_phase(bool start, uint32_t *wait_us)
+{
+    bus_attempt_t attempt[BME280_INSTANCES] = { 0 };
+    bool pending[BME280_INSTANCES];
+    bool again;
+
+    for (uint8_t i = 0; i < BME280_INSTANCES; i++)
+        pending[i] = slots[i].result == ESP_OK;
+
+    do {
+        acq_submit(start, pending, wait_us);
+
+        again = false;
+        for (uint8_t i = 0; i < BME280_INSTANCES; i++) {
+            pending[i] = pending[i] && !slots[i].in_flight &&
+                         bme280_submit_retry(i, &attempt[i], slots[i].result);
+            again |= pending[i];
+        }
+    } while (again);
+}
+
+static float acq_median(float *v, size_t n)
+{
+    for (size_t i = 1; i < n; i++) {
+        float x = v[i];
+        size_t j = i;
+        for (; j > 0 && v[j - 1] > x; j--)
+            v[j] = v[j - 1];
+        v[j] = x;
+    }
+
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static void acq_note_failure(uint8_t instance, esp_err_t err)
+{
+    acq_slot_t *slot = &slots[instance];
+
+    /* The driver has already reinitialised a sensor it found reset. */
+    if (err == ESP_ERR_INVALID_RESPONSE) {
+        slot->fail_streak = 0;
+        return;
+    }
+
+    /* Reinit detaches the device; that waits for what is still queued on it. */
+    if (++slot->fail_streak < CONFIG_METEO_ACQ_REINIT_AFTER || slot->in_flight)
+        return;
+
+    slot->fail_streak = 0;
+    esp_err_t rerr = bme280_reinit(instance);
+    ESP_LOGW(TAG, "Sensor %u initialized again: %s", (unsigned)instance, esp_err_to_name(rerr));
+}
+
+esp_err_t acquisition_sample(acq_sample_t *sample, uint32_t *failed)
+{
+    if (!round_done) {
+        round_done = xSemaphoreCreateCounting(BME280_INSTANCES, 0);
+        if (!round_done)
+            return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < BME280_INSTANCES; i++)
+        slots[i].result = ESP_OK;
+
+    uint32_t wait_us = 0;
+    acq_run_phase(true, &wait_us);
+    TickType_t ticks = measure_ticks(wait_us);
+    if (ticks)
+        vTaskDelay(ticks);
+    acq_run_phase(false, NULL);
+    sample->timestamp_us = clock_now_us();
+
+    float temp[BME280_INSTANCES], pressure[BME280_INSTANCES], humidity[BME280_INSTANCES];
+    esp_err_t err = ESP_OK;
+    size_t n = 0;
+
+    for (uint8_t i = 0; i < BME280_INSTANCES; i++) {
+        esp_err_t res = slots[i].result;
+        bme280_data_t data;
+
+        if (res == ESP_OK) {
+            bme280_raw_t raw;
+            bme280_decode_raw(slots[i].raw, &raw);
+            res = bme280_compensate_raw(i, &raw, &data);
+        }
+
+        if (res != ESP_OK) {
+            ESP_LOGE(TAG, "Sensor %u read failed: %s", (unsigned)i, esp_err_to_name(res));
+            err = res;
+            acq_note_failure(i, res);
+            continue;
+        }
+
+        slots[i].fail_streak = 0;
+
+        temp[n] = data.temp;
+        pressure[n] = data.pressure;
+        humidity[n] = data.humidity;
+        n++;
+    }
+
+    if (failed)
+        *failed = BME280_INSTANCES - n;
+    if (n == 0)
+        return err;
+
+    sample->data.temp = acq_median(temp, n);
+    sample->data.pressure = acq_median(pressure, n);
+    sample->data.humidity = acq_median(humidity, n);
+    return ESP_OK;
+}
+
+static void acquisition_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    const TickType_t period = pdMS_TO_TICKS(cfg.period_ms) ? pdMS_TO_TICKS(cfg.period_ms) : 1;
+    uint32_t since_notify = 0;
+
+    while (1) {
+        acq_sample_t sample;
+        uint32_t failed = 0;
+
+        esp_err_t err = acquisition_sample(&sample, &failed);
+        read_errors += failed;
+
+        if (err == ESP_OK) {
+            sample_ring_push(&ring, &sample);
+            sample_count++;
+
+            if (cfg.consumer && ++since_notify >= cfg.notify_every) {
+                since_notify = 0;
+                xTaskNotifyGive(cfg.consumer);
+            }
+        }
+
+        vTaskDelayUntil(&last_wake, period);
+    }
+}
+
+esp_err_t acquisition_start(const acq_config_t *config)
+{
+    if (!config || config->period_ms == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    if (task_handle)
+        return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = sample_ring_init(&ring, ring_storage, CONFIG_METEO_ACQ_RING_LEN);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Ring length %d is not a power of two", CONFIG_METEO_ACQ_RING_LEN);
+        return err;
+    }
+
+    cfg = *config;
+    if (cfg.notify_every == 0)
+        cfg.notify_every = 1;
+
+    BaseType_t ok = xTaskCreatePinnedToCore(acquisition_task, "acquisition", ACQ_TASK_STACK,
+                                            NULL, cfg.priority, &task_handle, cfg.core);
+    if (ok != pdPASS) {
+        task_handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Acquisition running every %u ms on core %d", (unsigned)cfg.period_ms, (int)cfg.core);
+    return ESP_OK;
+}
+
+sample_ring_t *acquisition_ring(void)
+{
+    return &ring;
+}
+
+void acquisition_get_stats(acq_stats_t *stats)
+{
+    stats->samples = sample_count;
+    stats->read_errors = read_errors;
+    stats->overruns = sample_ring_overruns(&ring);
+    stats->high_water = sample_ring_high_water(&ring);
+}
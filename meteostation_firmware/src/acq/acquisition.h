@@ -0,0 +1,41 @@
+#ifndef _ACQUISITION_H
+#define _ACQUISITION_H
+
+#include <stdint.h>
+#include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sample_ring.h"
+
+typedef struct {
+    uint32_t period_ms;
+    BaseType_t core;
+    UBaseType_t priority;
+    /* Task notified each time `notify_every` samples have been pushed. */
+    TaskHandle_t consumer;
+    uint32_t notify_every;
+} acq_config_t;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t read_errors;
+    uint32_t overruns;
+    uint32_t high_water;
+} acq_stats_t;
+
+esp_err_t acquisition_start(const acq_config_t *config);
+
+/* The ring the acquisition task produces into; the caller is its only consumer. */
+sample_ring_t *acquisition_ring(void);
+
+void acquisition_get_stats(acq_stats_t *stats);
+
+/*
+ * One acquisition round: starts every BME280 instance at once, reads them
+ * all back in parallel and fuses the readings by per-channel median.
+ * *failed counts the instances that dropped out. Fails only when none
+ * answered. Runs on the acquisition task; not reentrant.
+ */
+esp_err_t acquisition_sample(acq_sample_t *sample, uint32_t *failed);
+
+#endif
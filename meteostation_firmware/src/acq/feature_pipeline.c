@@ -0,0 +1,110 @@
+#include <math.h>
+#include <string.h>
+#include "feature_pipeline.h"
+#include "feature_quant.h"
+
+#define MAGNUS_B 17.62f
+#define MAGNUS_C 243.12f
+
+/* Standard atmosphere lapse rate (K/m) and g*M/(R*L). */
+#define LAPSE_RATE   0.0065f
+#define BARO_EXPONENT 5.257f
+
+#define MIN_HUMIDITY 0.1f
+
+_Static_assert(sizeof(feature_quant) / sizeof(feature_quant[0]) == FEATURE_COUNT, "feature_quant.h is out of date");
+
+void features_init(features_acc_t *acc, int64_t period_us, float altitude_m)
+{
+    memset(acc, 0, sizeof(*acc));
+    acc->period_us = period_us;
+    acc->start_us = -1;
+    acc->altitude_m = altitude_m;
+}
+
+float features_dew_point(float temp_c, float humidity)
+{
+    if (humidity < MIN_HUMIDITY)
+        humidity = MIN_HUMIDITY;
+    float gamma = logf(humidity / 100.0f) + MAGNUS_B * temp_c / (MAGNUS_C + temp_c);
+    return MAGNUS_C * gamma / (MAGNUS_B - gamma);
+}
+
+float features_pressure_msl(float pressure_hpa, float temp_c, float altitude_m)
+{
+    if (altitude_m == 0.0f)
+        return pressure_hpa;
+    float lapse = LAPSE_RATE * altitude_m;
+    return pressure_hpa * powf(1.0f - lapse / (temp_c + lapse + 273.15f), -BARO_EXPONENT);
+}
+
+void features_month(int month, float *month_sin, float *month_cos)
+{
+    if (month < 1 || month > 12) {
+        *month_sin = FEATURE_FALLBACK_MONTH_SIN;
+        *month_cos = FEATURE_FALLBACK_MONTH_COS;
+        return;
+    }
+    float angle = 2.0f * (float)M_PI * month / 12.0f;
+    *month_sin = sinf(angle);
+    *month_cos = cosf(angle);
+}
+
+int features_clock_month(time_t now)
+{
+    struct tm tm;
+    if (!localtime_r(&now, &tm) || tm.tm_year + 1900 < FEATURES_MIN_VALID_YEAR)
+        return 0;
+    return tm.tm_mon + 1;
+}
+
+static void close_period(features_acc_t *acc, feature_row_t *row)
+{
+    row->v[FEATURE_TEMP] = acc->temp;
+    row->v[FEATURE_HUMIDITY] = acc->humidity;
+    row->v[FEATURE_DEW_POINT] = features_dew_point(acc->temp, acc->humidity);
+    row->v[FEATURE_PRESSURE_MSL] = features_pressure_msl(acc->pressure, acc->temp, acc->altitude_m);
+    row->v[FEATURE_CLOUD_COVER] = FEATURE_FALLBACK_CLOUD_COVER;
+    row->v[FEATURE_PRECIPITATION] = FEATURE_FALLBACK_PRECIPITATION;
+    row->samples = acc->count;
+    row->fallback = (1u << FEATURE_CLOUD_COVER) | (1u << FEATURE_PRECIPITATION);
+
+    int month = features_clock_month(time(NULL));
+    features_month(month, &row->v[FEATURE_MONTH_SIN], &row->v[FEATURE_MONTH_COS]);
+    if (!month)
+        row->fallback |= (1u << FEATURE_MONTH_SIN) | (1u << FEATURE_MONTH_COS);
+}
+
+bool features_add(features_acc_t *acc, const acq_sample_t *sample, feature_row_t *row)
+{
+    bool closed = false;
+
+    if (acc->start_us < 0) {
+        acc->start_us = sample->timestamp_us;
+    } else if (sample->timestamp_us - acc->start_us >= acc->period_us) {
+        int64_t periods = (sample->timestamp_us - acc->start_us) / acc->period_us;
+        close_period(acc, row);
+        row->skipped = (uint32_t)(periods - 1);
+        acc->start_us += periods * acc->period_us;
+        acc->count = 0;
+        closed = true;
+    }
+
+    /* Incremental means keep float precision over an hour where a running sum would not. */
+    float n = (float)++acc->count;
+    acc->temp += (sample->data.temp - acc->temp) / n;
+    acc->humidity += (sample->data.humidity - acc->humidity) / n;
+    acc->pressure += (sample->data.pressure - acc->pressure) / n;
+
+    return closed;
+}
+
+void features_quantize(const feature_row_t *row, int8_t q[FEATURE_COUNT])
+{
+    for (int f = 0; f < FEATURE_COUNT; f++) {
+        int64_t x = lrintf(row->v[f] * (float)(1 << FEATURE_QUANT_FRAC_BITS));
+        int64_t acc = x * feature_quant[f].mult + feature_quant[f].offset;
+        int64_t r = (acc + (1ll << (FEATURE_QUANT_SHIFT - 1))) >> FEATURE_QUANT_SHIFT;
+        q[f] = (int8_t)(r < -128 ? -128 : (r > 127 ? 127 : r));
+    }
+}
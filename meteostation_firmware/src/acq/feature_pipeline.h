@@ -0,0 +1,88 @@
+#ifndef _FEATURE_PIPELINE_H
+#define _FEATURE_PIPELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "sample_ring.h"
+
+/* Column order of load_forecast_data() in meteostation_nn/main.py. */
+typedef enum {
+    FEATURE_TEMP,           /* temperature_2m, degC */
+    FEATURE_HUMIDITY,       /* relative_humidity_2m, % */
+    FEATURE_DEW_POINT,      /* dew_point_2m, degC */
+    FEATURE_PRESSURE_MSL,   /* pressure_msl, hPa */
+    FEATURE_CLOUD_COVER,    /* cloud_cover, % */
+    FEATURE_PRECIPITATION,  /* precipitation, mm */
+    FEATURE_MONTH_SIN,
+    FEATURE_MONTH_COS,
+    FEATURE_COUNT
+} feature_index_t;
+
+/*
+ * Values used for features the station cannot measure. Cloud cover and
+ * precipitation take the medians of weather_data1.csv; an unknown month
+ * encodes as the centre of the unit circle.
+ */
+#define FEATURE_FALLBACK_CLOUD_COVER   92.0f
+#define FEATURE_FALLBACK_PRECIPITATION 0.0f
+#define FEATURE_FALLBACK_MONTH_SIN     0.0f
+#define FEATURE_FALLBACK_MONTH_COS     0.0f
+
+/* The wall clock is trusted for the month once it is past this year. */
+#define FEATURES_MIN_VALID_YEAR 2024
+
+typedef struct {
+    float v[FEATURE_COUNT];
+    uint32_t samples;
+    /* Bit per feature_index_t that holds a fallback instead of a measurement. */
+    uint32_t fallback;
+    /* Periods without any sample between this row and the next one. */
+    uint32_t skipped;
+} feature_row_t;
+
+/*
+ * Running means of one aggregation period. Constant size whatever the sample
+ * rate: each sample updates the means in place.
+ */
+typedef struct {
+    int64_t period_us;
+    int64_t start_us;
+    uint32_t count;
+    float temp;
+    float humidity;
+    float pressure;
+    float altitude_m;
+} features_acc_t;
+
+void features_init(features_acc_t *acc, int64_t period_us, float altitude_m);
+
+/*
+ * Adds one sample. When it falls past the end of the current period, the
+ * closed period is written to *row and true is returned; the sample then
+ * opens the period it belongs to. A gap in the samples shows up as
+ * row->skipped, since the hourly series the model expects is broken there.
+ */
+bool features_add(features_acc_t *acc, const acq_sample_t *sample, feature_row_t *row);
+
+/* Magnus formula (b = 17.62, c = 243.12 degC), valid for -45..60 degC. */
+float features_dew_point(float temp_c, float humidity);
+
+/* Station pressure reduced to mean sea level with the standard atmosphere lapse rate. */
+float features_pressure_msl(float pressure_hpa, float temp_c, float altitude_m);
+
+/* sin/cos(2 pi month / 12) as in main.py; month is 1..12, anything else gives the fallback. */
+void features_month(int month, float *month_sin, float *month_cos);
+
+/* Month of the wall clock, or 0 while it is not set. */
+int features_clock_month(time_t now);
+
+/*
+ * Writes the row as model input: the training MinMaxScaler and the model's
+ * input quantization are folded into one fixed-point affine map per feature
+ * (acq/feature_quant.h, generated by meteostation_nn/feature_quant.py), so
+ * this is a single integer pass with the same result on host and device.
+ */
+void features_quantize(const feature_row_t *row, int8_t q[FEATURE_COUNT]);
+
+#endif
@@ -0,0 +1,27 @@
+/* Generated by meteostation_nn/feature_quant.py from weather_data1.csv. Do not edit. */
+#ifndef _FEATURE_QUANT_H
+#define _FEATURE_QUANT_H
+
+#include <stdint.h>
+
+/* Model input: scale 0.003921568859368563, zero point -128. */
+#define FEATURE_QUANT_FRAC_BITS 16
+#define FEATURE_QUANT_SHIFT     48
+
+typedef struct {
+    int64_t mult;
+    int64_t offset;
+} feature_quant_t;
+
+static const feature_quant_t feature_quant[8] = {
+    { 16823603621ll, -4165053267882120ll },  /* temperature_2m (°C): -28.9 .. 36.2 */
+    { 12884901126ll, -48695170221867056ll },  /* relative_humidity_2m (%): 15.0 .. 100.0 */
+    { 21349251378ll, 5385881315674320ll },  /* dew_point_2m (°C): -29.6 .. 21.7 */
+    { 14113615924ll, -936282567004162944ll },  /* pressure_msl (hPa): 973.3 .. 1050.9 */
+    { 10952165957ll, -36028797018963968ll },  /* cloud_cover (%): 0.0 .. 100.0 */
+    { 86237527221ll, -36028797018963968ll },  /* precipitation (mm): 0.0 .. 12.7 */
+    { 547608297855ll, -140739610738564ll },  /* month_sin: -1.0 .. 1.0 */
+    { 547608297855ll, -140739610738564ll },  /* month_cos: -1.0 .. 1.0 */
+};
+
+#endif
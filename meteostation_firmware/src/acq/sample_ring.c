@@ -0,0 +1,71 @@
+#include "sample_ring.h"
+
+esp_err_t sample_ring_init(sample_ring_t *ring, acq_sample_t *storage, size_t capacity)
+{
+    if (!ring || !storage || capacity == 0 || (capacity & (capacity - 1)) != 0)
+        return ESP_ERR_INVALID_ARG;
+
+    ring->buf = storage;
+    ring->mask = capacity - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->high_water, 0);
+    atomic_init(&ring->overruns, 0);
+
+    return ESP_OK;
+}
+
+bool sample_ring_push(sample_ring_t *ring, const acq_sample_t *sample)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t used = head - tail;
+
+    if (used > ring->mask) {
+        atomic_fetch_add_explicit(&ring->overruns, 1, memory_order_relaxed);
+        return false;
+    }
+
+    ring->buf[head & ring->mask] = *sample;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    if (used + 1 > atomic_load_explicit(&ring->high_water, memory_order_relaxed))
+        atomic_store_explicit(&ring->high_water, used + 1, memory_order_relaxed);
+
+    return true;
+}
+
+size_t sample_ring_peek(sample_ring_t *ring, const acq_sample_t **span)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t avail = head - tail;
+    uint32_t offset = tail & ring->mask;
+    uint32_t to_end = ring->mask + 1 - offset;
+
+    *span = &ring->buf[offset];
+    return avail < to_end ? avail : to_end;
+}
+
+void sample_ring_release(sample_ring_t *ring, size_t count)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + (uint32_t)count, memory_order_release);
+}
+
+size_t sample_ring_count(sample_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return head - tail;
+}
+
+uint32_t sample_ring_overruns(sample_ring_t *ring)
+{
+    return atomic_load_explicit(&ring->overruns, memory_order_relaxed);
+}
+
+uint32_t sample_ring_high_water(sample_ring_t *ring)
+{
+    return atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+}
@@ -0,0 +1,51 @@
+#ifndef _SAMPLE_RING_H
+#define _SAMPLE_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <esp_err.h>
+#include "../hw/driver/bme280/bme_280.h"
+
+#define SAMPLE_RING_CACHE_LINE 64
+
+typedef struct {
+    int64_t timestamp_us;        /* clock_now_us() of the read */
+    bme280_data_t data;
+} acq_sample_t;
+
+/*
+ * Lock-free single-producer/single-consumer ring. Indices run freely and are
+ * masked on access, so capacity must be a power of two. The producer never
+ * overwrites unread samples: a push into a full ring is dropped and counted
+ * as an overrun.
+ */
+typedef struct {
+    acq_sample_t *buf;
+    uint32_t mask;
+
+    _Alignas(SAMPLE_RING_CACHE_LINE) _Atomic uint32_t head;
+    _Atomic uint32_t high_water;
+    _Atomic uint32_t overruns;
+
+    _Alignas(SAMPLE_RING_CACHE_LINE) _Atomic uint32_t tail;
+} sample_ring_t;
+
+esp_err_t sample_ring_init(sample_ring_t *ring, acq_sample_t *storage, size_t capacity);
+
+/* Producer side. Returns false if the ring was full. */
+bool sample_ring_push(sample_ring_t *ring, const acq_sample_t *sample);
+
+/*
+ * Consumer side, zero-copy: returns the number of readable samples stored
+ * contiguously at *span. Call sample_ring_release() once they are consumed.
+ */
+size_t sample_ring_peek(sample_ring_t *ring, const acq_sample_t **span);
+void sample_ring_release(sample_ring_t *ring, size_t count);
+
+size_t sample_ring_count(sample_ring_t *ring);
+uint32_t sample_ring_overruns(sample_ring_t *ring);
+uint32_t sample_ring_high_water(sample_ring_t *ring);
+
+#endif
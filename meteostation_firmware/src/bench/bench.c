@@ -0,0 +1,436 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_BENCH
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include "bench.h"
+#include "../hw/bus/include/bus.h"
+#include "../hw/driver/include/driver.h"
+#include "../hw/driver/bme280/bme_280.h"
+
+#ifdef CONFIG_IDF_TARGET_LINUX
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#else
+#include <esp_timer.h>
+#include <esp_cpu.h>
+#endif
+
+#define BENCH_BUS_ID       0x0
+#define BME280_DATA_REG    0xF7
+#define BME280_ADDR        0x76
+#define BENCH_IN_FLIGHT    4
+#define BENCH_ACQ_ROUNDS   50
+
+static const char *TAG = "BENCH";
+
+static volatile uint32_t alloc_count = 0;
+static uint32_t failed_checks = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    alloc_count++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    alloc_count++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    alloc_count++;
+    return __real_realloc(ptr, size);
+}
+
+static bus_operations_t *inner_ops = NULL;
+static bus_operations_t counting_ops;
+static uint32_t transactions = 0;
+static uint32_t bytes = 0;
+
+static esp_err_t counting_read(bus_device_handle_t dev, uint8_t *data, size_t len)
+{
+    transactions++;
+    bytes += len;
+    return inner_ops->read(dev, data, len);
+}
+
+static esp_err_t counting_write(bus_device_handle_t dev, const uint8_t *data, size_t len)
+{
+    transactions++;
+    bytes += len;
+    return inner_ops->write(dev, data, len);
+}
+
+static esp_err_t counting_transfer(bus_device_handle_t dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    transactions++;
+    bytes += tx_len + rx_len;
+    return inner_ops->transfer(dev, tx, tx_len, rx, rx_len);
+}
+
+static esp_err_t counting_submit(bus_device_handle_t dev, const bus_transaction_t *trans)
+{
+    transactions++;
+    bytes += trans->tx_len + trans->rx_len;
+    return inner_ops->submit(dev, trans);
+}
+
+static esp_err_t install_counting_ops(void)
+{
+    bus_t *bus = NULL;
+    esp_err_t err = get_bus_by_id(BENCH_BUS_ID, &bus);
+    if (err != ESP_OK)
+        return err;
+
+    inner_ops = bus->ops;
+    counting_ops = *inner_ops;
+    counting_ops.read = counting_read;
+    counting_ops.write = counting_write;
+    counting_ops.transfer = counting_transfer;
+    counting_ops.submit = counting_submit;
+    bus->ops = &counting_ops;
+    return ESP_OK;
+}
+
+static void remove_counting_ops(void)
+{
+    bus_t *bus = NULL;
+    if (inner_ops && get_bus_by_id(BENCH_BUS_ID, &bus) == ESP_OK)
+        bus->ops = inner_ops;
+    inner_ops = NULL;
+}
+
+uint64_t bench_now_ns(void)
+{
+#ifdef CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#else
+    return (uint64_t)esp_timer_get_time() * 1000ull;
+#endif
+}
+
+uint64_t bench_cycles(void)
+{
+#ifdef CONFIG_IDF_TARGET_LINUX
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+#else
+    return esp_cpu_get_cycle_count();
+#endif
+}
+
+void bench_case(const char *name, bench_fn_t fn, void *arg, uint32_t iterations, bench_result_t *result)
+{
+    memset(result, 0, sizeof(*result));
+    result->name = name;
+    result->iterations = iterations;
+
+    transactions = 0;
+    bytes = 0;
+    uint32_t allocs_before = alloc_count;
+
+    uint64_t start = bench_now_ns();
+    uint64_t start_cycles = bench_cycles();
+    for (uint32_t i = 0; i < iterations; i++) {
+        if (fn(arg) != ESP_OK)
+            result->errors++;
+    }
+    result->total_cycles = bench_cycles() - start_cycles;
+    result->total_ns = bench_now_ns() - start;
+
+    result->allocations = alloc_count - allocs_before;
+    result->transactions = transactions;
+    result->bytes = bytes;
+}
+
+void bench_print(const bench_result_t *r)
+{
+    double n = r->iterations ? (double)r->iterations : 1.0;
+
+    printf("%-24s %10.1f ns/op %10.1f cyc/op %6.2f xfer/op %6.1f B/op %6.2f alloc/op %u err\n",
+        r->name,
+        (double)r->total_ns / n,
+        (double)r->total_cycles / n,
+        r->transactions / n,
+        r->bytes / n,
+        r->allocations / n,
+        (unsigned)r->errors);
+}
+
+void bench_check(const char *name, bool ok)
+{
+    if (ok)
+        return;
+
+    failed_checks++;
+    printf("CHECK FAILED: %s\n", name);
+}
+
+typedef struct {
+    bus_t *bus;
+    bus_device_handle_t dev;
+} bench_bus_arg_t;
+
+static const bus_device_config_t bench_dev_cfg = {
+    .addr = BME280_ADDR,
+    .scl_speed_hz = 400000,
+};
+
+static esp_err_t bench_bus_read(void *arg)
+{
+    bench_bus_arg_t *b = arg;
+    uint8_t reg = BME280_DATA_REG;
+    uint8_t raw[8];
+
+    esp_err_t err = b->bus->ops->write(b->dev, &reg, 1);
+    if (err != ESP_OK)
+        return err;
+
+    return b->bus->ops->read(b->dev, raw, sizeof(raw));
+}
+
+static esp_err_t bench_bus_transfer(void *arg)
+{
+    bench_bus_arg_t *b = arg;
+    uint8_t reg = BME280_DATA_REG;
+    uint8_t raw[8];
+
+    return b->bus->ops->transfer(b->dev, &reg, 1, raw, sizeof(raw));
+}
+
+static _Atomic uint32_t completed;
+static _Atomic uint32_t failed;
+
+static void bench_submit_done(esp_err_t result, void *arg)
+{
+    if (result != ESP_OK)
+        atomic_fetch_add(&failed, 1);
+    atomic_fetch_add(&completed, 1);
+}
+
+/* Keeps BENCH_IN_FLIGHT data reads queued at once and waits for all of them. */
+static esp_err_t bench_bus_submit(void *arg)
+{
+    bench_bus_arg_t *b = arg;
+    static const uint8_t reg = BME280_DATA_REG;
+    static uint8_t raw[BENCH_IN_FLIGHT][8];
+
+    atomic_store(&completed, 0);
+    atomic_store(&failed, 0);
+
+    uint32_t queued = 0;
+    for (int i = 0; i < BENCH_IN_FLIGHT; i++) {
+        bus_transaction_t trans = {
+            .tx = &reg, .tx_len = 1,
+            .rx = raw[i], .rx_len = sizeof(raw[i]),
+            .done = bench_submit_done,
+        };
+        if (b->bus->ops->submit(b->dev, &trans) == ESP_OK)
+            queued++;
+    }
+
+    uint64_t deadline = bench_now_ns() + (uint64_t)BUS_TIMEOUT_MS * 1000000ull;
+    while (atomic_load(&completed) < queued) {
+        if (bench_now_ns() > deadline)
+            return ESP_ERR_TIMEOUT;
+        taskYIELD();
+    }
+
+    return queued == BENCH_IN_FLIGHT && atomic_load(&failed) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t bench_bus_attach(void *arg)
+{
+    bench_bus_arg_t *b = arg;
+    bus_device_handle_t dev = NULL;
+
+    esp_err_t err = b->bus->ops->attach(&bench_dev_cfg, &dev);
+    if (err != ESP_OK)
+        return err;
+
+    return b->bus->ops->detach(dev);
+}
+
+static esp_err_t bench_read_data(void *arg)
+{
+    bme280_data_t data;
+    return bme280_read_data(0, &data);
+}
+
+#ifdef CONFIG_METEO_INSTR
+static instr_stat_t bench_instr;
+
+static esp_err_t bench_instr_record(void *arg)
+{
+    instr_record(&bench_instr, instr_cycles(), 8, ESP_OK);
+    return ESP_OK;
+}
+
+static void print_instr(const char *name, const instr_snapshot_t *s)
+{
+    printf("%-24s %u calls, %u errors, %u retries, p50 < %u, p99 < %u, max %u cycles\n", name,
+        (unsigned)s->calls, (unsigned)s->errors, (unsigned)s->retries, (unsigned)instr_percentile(s, 50),
+        (unsigned)instr_percentile(s, 99), (unsigned)s->max_cycles);
+}
+#endif
+
+static esp_err_t bench_driver_init(void *arg)
+{
+    driver_t *drv = arg;
+
+    drv->ops->destruct(drv);
+    return drv->ops->init(drv);
+}
+
+static esp_err_t bench_profile_same(void *arg)
+{
+    return bme280_set_profile(0, BME280_PROFILE_WEATHER);
+}
+
+static esp_err_t bench_profile_toggle(void *arg)
+{
+    static uint32_t n;
+    return bme280_set_profile(0, n++ & 1 ? BME280_PROFILE_LOW_NOISE : BME280_PROFILE_WEATHER);
+}
+
+/* Against one bus transaction per register access. */
+static void bench_regmap(uint32_t iterations, driver_t *drv)
+{
+    bench_result_t result;
+    regmap_stats_t s;
+
+    bench_case("bme280_profile_same", bench_profile_same, NULL, iterations, &result);
+    bench_print(&result);
+
+    bench_case("bme280_profile_toggle", bench_profile_toggle, NULL, iterations, &result);
+    bench_print(&result);
+
+    if (bme280_get_regmap_stats(0, &s) == ESP_OK) {
+        printf("regmap bme280: %u writes, %u skipped, %u registers in %u bursts, %u of %u reads cached, %d transactions saved\n",
+            (unsigned)s.writes, (unsigned)s.writes_skipped, (unsigned)s.registers_written, (unsigned)s.bursts,
+            (unsigned)s.reads_cached, (unsigned)s.reads,
+            (int)(s.writes - s.writes_skipped - s.bursts + s.reads_cached));
+    }
+
+    /* Back to the configured profile for the cases that follow. */
+    bench_driver_init(drv);
+}
+
+esp_err_t bench_run(void)
+{
+    const uint32_t iterations = CONFIG_METEO_BENCH_ITERATIONS;
+    bench_result_t result;
+
+    bus_t *bus = NULL;
+    driver_t *drv = NULL;
+
+    if (get_bus_by_id(BENCH_BUS_ID, &bus) != ESP_OK || get_driver_by_id(BME280_DRIVER_ID, &drv) != ESP_OK) {
+        ESP_LOGE(TAG, "Bus or BME280 driver not available, nothing to measure");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = install_counting_ops();
+    if (err != ESP_OK)
+        return err;
+
+    printf("benchmark: %u iterations per case\n", (unsigned)iterations);
+
+    /* The driver holds the sensor's device handle; release it for the raw bus cases. */
+    drv->ops->destruct(drv);
+
+    bench_bus_arg_t bus_arg = { .bus = bus };
+
+    bench_case("bus_attach_detach", bench_bus_attach, &bus_arg, iterations, &result);
+    bench_print(&result);
+
+    if (bus->ops->attach(&bench_dev_cfg, &bus_arg.dev) == ESP_OK) {
+        bench_case("bus_register_read", bench_bus_read, &bus_arg, iterations, &result);
+        bench_print(&result);
+
+        bench_case("bus_register_transfer", bench_bus_transfer, &bus_arg, iterations, &result);
+        bench_print(&result);
+
+        bench_case("bus_submit_x4", bench_bus_submit, &bus_arg, iterations / BENCH_IN_FLIGHT, &result);
+        bench_print(&result);
+
+        bus->ops->detach(bus_arg.dev);
+    }
+
+    bench_bus_compare(iterations);
+    bench_bus_faults(iterations);
+
+    if (drv->ops->init(drv) != ESP_OK) {
+        ESP_LOGE(TAG, "BME280 re-init failed");
+        remove_counting_ops();
+        return ESP_FAIL;
+    }
+
+    bench_case("bme280_read_data", bench_read_data, NULL, iterations, &result);
+    bench_print(&result);
+
+    bench_case("bme280_init", bench_driver_init, drv, iterations / 10 ? iterations / 10 : 1, &result);
+    bench_print(&result);
+
+    bench_regmap(iterations, drv);
+
+    bench_acquisition(BENCH_ACQ_ROUNDS);
+    bench_sensor_reset();
+    bench_late_completion();
+    bench_submit_retry();
+    bench_bus_policy();
+
+    remove_counting_ops();
+
+#ifdef CONFIG_METEO_INSTR
+    /* Cost of one record, paid on every instrumented call. */
+    bench_case("instr_record", bench_instr_record, NULL, iterations, &result);
+    bench_print(&result);
+
+    instr_snapshot_t snap;
+    if (bus_get_instr(BENCH_BUS_ID, BUS_OP_TRANSFER, &snap) == ESP_OK)
+        print_instr("instr bus transfer", &snap);
+    if (bus_get_instr(BENCH_BUS_ID, BUS_OP_SUBMIT, &snap) == ESP_OK)
+        print_instr("instr bus submit", &snap);
+    if (driver_get_instr(BME280_DRIVER_ID, DRIVER_OP_PROCESS, &snap) == ESP_OK)
+        print_instr("instr bme280 process", &snap);
+#endif
+
+    bench_ring();
+    bench_compensation(iterations);
+    bench_features(iterations);
+
+#ifdef CONFIG_METEO_LOG
+    bench_log();
+#endif
+
+#ifdef CONFIG_METEO_FORECAST
+    bench_forecast(iterations / 10 ? iterations / 10 : 1);
+#endif
+
+    if (failed_checks) {
+        printf("benchmark: %u cross-checks failed\n", (unsigned)failed_checks);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+#endif
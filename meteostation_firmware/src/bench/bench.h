@@ -0,0 +1,59 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+typedef esp_err_t (*bench_fn_t)(void *arg);
+
+typedef struct {
+    const char *name;
+    uint32_t iterations;
+    uint64_t total_ns;
+    uint64_t total_cycles;
+    uint32_t transactions;
+    uint32_t bytes;
+    uint32_t allocations;
+    uint32_t errors;
+} bench_result_t;
+
+uint64_t bench_now_ns(void);
+
+/* CPU cycle counter; TSC on x86 hosts, 0 where none is available. */
+uint64_t bench_cycles(void);
+
+/* Runs fn `iterations` times with bus transactions and allocations counted. */
+void bench_case(const char *name, bench_fn_t fn, void *arg, uint32_t iterations, bench_result_t *result);
+
+void bench_print(const bench_result_t *result);
+
+/* Records the outcome of a cross-check; one that failed makes bench_run() fail. */
+void bench_check(const char *name, bool ok);
+
+void bench_compensation(uint32_t iterations);
+void bench_bus_compare(uint32_t iterations);
+void bench_bus_policy(void);
+
+/* Fault injection on the simulated I2C bus; no-ops elsewhere. */
+void bench_bus_faults(uint32_t iterations);
+void bench_sensor_reset(void);
+void bench_late_completion(void);
+void bench_submit_retry(void);
+
+/* Rounds take a conversion time each; keep `rounds` small. */
+void bench_acquisition(uint32_t rounds);
+void bench_forecast(uint32_t iterations);
+void bench_features(uint32_t iterations);
+void bench_log(void);
+
+/* SPSC ring with producer and consumer in threads; linux target only. */
+void bench_ring(void);
+
+/*
+ * Runs the whole suite. Buses and drivers must be initialized. ESP_FAIL if a
+ * cross-check failed.
+ */
+esp_err_t bench_run(void);
+
+#endif
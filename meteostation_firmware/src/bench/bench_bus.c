@@ -0,0 +1,324 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_BENCH
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "bench.h"
+#include "../hw/bus/include/bus.h"
+#include "../acq/acquisition.h"
+#include "../util/clock.h"
+#ifdef CONFIG_METEO_BUS_SIM_I2C
+#include "../hw/bus/sim_i2c_bus.h"
+#endif
+#ifdef CONFIG_METEO_BUS_SIM_SPI
+#include "../hw/bus/sim_spi_bus.h"
+#endif
+
+#define I2C_BUS_ID       0x0
+#define SPI_BUS_ID       0x1
+#define I2C1_BUS_ID      0x2
+#define BME280_DATA_REG  0xF7
+
+#ifdef CONFIG_METEO_BME280_SPI_CS
+#define BENCH_SPI_CS     CONFIG_METEO_BME280_SPI_CS
+#else
+#define BENCH_SPI_CS     10
+#endif
+
+typedef struct {
+    const char *name;
+    bus_id id;
+    bus_device_config_t cfg;
+} bench_bus_target_t;
+
+/* The BME280 at its fastest clock on each bus. */
+static const bench_bus_target_t targets[] = {
+    { "sample_read_i2c_400k", I2C_BUS_ID, { .addr = 0x76, .scl_speed_hz = 400000, .cs_gpio = -1 } },
+    { "sample_read_spi_10m",  SPI_BUS_ID, { .scl_speed_hz = 10000000, .cs_gpio = BENCH_SPI_CS } },
+};
+
+typedef struct {
+    bus_t *bus;
+    bus_device_handle_t dev;
+} bench_target_arg_t;
+
+static esp_err_t bench_sample_read(void *arg)
+{
+    bench_target_arg_t *b = arg;
+    uint8_t reg = BME280_DATA_REG;
+    uint8_t raw[BME280_RAW_LEN];
+
+    return b->bus->ops->transfer(b->dev, &reg, 1, raw, sizeof(raw));
+}
+
+/* Wire time the simulated buses account for; 0 on hardware, where ns/op is the bus time. */
+static uint64_t sim_wire_ns(bus_id id, bool reset)
+{
+#ifdef CONFIG_METEO_BUS_SIM_I2C
+    if (id == I2C_BUS_ID) {
+        sim_i2c_stats_t s;
+        sim_i2c_get_stats(0, &s);
+        if (reset)
+            sim_i2c_reset_stats(0);
+        return s.wire_ns;
+    }
+#ifdef CONFIG_METEO_BUS_I2C1
+    if (id == I2C1_BUS_ID) {
+        sim_i2c_stats_t s;
+        sim_i2c_get_stats(1, &s);
+        if (reset)
+            sim_i2c_reset_stats(1);
+        return s.wire_ns;
+    }
+#endif
+#endif
+#ifdef CONFIG_METEO_BUS_SIM_SPI
+    if (id == SPI_BUS_ID) {
+        sim_spi_stats_t s;
+        sim_spi_get_stats(&s);
+        if (reset)
+            sim_spi_reset_stats();
+        return s.wire_ns;
+    }
+#endif
+    return 0;
+}
+
+/*
+ * Per-sample cost of reading the BME280 data block over each bus. The
+ * sensor's device handle must be released, as in bench_run().
+ */
+void bench_bus_compare(uint32_t iterations)
+{
+    bench_result_t result;
+
+    for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        const bench_bus_target_t *t = &targets[i];
+        bench_target_arg_t arg = { 0 };
+
+        if (get_bus_by_id(t->id, &arg.bus) != ESP_OK || arg.bus->ops->attach(&t->cfg, &arg.dev) != ESP_OK) {
+            printf("%-24s bus %d not available\n", t->name, (int)t->id);
+            continue;
+        }
+
+        sim_wire_ns(t->id, true);
+        bench_case(t->name, bench_sample_read, &arg, iterations, &result);
+        bench_print(&result);
+
+        uint64_t wire = sim_wire_ns(t->id, false);
+        if (wire)
+            printf("%-24s %10.2f us/sample on the wire\n", t->name, wire / 1000.0 / iterations);
+
+        arg.bus->ops->detach(arg.dev);
+    }
+}
+
+/*
+ * Policy limits on bus 0: more retries than the backoff shift allows are
+ * refused, and a backoff that would wrap past 32 bits still counts against
+ * the deadline instead of turning into a fast retry.
+ */
+void bench_bus_policy(void)
+{
+    bus_policy_t saved, policy = {
+        .deadline_us = 2000,
+        .backoff_us = 0x80000000u,
+        .retries = BUS_MAX_RETRIES + 1,
+    };
+    bus_t *bus;
+
+    if (get_bus_by_id(I2C_BUS_ID, &bus) != ESP_OK || bus_get_policy(I2C_BUS_ID, &saved) != ESP_OK) {
+        printf("bus policy: bus %d not available\n", (int)I2C_BUS_ID);
+        return;
+    }
+
+    esp_err_t too_many = bus_set_policy(I2C_BUS_ID, &policy);
+    policy.retries = BUS_MAX_RETRIES;
+    esp_err_t most = bus_set_policy(I2C_BUS_ID, &policy);
+
+    /* The second retry's backoff is 2^32 us; the failure was 1 ms ago. */
+    bus_attempt_t attempt = { .first_fail_us = clock_now_us() - 1000, .retries = 1 };
+    bool retried = bus_retry(bus, BUS_OP_READ, NULL, &attempt, ESP_FAIL);
+    bus_set_policy(I2C_BUS_ID, &saved);
+
+    printf("bus policy: %d retries %s, %d retries %s, wrapping backoff %s\n",
+           BUS_MAX_RETRIES + 1, esp_err_to_name(too_many), BUS_MAX_RETRIES, esp_err_to_name(most),
+           retried ? "retried" : "gave up");
+    bench_check("bus policy", too_many == ESP_ERR_INVALID_ARG && most == ESP_OK && !retried);
+}
+
+#ifdef CONFIG_METEO_BUS_SIM_I2C
+static const struct {
+    const char *name;
+    sim_i2c_fault_t fault;
+} fault_cases[] = {
+    { "transfer_nack_1_in_4", { .nack_every = 4 } },
+    { "transfer_stuck_once",  { .stick_at = 100 } },
+};
+
+/*
+ * Data block reads on the simulated I2C bus under injected faults. With the
+ * default bus policy none of them should reach the caller. The sensor's device
+ * handle must be released, as for bench_bus_compare().
+ */
+void bench_bus_faults(uint32_t iterations)
+{
+    const bench_bus_target_t *t = &targets[0];
+    bench_target_arg_t arg = { 0 };
+    bench_result_t result;
+
+    if (get_bus_by_id(t->id, &arg.bus) != ESP_OK || arg.bus->ops->attach(&t->cfg, &arg.dev) != ESP_OK) {
+        printf("bus faults: bus %d not available\n", (int)t->id);
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(fault_cases) / sizeof(fault_cases[0]); i++) {
+        uint32_t recoveries = arg.bus->recoveries;
+        sim_i2c_stats_t s;
+
+        sim_i2c_reset_stats(0);
+        sim_i2c_set_fault(0, &fault_cases[i].fault);
+        bench_case(fault_cases[i].name, bench_sample_read, &arg, iterations, &result);
+        bench_print(&result);
+
+        sim_i2c_get_stats(0, &s);
+        printf("%-24s %u faults injected, %u bus recoveries\n", fault_cases[i].name,
+               (unsigned)s.faults, (unsigned)(arg.bus->recoveries - recoveries));
+    }
+
+    sim_i2c_set_fault(0, NULL);
+    arg.bus->ops->detach(arg.dev);
+}
+
+/* Power-cycles BME280 instance 0 behind the simulated I2C bus; its driver must be up. */
+void bench_sensor_reset(void)
+{
+#ifndef CONFIG_METEO_BME280_BUS_SPI
+    bme280_data_t data = { 0 };
+
+    sim_i2c_power_cycle(0, targets[0].cfg.addr);
+    esp_err_t first = bme280_read_data(0, &data);
+    esp_err_t next = bme280_read_data(0, &data);
+
+    printf("sensor reset: first read %s, next read %s, humidity %.1f %%\n",
+           esp_err_to_name(first), esp_err_to_name(next), data.humidity);
+#endif
+}
+
+/*
+ * Stalls the first transaction on port 0 past the acquisition timeout, so its
+ * completion arrives rounds later, while both sensors on the port wait to be
+ * reinitialised. They must sit those rounds out and come back afterwards.
+ */
+void bench_late_completion(void)
+{
+#ifndef CONFIG_METEO_BME280_BUS_SPI
+    const sim_i2c_fault_t stall = { .stall_at = 1, .stall_ms = 4 * BUS_TIMEOUT_MS };
+    const uint32_t rounds = 2 * CONFIG_METEO_ACQ_REINIT_AFTER + 4;
+    uint32_t degraded = 0, failed = 0;
+    acq_sample_t sample;
+
+    sim_i2c_set_fault(0, &stall);
+    for (uint32_t i = 0; i < rounds; i++) {
+        failed = 0;
+        acquisition_sample(&sample, &failed);
+        if (failed)
+            degraded++;
+    }
+    sim_i2c_set_fault(0, NULL);
+
+    printf("late completion: %u of %u rounds degraded, last round %u sensors failed\n",
+           (unsigned)degraded, (unsigned)rounds, (unsigned)failed);
+#endif
+}
+
+/*
+ * NACKs every third transaction on port 0 during acquisition rounds. The
+ * failed starts and reads go out again under the bus policy, so with retries
+ * enabled no round loses a sensor.
+ */
+void bench_submit_retry(void)
+{
+#ifndef CONFIG_METEO_BME280_BUS_SPI
+    const sim_i2c_fault_t nack = { .nack_every = 3 };
+    const uint32_t rounds = 8;
+    uint32_t degraded = 0;
+    sim_i2c_stats_t stats;
+    acq_sample_t sample;
+
+    sim_i2c_reset_stats(0);
+    sim_i2c_set_fault(0, &nack);
+    for (uint32_t i = 0; i < rounds; i++) {
+        uint32_t failed = 0;
+        acquisition_sample(&sample, &failed);
+        if (failed)
+            degraded++;
+    }
+    sim_i2c_set_fault(0, NULL);
+    sim_i2c_get_stats(0, &stats);
+
+    printf("submit retry: %u NACKs, %u of %u rounds degraded\n",
+           (unsigned)stats.faults, (unsigned)degraded, (unsigned)rounds);
+#endif
+}
+#else
+void bench_bus_faults(uint32_t iterations)
+{
+}
+
+void bench_sensor_reset(void)
+{
+}
+
+void bench_late_completion(void)
+{
+}
+
+void bench_submit_retry(void)
+{
+}
+#endif
+
+static const bus_id acq_buses[] = { I2C_BUS_ID, SPI_BUS_ID, I2C1_BUS_ID };
+
+static esp_err_t bench_acq_round(void *arg)
+{
+    acq_sample_t sample;
+    uint32_t failed = 0;
+
+    esp_err_t err = acquisition_sample(&sample, &failed);
+    return err == ESP_OK && failed ? ESP_FAIL : err;
+}
+
+/*
+ * Parallel acquisition rounds over all BME280 instances. Wire time summed
+ * over the buses is what one controller would spend reading the sensors in
+ * turn; the busiest bus is the round's critical path.
+ */
+void bench_acquisition(uint32_t rounds)
+{
+    char name[32];
+    bench_result_t result;
+
+    for (size_t i = 0; i < sizeof(acq_buses) / sizeof(acq_buses[0]); i++)
+        sim_wire_ns(acq_buses[i], true);
+
+    snprintf(name, sizeof(name), "acq_round_%ux", (unsigned)BME280_INSTANCES);
+    bench_case(name, bench_acq_round, NULL, rounds, &result);
+    bench_print(&result);
+
+    uint64_t serial = 0, critical = 0;
+    for (size_t i = 0; i < sizeof(acq_buses) / sizeof(acq_buses[0]); i++) {
+        uint64_t wire = sim_wire_ns(acq_buses[i], false);
+        serial += wire;
+        if (wire > critical)
+            critical = wire;
+    }
+
+    if (serial)
+        printf("%-24s %10.2f us/round on one bus, %.2f us/round in parallel\n",
+               name, serial / 1000.0 / rounds, critical / 1000.0 / rounds);
+}
+
+#endif
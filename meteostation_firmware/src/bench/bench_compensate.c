@@ -0,0 +1,180 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_BENCH
+
+#include <stdio.h>
+#include <math.h>
+#include "bench.h"
+#include "../hw/driver/bme280/bme_280_compensate.h"
+
+#define TEMP_TOLERANCE_DEG   0.01
+#define HUM_TOLERANCE_PCT    0.01
+#define PRESS_TOLERANCE_HPA  0.01
+
+#define SWEEP_TEMP_STEP  1024
+#define SWEEP_HUM_STEP   1025
+#define SWEEP_PRESS_STEP 16411
+
+#define BURST_LEN 256
+
+/* Typical trim values, matching the simulated bus register map. */
+static const bme_calibration_data_t bench_calib = {
+    .t1 = 27504, .t2 = 26435, .t3 = -1000,
+    .p1 = 36477, .p2 = -10685, .p3 = 3024, .p4 = 2855, .p5 = 140,
+    .p6 = -7, .p7 = 15500, .p8 = -14600, .p9 = 6000,
+    .h1 = 75, .h2 = 362, .h3 = 0, .h4 = 313, .h5 = 50, .h6 = 30,
+};
+
+static const bme280_raw_t bench_raw = { .temp = 519888, .press = 415148, .hum = 29000 };
+
+static volatile float sink;
+
+static esp_err_t bench_compensate_float(void *arg)
+{
+    bme280_data_t out;
+    bme280_compensate_float(&bench_calib, &bench_raw, &out);
+    sink = out.pressure;
+    return ESP_OK;
+}
+
+static esp_err_t bench_compensate_int(void *arg)
+{
+    bme280_data_t out;
+    bme280_compensate_int(&bench_calib, &bench_raw, &out);
+    sink = out.pressure;
+    return ESP_OK;
+}
+
+static int32_t burst_temp[BURST_LEN];
+static int32_t burst_press[BURST_LEN];
+static int32_t burst_hum[BURST_LEN];
+static float out_temp[BURST_LEN];
+static float out_press[BURST_LEN];
+static float out_hum[BURST_LEN];
+
+static const bme280_raw_batch_t burst = { .temp = burst_temp, .press = burst_press, .hum = burst_hum };
+static bme280_data_batch_t burst_out = { .temp = out_temp, .pressure = out_press, .humidity = out_hum };
+
+static void fill_burst(void)
+{
+    for (int i = 0; i < BURST_LEN; i++) {
+        burst_temp[i] = bench_raw.temp + (i * 37) % 4096 - 2048;
+        burst_press[i] = bench_raw.press + (i * 53) % 8192 - 4096;
+        burst_hum[i] = bench_raw.hum + (i * 29) % 2048 - 1024;
+    }
+}
+
+static esp_err_t bench_burst_scalar(void *arg)
+{
+    bme280_data_t out;
+
+    for (int i = 0; i < BURST_LEN; i++) {
+        bme280_raw_t raw = { .temp = burst_temp[i], .press = burst_press[i], .hum = burst_hum[i] };
+        bme280_compensate_int(&bench_calib, &raw, &out);
+        out_temp[i] = out.temp;
+        out_press[i] = out.pressure;
+        out_hum[i] = out.humidity;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t bench_burst_batch(void *arg)
+{
+    bme280_compensate_batch(&bench_calib, &burst, &burst_out, BURST_LEN);
+    return ESP_OK;
+}
+
+static void print_throughput(const bench_result_t *r)
+{
+    double ns = (double)r->total_ns / (r->iterations ? r->iterations : 1);
+    printf("%-24s %10.0f samples/s\n", r->name, ns > 0 ? BURST_LEN * 1e9 / ns : 0.0);
+}
+
+/* The batch kernel must match the scalar integer path bit for bit. */
+static uint32_t check_batch(void)
+{
+    uint32_t mismatches = 0;
+
+    bme280_compensate_batch(&bench_calib, &burst, &burst_out, BURST_LEN);
+
+    for (int i = 0; i < BURST_LEN; i++) {
+        bme280_raw_t raw = { .temp = burst_temp[i], .press = burst_press[i], .hum = burst_hum[i] };
+        bme280_data_t ref;
+        bme280_compensate_int(&bench_calib, &raw, &ref);
+
+        if (ref.temp != out_temp[i] || ref.pressure != out_press[i] || ref.humidity != out_hum[i])
+            mismatches++;
+    }
+
+    printf("batch vs scalar: %u of %d samples differ\n", (unsigned)mismatches, BURST_LEN);
+    return mismatches;
+}
+
+/* Runs both paths over the raw range of the operating temperature span. */
+static uint32_t cross_check(void)
+{
+    double max_t = 0, max_h = 0, max_p = 0;
+    uint32_t checked = 0;
+    uint32_t failures = 0;
+
+    for (int32_t t = 0; t < (1 << 20); t += SWEEP_TEMP_STEP) {
+        temp_data_t td = compensate_temp(&bench_calib, t);
+        if (td.temp_degree < -40.0f || td.temp_degree > 85.0f)
+            continue;
+
+        for (int32_t h = 0; h < (1 << 16); h += SWEEP_HUM_STEP) {
+            for (int32_t p = 0; p < (1 << 20); p += SWEEP_PRESS_STEP) {
+                bme280_raw_t raw = { .temp = t, .press = p, .hum = h };
+                bme280_data_t a, b;
+
+                bme280_compensate_float(&bench_calib, &raw, &a);
+                bme280_compensate_int(&bench_calib, &raw, &b);
+
+                double dt = fabs((double)a.temp - b.temp);
+                double dh = fabs((double)a.humidity - b.humidity);
+                double dp = fabs((double)a.pressure - b.pressure);
+
+                if (dt > max_t) max_t = dt;
+                if (dh > max_h) max_h = dh;
+                if (dp > max_p) max_p = dp;
+
+                if (dt > TEMP_TOLERANCE_DEG || dh > HUM_TOLERANCE_PCT || dp > PRESS_TOLERANCE_HPA)
+                    failures++;
+                checked++;
+            }
+        }
+    }
+
+    printf("compensation cross-check: %u samples, max |d| temp %.4f degC, hum %.4f %%RH, press %.4f hPa, %u out of tolerance\n",
+        (unsigned)checked, max_t, max_h, max_p, (unsigned)failures);
+
+    return failures;
+}
+
+void bench_compensation(uint32_t iterations)
+{
+    bench_result_t result;
+
+    bench_case("compensate_float", bench_compensate_float, NULL, iterations, &result);
+    bench_print(&result);
+
+    bench_case("compensate_int", bench_compensate_int, NULL, iterations, &result);
+    bench_print(&result);
+
+    bench_check("compensation float vs int", cross_check() == 0);
+
+    fill_burst();
+    uint32_t bursts = iterations / 16 ? iterations / 16 : 1;
+
+    bench_case("burst_scalar", bench_burst_scalar, NULL, bursts, &result);
+    bench_print(&result);
+    print_throughput(&result);
+
+    bench_case("burst_batch", bench_burst_batch, NULL, bursts, &result);
+    bench_print(&result);
+    print_throughput(&result);
+
+    bench_check("compensation batch vs scalar", check_batch() == 0);
+}
+
+#endif
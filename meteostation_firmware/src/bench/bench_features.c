@@ -0,0 +1,182 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_BENCH
+
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "../acq/feature_pipeline.h"
+
+#define FEATURES_PERIOD_US 3600000000LL
+
+/* The CSV rounds humidity to 1 % and dew point to 0.1 degC, which bounds the dew point match. */
+#define DEW_TOLERANCE_DEG   0.5f
+#define MSL_TOLERANCE_HPA   0.01f
+#define MONTH_TOLERANCE     1e-5f
+/* Against the independent references below, which round to 0.01 hPa. */
+#define MSL_REF_TOLERANCE_HPA 0.15f
+
+/* ICAO standard atmosphere: pressure and temperature at altitude reduce to 1013.25 hPa. */
+static const struct {
+    float altitude_m;
+    float pressure_hpa;
+    float temp_c;
+} isa_levels[] = {
+    { 0.0f, 1013.25f, 15.0f },
+    { 500.0f, 954.61f, 11.75f },
+    { 1000.0f, 898.76f, 8.5f },
+    { 1500.0f, 845.59f, 5.25f },
+    { 2000.0f, 795.01f, 2.0f },
+};
+
+/* One row of meteostation_nn/export_features.py. */
+typedef struct __attribute__((packed)) {
+    float temp;
+    float humidity;
+    float pressure;
+    int32_t month;
+    float dew_point;
+    float pressure_msl;
+    float month_sin;
+    float month_cos;
+    float cloud_cover;
+    float precipitation;
+    /* feature_quant.quantize(): MinMaxScaler, then model input quantization. */
+    int8_t q[FEATURE_COUNT];
+} features_ref_t;
+
+static features_acc_t bench_acc;
+static acq_sample_t bench_sample = { .data = { .temp = 21.5f, .pressure = 1001.3f, .humidity = 48.0f } };
+
+static feature_row_t bench_row = { .v = { 21.5f, 48.0f, 10.1f, 1013.2f, 92.0f, 0.0f, 0.5f, -0.866f } };
+
+static esp_err_t bench_quantize(void *arg)
+{
+    int8_t q[FEATURE_COUNT];
+    features_quantize(&bench_row, q);
+    return ESP_OK;
+}
+
+static esp_err_t bench_add(void *arg)
+{
+    feature_row_t row;
+    bench_sample.timestamp_us += 100000;
+    features_add(&bench_acc, &bench_sample, &row);
+    return ESP_OK;
+}
+
+static float track(float worst, float got, float want)
+{
+    float d = fabsf(got - want);
+    return d > worst ? d : worst;
+}
+
+/*
+ * export_features.py derives station pressure by inverting the firmware's own
+ * reduction, so MSL is also checked against references that do not share it:
+ * the standard atmosphere table, and the hypsometric equation with the mean
+ * temperature of the layer for days off the standard.
+ */
+static float check_msl(void)
+{
+    float worst = 0;
+
+    for (size_t i = 0; i < sizeof(isa_levels) / sizeof(isa_levels[0]); i++)
+        worst = track(worst, features_pressure_msl(isa_levels[i].pressure_hpa, isa_levels[i].temp_c,
+                                                   isa_levels[i].altitude_m), 1013.25f);
+
+    static const float altitudes[] = { 100.0f, 500.0f, 1000.0f, 1500.0f };
+    static const float temps[] = { -20.0f, 0.0f, 15.0f, 35.0f };
+    for (size_t a = 0; a < sizeof(altitudes) / sizeof(altitudes[0]); a++) {
+        for (size_t t = 0; t < sizeof(temps) / sizeof(temps[0]); t++) {
+            const double g = 9.80665, r = 287.05;
+            double mean_k = temps[t] + 273.15 + 0.0065 * altitudes[a] / 2;
+            float want = (float)(900.0 * exp(g * altitudes[a] / (r * mean_k)));
+            worst = track(worst, features_pressure_msl(900.0f, temps[t], altitudes[a]), want);
+        }
+    }
+
+    printf("features msl vs standard atmosphere and hypsometric equation: %.4f hPa max error\n", worst);
+    return worst;
+}
+
+/* Compares the firmware formulas with the Python features on every hourly row. */
+static void check_reference(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("features reference %s not found, skipping\n", path);
+        return;
+    }
+
+    float altitude;
+    if (fread(&altitude, sizeof(altitude), 1, f) != 1) {
+        fclose(f);
+        bench_check("features reference header", false);
+        return;
+    }
+
+    features_ref_t ref;
+    uint32_t rows = 0;
+    float dew = 0, msl = 0, month = 0;
+    double dew_sum = 0;
+    uint32_t q_mismatches = 0;
+    int q_worst = 0;
+
+    while (fread(&ref, sizeof(ref), 1, f) == 1) {
+        float s, c;
+        float td = features_dew_point(ref.temp, ref.humidity);
+        dew = track(dew, td, ref.dew_point);
+        dew_sum += fabsf(td - ref.dew_point);
+        msl = track(msl, features_pressure_msl(ref.pressure, ref.temp, altitude), ref.pressure_msl);
+        features_month(ref.month, &s, &c);
+        month = track(month, s, ref.month_sin);
+        month = track(month, c, ref.month_cos);
+
+        /* Quantization runs on the CSV features, as in training. */
+        feature_row_t row = { .v = {
+            [FEATURE_TEMP] = ref.temp,
+            [FEATURE_HUMIDITY] = ref.humidity,
+            [FEATURE_DEW_POINT] = ref.dew_point,
+            [FEATURE_PRESSURE_MSL] = ref.pressure_msl,
+            [FEATURE_CLOUD_COVER] = ref.cloud_cover,
+            [FEATURE_PRECIPITATION] = ref.precipitation,
+            [FEATURE_MONTH_SIN] = ref.month_sin,
+            [FEATURE_MONTH_COS] = ref.month_cos,
+        } };
+        int8_t q[FEATURE_COUNT];
+        features_quantize(&row, q);
+        for (int i = 0; i < FEATURE_COUNT; i++) {
+            int d = abs(q[i] - ref.q[i]);
+            q_mismatches += d != 0;
+            q_worst = d > q_worst ? d : q_worst;
+        }
+        rows++;
+    }
+    fclose(f);
+
+    printf("features vs python (%u rows, %.0f m): dew point %.3f degC (mean %.3f), msl %.4f hPa, month %.2e max error\n",
+        (unsigned)rows, altitude, dew, rows ? dew_sum / rows : 0.0, msl, month);
+    bench_check("features vs python", dew <= DEW_TOLERANCE_DEG && msl <= MSL_TOLERANCE_HPA && month <= MONTH_TOLERANCE);
+    printf("features quantized vs python: %u of %u values differ, max %d LSB\n",
+        (unsigned)q_mismatches, (unsigned)(rows * FEATURE_COUNT), q_worst);
+    bench_check("features quantized vs python", q_mismatches == 0);
+}
+
+void bench_features(uint32_t iterations)
+{
+    bench_result_t result;
+
+    bench_check("features msl", check_msl() <= MSL_REF_TOLERANCE_HPA);
+    check_reference(CONFIG_METEO_BENCH_FEATURES_REF);
+
+    features_init(&bench_acc, FEATURES_PERIOD_US, 150.0f);
+    bench_case("features_add", bench_add, NULL, iterations, &result);
+    bench_print(&result);
+
+    bench_case("features_quantize", bench_quantize, NULL, iterations, &result);
+    bench_print(&result);
+}
+
+#endif
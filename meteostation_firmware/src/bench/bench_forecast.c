@@ -0,0 +1,245 @@
+#include <sdkconfig.h>
+
+#if defined(CONFIG_METEO_BENCH) && defined(CONFIG_METEO_FORECAST)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../nn/forecast.h"
+#include "../nn/forecast_tflm.h"
+#include "forecast_model.h"
+
+#define REF_INPUT_LEN  (FORECAST_WINDOW * FORECAST_FEATURES)
+#define REF_RECORD_LEN (REF_INPUT_LEN + FORECAST_CLASSES)
+#define RANDOM_WINDOWS 1000
+/* The desktop interpreter uses a table-driven softmax and may round differently. */
+#define REF_TOLERANCE_LSB 1
+
+static int8_t bench_window[REF_INPUT_LEN];
+static int8_t slide_window[REF_INPUT_LEN];
+static uint32_t slide_state = 0x9e3779b9;
+
+/* Drops the oldest row of slide_window and appends a pseudo-random one. */
+static void slide(void)
+{
+    memmove(slide_window, slide_window + FORECAST_FEATURES, REF_INPUT_LEN - FORECAST_FEATURES);
+    for (int f = 0; f < FORECAST_FEATURES; f++) {
+        slide_state ^= slide_state << 13;
+        slide_state ^= slide_state >> 17;
+        slide_state ^= slide_state << 5;
+        slide_window[REF_INPUT_LEN - FORECAST_FEATURES + f] = (int8_t)slide_state;
+    }
+}
+
+static esp_err_t bench_slide_full(void *arg)
+{
+    int8_t out[FORECAST_CLASSES];
+    slide();
+    forecast_model_invoke(slide_window, out);
+    return ESP_OK;
+}
+
+static esp_err_t bench_slide_stream(void *arg)
+{
+    int8_t out[FORECAST_CLASSES];
+    slide();
+    forecast_model_invoke_stream(slide_window, out);
+    return ESP_OK;
+}
+
+static esp_err_t bench_aot(void *arg)
+{
+    int8_t out[FORECAST_CLASSES];
+    forecast_model_invoke(bench_window, out);
+    return ESP_OK;
+}
+
+static int max_lsb_diff(const int8_t *a, const int8_t *b)
+{
+    int worst = 0;
+    for (int c = 0; c < FORECAST_CLASSES; c++) {
+        int d = abs(a[c] - b[c]);
+        worst = d > worst ? d : worst;
+    }
+    return worst;
+}
+
+/* Compares every window of the reference file with the generated kernels; returns those off by more than the tolerance. */
+static uint32_t check_reference(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("forecast reference %s not found, skipping\n", path);
+        return 0;
+    }
+
+    int8_t rec[REF_RECORD_LEN];
+    int8_t out[FORECAST_CLASSES];
+    uint32_t windows = 0;
+    uint32_t mismatches = 0;
+    uint32_t failures = 0;
+    int worst = 0;
+
+    while (fread(rec, 1, sizeof(rec), f) == sizeof(rec)) {
+        if (windows == 0)
+            memcpy(bench_window, rec, REF_INPUT_LEN);
+
+        forecast_model_invoke(rec, out);
+        int d = max_lsb_diff(out, rec + REF_INPUT_LEN);
+        mismatches += d != 0;
+        failures += d > REF_TOLERANCE_LSB;
+        worst = d > worst ? d : worst;
+        windows++;
+    }
+    fclose(f);
+
+    printf("forecast aot vs tflite file: %u of %u windows differ, max %d LSB\n",
+        (unsigned)mismatches, (unsigned)windows, worst);
+    return failures;
+}
+
+/* Streaming inference must match full recomputation on every step of a sliding series. */
+static uint32_t check_stream(void)
+{
+    int8_t full[FORECAST_CLASSES];
+    int8_t stream[FORECAST_CLASSES];
+    uint32_t mismatches = 0;
+
+    for (int w = 0; w < RANDOM_WINDOWS; w++) {
+        slide();
+        forecast_model_invoke(slide_window, full);
+        forecast_model_invoke_stream(slide_window, stream);
+        mismatches += memcmp(full, stream, sizeof(full)) != 0;
+    }
+
+    printf("forecast stream vs full: %u of %d sliding windows differ\n", (unsigned)mismatches, RANDOM_WINDOWS);
+    return mismatches;
+}
+
+/*
+ * After forecast_reset() the stream starts over: it waits for a full window
+ * again and then gives what a fresh stream gives, whatever was pushed before.
+ */
+static uint32_t check_reset(void)
+{
+    int8_t rows[2 * FORECAST_WINDOW][FORECAST_FEATURES];
+    float fresh[FORECAST_CLASSES], again[FORECAST_CLASSES];
+    uint32_t state = 0x6a09e667;
+    uint32_t mismatches = 0;
+
+    for (int w = 0; w < RANDOM_WINDOWS / 10; w++) {
+        for (int r = 0; r < 2 * FORECAST_WINDOW; r++) {
+            for (int f = 0; f < FORECAST_FEATURES; f++) {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                rows[r][f] = (int8_t)state;
+            }
+        }
+
+        forecast_reset();
+        for (int r = FORECAST_WINDOW; r < 2 * FORECAST_WINDOW; r++)
+            forecast_push(rows[r], fresh);
+
+        for (int r = 0; r < FORECAST_WINDOW; r++)
+            forecast_push(rows[r], again);
+        forecast_reset();
+
+        bool ok = true;
+        for (int r = FORECAST_WINDOW; r < 2 * FORECAST_WINDOW; r++) {
+            esp_err_t err = forecast_push(rows[r], again);
+            ok &= err == (r < 2 * FORECAST_WINDOW - 1 ? ESP_ERR_NOT_FINISHED : ESP_OK);
+        }
+        mismatches += !ok || memcmp(fresh, again, sizeof(fresh)) != 0;
+    }
+    forecast_reset();
+
+    printf("forecast after reset vs fresh stream: %u of %d windows differ\n",
+        (unsigned)mismatches, RANDOM_WINDOWS / 10);
+    return mismatches;
+}
+
+#ifdef CONFIG_METEO_FORECAST_TFLM
+static esp_err_t bench_tflm(void *arg)
+{
+    int8_t out[FORECAST_CLASSES];
+    return forecast_tflm_predict_q(bench_window, out);
+}
+
+/* Generated kernels against the interpreter on the device, which must agree bit for bit. */
+static uint32_t check_tflm(void)
+{
+    int8_t in[REF_INPUT_LEN];
+    int8_t aot[FORECAST_CLASSES];
+    int8_t ref[FORECAST_CLASSES];
+    uint32_t mismatches = 0;
+    uint32_t state = 0x2545f491;
+
+    for (int w = 0; w < RANDOM_WINDOWS; w++) {
+        for (int i = 0; i < REF_INPUT_LEN; i++) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            in[i] = (int8_t)state;
+        }
+        forecast_model_invoke(in, aot);
+        if (forecast_tflm_predict_q(in, ref) != ESP_OK || memcmp(aot, ref, sizeof(aot)) != 0)
+            mismatches++;
+    }
+
+    printf("forecast aot vs tflm: %u of %d random windows differ\n", (unsigned)mismatches, RANDOM_WINDOWS);
+    return mismatches;
+}
+#endif
+
+void bench_forecast(uint32_t iterations)
+{
+    bench_result_t result;
+
+    if (forecast_init() != ESP_OK) {
+        printf("forecast model unavailable\n");
+        return;
+    }
+
+    printf("forecast aot: %d bytes of constants, %d bytes scratch\n",
+        FORECAST_MODEL_CONST_BYTES, FORECAST_MODEL_SCRATCH_BYTES);
+
+    for (int i = 0; i < REF_INPUT_LEN; i++)
+        bench_window[i] = (int8_t)(i * 7 - 100);
+
+    bench_check("forecast aot vs tflite file", check_reference(CONFIG_METEO_BENCH_FORECAST_REF) == 0);
+
+    bench_case("forecast_aot", bench_aot, NULL, iterations, &result);
+    bench_print(&result);
+
+    bench_check("forecast stream vs full", check_stream() == 0);
+    bench_check("forecast after reset", check_reset() == 0);
+
+    bench_case("forecast_slide_full", bench_slide_full, NULL, iterations, &result);
+    bench_print(&result);
+
+    uint32_t macs = forecast_model_stream_macs();
+    bench_case("forecast_slide_stream", bench_slide_stream, NULL, iterations, &result);
+    bench_print(&result);
+    printf("forecast MACs per step: %d full, %u streaming, %d bytes of stream state\n",
+        FORECAST_MODEL_MACS, (unsigned)((forecast_model_stream_macs() - macs) / iterations),
+        FORECAST_MODEL_STREAM_BYTES);
+
+#ifdef CONFIG_METEO_FORECAST_TFLM
+    if (forecast_tflm_init() != ESP_OK) {
+        printf("forecast tflm unavailable\n");
+        return;
+    }
+
+    printf("forecast tflm arena: %u of %d bytes used\n",
+        (unsigned)forecast_tflm_arena_used(), CONFIG_METEO_FORECAST_ARENA_SIZE);
+
+    bench_check("forecast aot vs tflm", check_tflm() == 0);
+
+    bench_case("forecast_tflm", bench_tflm, NULL, iterations, &result);
+    bench_print(&result);
+#endif
+}
+
+#endif
@@ -0,0 +1,238 @@
+#include <sdkconfig.h>
+
+#if defined(CONFIG_METEO_BENCH) && defined(CONFIG_METEO_LOG)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../storage/sample_log.h"
+#include "../util/clock.h"
+
+#define CHUNK_ROWS 1024
+
+typedef struct {
+    FILE *f;
+    int col_temp;
+    int col_humidity;
+    int col_pressure;
+} csv_reader_t;
+
+#define WALL_CLOCK_SAMPLES 10
+
+static sample_log_t bench_samples;
+static sample_log_iter_t bench_iter;
+static acq_sample_t chunk[CHUNK_ROWS];
+
+static bool csv_open(csv_reader_t *csv, const char *path)
+{
+    char line[512];
+
+    csv->f = fopen(path, "r");
+    if (!csv->f)
+        return false;
+
+    csv->col_temp = csv->col_humidity = csv->col_pressure = -1;
+    if (!fgets(line, sizeof(line), csv->f)) {
+        fclose(csv->f);
+        return false;
+    }
+
+    int col = 0;
+    for (char *tok = strtok(line, ",\r\n"); tok; tok = strtok(NULL, ",\r\n"), col++) {
+        if (strncmp(tok, "temperature_2m", 14) == 0)
+            csv->col_temp = col;
+        else if (strncmp(tok, "relative_humidity_2m", 20) == 0)
+            csv->col_humidity = col;
+        else if (strncmp(tok, "pressure_msl", 12) == 0)
+            csv->col_pressure = col;
+    }
+
+    if (csv->col_temp < 0 || csv->col_humidity < 0 || csv->col_pressure < 0) {
+        fclose(csv->f);
+        return false;
+    }
+    return true;
+}
+
+/* Next complete row; rows with empty fields are skipped. */
+static bool csv_next(csv_reader_t *csv, acq_sample_t *sample)
+{
+    char line[512];
+
+    while (fgets(line, sizeof(line), csv->f)) {
+        int y, mo, d, h, mi;
+        if (sscanf(line, "%d-%d-%dT%d:%d", &y, &mo, &d, &h, &mi) != 5)
+            continue;
+
+        bool complete = true;
+        int seen = 0;
+        char *p = line;
+        for (int col = 0; p && complete; col++) {
+            char *end = strpbrk(p, ",\r\n");
+            if (end == p)
+                complete = false;
+            else if (col == csv->col_temp)
+                sample->data.temp = strtof(p, NULL), seen++;
+            else if (col == csv->col_humidity)
+                sample->data.humidity = strtof(p, NULL), seen++;
+            else if (col == csv->col_pressure)
+                sample->data.pressure = strtof(p, NULL), seen++;
+            p = end && *end == ',' ? end + 1 : NULL;
+        }
+        if (!complete || seen != 3)
+            continue;
+
+        sample->timestamp_us = ((clock_days_from_civil(y, mo, d) * 24 + h) * 60 + mi) * 60 * 1000000LL;
+        return true;
+    }
+
+    return false;
+}
+
+/* Linked over gettimeofday() in bench builds; holds the wall clock unset while true. */
+static bool wall_clock_unset;
+
+int __real_gettimeofday(struct timeval *tv, void *tz);
+
+int __wrap_gettimeofday(struct timeval *tv, void *tz)
+{
+    int ret = __real_gettimeofday(tv, tz);
+    if (ret == 0 && wall_clock_unset)
+        tv->tv_sec %= CLOCK_MIN_VALID_EPOCH_S / 2;
+    return ret;
+}
+
+/* Setting the clock in the middle of a segment closes it, so no sample carries the wrong flag. */
+static void check_wall_clock(void)
+{
+    acq_sample_t sample = { 0 };
+    sample_log_stats_t stats;
+    uint32_t index = 0, wrong = 0;
+
+    if (sample_log_open(&bench_samples, CONFIG_METEO_BENCH_LOG_PARTITION) != ESP_OK || sample_log_format(&bench_samples) != ESP_OK) {
+        bench_check("log wall clock", false);
+        return;
+    }
+
+    wall_clock_unset = true;
+    for (int i = 0; i < 2 * WALL_CLOCK_SAMPLES; i++) {
+        if (i == WALL_CLOCK_SAMPLES)
+            wall_clock_unset = false;
+        sample.timestamp_us = clock_epoch_us(clock_now_us());
+        sample_log_append(&bench_samples, &sample);
+    }
+    sample_log_close(&bench_samples);
+    sample_log_get_stats(&bench_samples, &stats);
+
+    sample_log_open(&bench_samples, CONFIG_METEO_BENCH_LOG_PARTITION);
+    sample_log_iter_begin(&bench_samples, &bench_iter);
+    while (sample_log_iter_next(&bench_iter, &sample) == ESP_OK)
+        wrong += bench_iter.wall_clock != (index++ >= WALL_CLOCK_SAMPLES);
+    sample_log_close(&bench_samples);
+
+    printf("sample log wall clock: %u samples in %u segments, %u flagged wrong\n",
+        (unsigned)index, (unsigned)stats.segments, (unsigned)wrong);
+    bench_check("log wall clock", index == 2 * WALL_CLOCK_SAMPLES && stats.segments == 2 && wrong == 0);
+}
+
+static void print_rate(const char *name, uint32_t samples, uint64_t ns, uint64_t cycles)
+{
+    bench_result_t result = {
+        .name = name,
+        .iterations = samples,
+        .total_ns = ns,
+        .total_cycles = cycles,
+    };
+    bench_print(&result);
+}
+
+void bench_log(void)
+{
+    csv_reader_t csv;
+    sample_log_stats_t stats;
+
+    if (strcmp(CONFIG_METEO_BENCH_LOG_PARTITION, CONFIG_METEO_LOG_PARTITION) == 0) {
+        printf("sample log bench would erase the live log, skipping\n");
+        return;
+    }
+
+    if (!csv_open(&csv, CONFIG_METEO_BENCH_LOG_CSV)) {
+        printf("sample log input %s not found, skipping\n", CONFIG_METEO_BENCH_LOG_CSV);
+        return;
+    }
+
+    if (sample_log_open(&bench_samples, CONFIG_METEO_BENCH_LOG_PARTITION) != ESP_OK || sample_log_format(&bench_samples) != ESP_OK) {
+        printf("sample log unavailable\n");
+        fclose(csv.f);
+        return;
+    }
+
+    uint32_t samples = 0;
+    uint64_t ns = 0, cycles = 0;
+    size_t n;
+
+    do {
+        for (n = 0; n < CHUNK_ROWS && csv_next(&csv, &chunk[n]); n++)
+            ;
+
+        uint64_t start = bench_now_ns();
+        uint64_t start_cycles = bench_cycles();
+        for (size_t i = 0; i < n; i++)
+            sample_log_append(&bench_samples, &chunk[i]);
+        cycles += bench_cycles() - start_cycles;
+        ns += bench_now_ns() - start;
+        samples += n;
+    } while (n == CHUNK_ROWS);
+
+    sample_log_close(&bench_samples);
+    sample_log_get_stats(&bench_samples, &stats);
+    print_rate("log_append", samples, ns, cycles);
+
+    double raw = (double)samples * sizeof(acq_sample_t);
+    printf("sample log: %u samples, %llu bytes in %u segments (%.0f raw), ratio %.2f, %.1f bits/sample, %u of %u sectors\n",
+        (unsigned)samples, (unsigned long long)stats.bytes_written, (unsigned)stats.segments, raw,
+        stats.bytes_written ? raw / stats.bytes_written : 0.0,
+        samples ? stats.bytes_written * 8.0 / samples : 0.0,
+        (unsigned)stats.used_sectors, (unsigned)stats.sectors);
+
+    /* Reopening recovers the ring from flash alone. */
+    if (sample_log_open(&bench_samples, CONFIG_METEO_BENCH_LOG_PARTITION) != ESP_OK) {
+        printf("sample log reopen failed\n");
+        fclose(csv.f);
+        return;
+    }
+
+    acq_sample_t got;
+    uint32_t scanned = 0;
+    uint64_t start = bench_now_ns();
+    uint64_t start_cycles = bench_cycles();
+    sample_log_iter_begin(&bench_samples, &bench_iter);
+    while (sample_log_iter_next(&bench_iter, &got) == ESP_OK)
+        scanned++;
+    print_rate("log_scan", scanned, bench_now_ns() - start, bench_cycles() - start_cycles);
+
+    /* Lossless: every sample that is still in the ring reads back bit for bit. */
+    acq_sample_t want;
+    uint32_t mismatches = 0;
+    fclose(csv.f);
+    if (!csv_open(&csv, CONFIG_METEO_BENCH_LOG_CSV)) {
+        sample_log_close(&bench_samples);
+        return;
+    }
+    for (uint32_t i = 0; i < samples - scanned; i++)
+        csv_next(&csv, &want);
+    sample_log_iter_begin(&bench_samples, &bench_iter);
+    while (sample_log_iter_next(&bench_iter, &got) == ESP_OK && csv_next(&csv, &want))
+        mismatches += got.timestamp_us != want.timestamp_us || memcmp(&got.data, &want.data, sizeof(got.data)) != 0;
+    fclose(csv.f);
+
+    printf("sample log read back: %u of %u samples, %u differ\n",
+        (unsigned)scanned, (unsigned)samples, (unsigned)mismatches);
+
+    sample_log_close(&bench_samples);
+
+    check_wall_clock();
+}
+
+#endif
@@ -0,0 +1,134 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_BENCH
+
+#include <stdio.h>
+#include "bench.h"
+#include "../acq/sample_ring.h"
+
+#ifdef CONFIG_IDF_TARGET_LINUX
+
+#include <pthread.h>
+#include <time.h>
+
+/* Small enough that both runs wrap the indices thousands of times. */
+#define RING_LEN     64
+#define RING_SAMPLES 1000000
+/* The dropping producer pauses this often, like the sampling period would. */
+#define RING_BURST   48
+
+typedef struct {
+    sample_ring_t ring;
+    bool retry;            /* producer waits for room instead of dropping */
+} ring_run_t;
+
+static acq_sample_t ring_storage[RING_LEN];
+
+/* Every field follows from the sequence number, so a torn or stale slot shows. */
+static void ring_fill(acq_sample_t *s, uint32_t seq)
+{
+    s->timestamp_us = seq;
+    s->data.temp = (float)(seq & 0xFFFF);
+    s->data.pressure = (float)(seq >> 16);
+    s->data.humidity = (float)(seq % 101);
+}
+
+static bool ring_valid(const acq_sample_t *s)
+{
+    acq_sample_t want;
+    ring_fill(&want, (uint32_t)s->timestamp_us);
+    return s->data.temp == want.data.temp && s->data.pressure == want.data.pressure &&
+           s->data.humidity == want.data.humidity;
+}
+
+/* Sleeping rather than spinning hands a single-core host to the other thread. */
+static void ring_pause(void)
+{
+    const struct timespec ts = { .tv_nsec = 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static void *ring_producer(void *arg)
+{
+    ring_run_t *run = arg;
+    acq_sample_t s;
+
+    for (uint32_t seq = 0; seq < RING_SAMPLES; seq++) {
+        ring_fill(&s, seq);
+        if (run->retry) {
+            while (!sample_ring_push(&run->ring, &s))
+                ring_pause();
+        } else {
+            sample_ring_push(&run->ring, &s);
+            if (seq % RING_BURST == 0)
+                ring_pause();
+        }
+    }
+    return NULL;
+}
+
+/*
+ * The acquisition task and its consumer in two threads: the consumer must
+ * see every sample in order when the producer waits for room, and when it
+ * drops, ascending samples with exactly the counted overruns missing.
+ */
+static uint32_t ring_run(bool retry, uint64_t *ns)
+{
+    ring_run_t run = { .retry = retry };
+    pthread_t producer;
+    uint32_t received = 0, errors = 0;
+    int64_t last = -1;
+
+    sample_ring_init(&run.ring, ring_storage, RING_LEN);
+
+    uint64_t start = bench_now_ns();
+    if (pthread_create(&producer, NULL, ring_producer, &run) != 0)
+        return 1;
+
+    /* A push into a full ring counts as an overrun even when it is retried. */
+    while (last < RING_SAMPLES - 1 &&
+           (retry || received + sample_ring_overruns(&run.ring) < RING_SAMPLES)) {
+        const acq_sample_t *span;
+        size_t n = sample_ring_peek(&run.ring, &span);
+        if (n == 0) {
+            ring_pause();
+            continue;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            errors += span[i].timestamp_us <= last || !ring_valid(&span[i]);
+            errors += retry && span[i].timestamp_us != last + 1;
+            last = span[i].timestamp_us;
+        }
+        received += n;
+        sample_ring_release(&run.ring, n);
+    }
+
+    pthread_join(producer, NULL);
+    *ns = bench_now_ns() - start;
+
+    uint32_t overruns = sample_ring_overruns(&run.ring);
+    errors += retry ? received != RING_SAMPLES : received + overruns != RING_SAMPLES;
+
+    printf("ring %s: %u samples, %u received, %u overruns, high water %u of %d, %u errors\n",
+        retry ? "lossless" : "dropping", (unsigned)RING_SAMPLES, (unsigned)received,
+        (unsigned)overruns, (unsigned)sample_ring_high_water(&run.ring), RING_LEN, (unsigned)errors);
+    return errors;
+}
+
+void bench_ring(void)
+{
+    uint64_t ns;
+
+    bench_check("ring lossless", ring_run(true, &ns) == 0);
+    printf("%-24s %10.0f samples/s\n", "ring_spsc_threads", ns ? RING_SAMPLES * 1e9 / ns : 0.0);
+
+    bench_check("ring dropping", ring_run(false, &ns) == 0);
+}
+#else
+void bench_ring(void)
+{
+}
+#endif
+
+#endif
@@ -1,23 +1,72 @@
+#include <sdkconfig.h>
+
+#ifndef CONFIG_METEO_BUS_SIM_I2C
+
+#include <string.h>
 #include "include/bus.h"
 #include <esp_log.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <driver/i2c_master.h>
 
 #define I2C_BUS_ID        0x0
-#define I2C_MASTER_NUM    I2C_NUM_0
-#define I2C_MASTER_SDA_IO GPIO_NUM_7
-#define I2C_MASTER_SCL_IO GPIO_NUM_6
+#define I2C1_BUS_ID       0x2
+#define I2C_MAX_DEVICES   8
+#define I2C_QUEUE_DEPTH   CONFIG_METEO_BUS_I2C_QUEUE_DEPTH
+#define I2C_SYNC_BUF_LEN  32
 
 static const char *TAG = "I2C_BUS";
 
-static i2c_master_bus_handle_t bus_handle = NULL;
+typedef struct i2c_port_t i2c_port_t;
 
-typedef struct {
-    uint8_t addr;
+struct bus_device_t {
+    i2c_port_t *port;
+    uint16_t addr;
     i2c_master_dev_handle_t dev;
-} i2c_device_entry_t;
+};
+
+/*
+ * The controller completes queued transactions in submission order, so
+ * completions are matched to callbacks through a FIFO filled under
+ * submit_lock and drained from the ISR.
+ */
+typedef struct {
+    bus_done_cb_t done;
+    void *arg;
+} i2c_pending_t;
+
+/* One controller; the two run independently of each other. */
+struct i2c_port_t {
+    i2c_port_num_t num;
+    gpio_num_t sda;
+    gpio_num_t scl;
+    i2c_master_bus_handle_t bus_handle;
+    struct bus_device_t devices[I2C_MAX_DEVICES];
+
+    i2c_pending_t pending[I2C_QUEUE_DEPTH];
+    volatile uint32_t pending_head;
+    volatile uint32_t pending_tail;
+
+    SemaphoreHandle_t submit_lock;
+    SemaphoreHandle_t free_slots;
+
+    /*
+     * Blocking operations run through the queue on these bounce buffers, one
+     * at a time; sync_busy stays set until the controller is done with them.
+     */
+    SemaphoreHandle_t sync_lock;
+    SemaphoreHandle_t sync_done;
+    uint8_t sync_tx[I2C_SYNC_BUF_LEN];
+    uint8_t sync_rx[I2C_SYNC_BUF_LEN];
+    volatile bool sync_busy;
+    volatile esp_err_t sync_result;
+};
 
-static i2c_device_entry_t devices[8];
-static size_t device_count = 0;
+static i2c_port_t ports[] = {
+    { .num = I2C_NUM_0, .sda = GPIO_NUM_7, .scl = GPIO_NUM_6 },
+    { .num = I2C_NUM_1, .sda = GPIO_NUM_4, .scl = GPIO_NUM_5 },
+};
 
 
 DEFINE_BUS_REGISTER(
@@ -25,108 +74,393 @@ DEFINE_BUS_REGISTER(
     i2c,
     init_i2c_bus,
     destroy_i2c_bus,
+    attach_i2c_device,
+    detach_i2c_device,
     read_i2c_bus,
-    write_i2c_bus
+    write_i2c_bus,
+    transfer_i2c_bus,
+    submit_i2c_bus,
+    recover_i2c_bus
 )
 
-esp_err_t init_i2c_bus(void)
+#ifdef CONFIG_METEO_BUS_I2C1
+DEFINE_BUS_REGISTER(
+    I2C1_BUS_ID,
+    i2c1,
+    init_i2c1_bus,
+    destroy_i2c1_bus,
+    attach_i2c1_device,
+    detach_i2c_device,
+    read_i2c_bus,
+    write_i2c_bus,
+    transfer_i2c_bus,
+    submit_i2c_bus,
+    recover_i2c_bus
+)
+#endif
+
+static esp_err_t i2c_event_to_err(i2c_master_event_t event)
 {
-    ESP_LOGI(TAG, "Initializing I2C bus...");
+    switch (event) {
+    case I2C_EVENT_DONE:    return ESP_OK;
+    case I2C_EVENT_TIMEOUT: return ESP_ERR_TIMEOUT;
+    default:                return ESP_FAIL;
+    }
+}
 
-    if (bus_handle) {
+static bool IRAM_ATTR i2c_trans_done(i2c_master_dev_handle_t i2c_dev, const i2c_master_event_data_t *evt, void *arg)
+{
+    i2c_port_t *port = arg;
+
+    i2c_pending_t p = port->pending[port->pending_tail];
+    port->pending_tail = (port->pending_tail + 1) % I2C_QUEUE_DEPTH;
+
+    if (p.done)
+        p.done(i2c_event_to_err(evt->event), p.arg);
+
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(port->free_slots, &woken);
+    return woken == pdTRUE;
+}
+
+static void destroy_i2c_sync_objects(i2c_port_t *port)
+{
+    if (port->submit_lock) vSemaphoreDelete(port->submit_lock);
+    if (port->sync_lock) vSemaphoreDelete(port->sync_lock);
+    if (port->free_slots) vSemaphoreDelete(port->free_slots);
+    if (port->sync_done) vSemaphoreDelete(port->sync_done);
+    port->submit_lock = port->sync_lock = port->free_slots = port->sync_done = NULL;
+}
+
+static esp_err_t i2c_port_init(i2c_port_t *port)
+{
+    ESP_LOGI(TAG, "Initializing I2C bus %d...", (int)port->num);
+
+    if (port->bus_handle) {
         ESP_LOGW(TAG, "Bus already initialized");
         return ESP_OK;
     }
 
     i2c_master_bus_config_t bus_config = {
-        .i2c_port = I2C_MASTER_NUM,
-        .sda_io_num = I2C_MASTER_SDA_IO,
-        .scl_io_num = I2C_MASTER_SCL_IO,
+        .i2c_port = port->num,
+        .sda_io_num = port->sda,
+        .scl_io_num = port->scl,
         .clk_source = I2C_CLK_SRC_DEFAULT,
         .glitch_ignore_cnt = 7,
+        .trans_queue_depth = I2C_QUEUE_DEPTH,
         .flags.enable_internal_pullup = true,
     };
 
-    esp_err_t err = i2c_new_master_bus(&bus_config, &bus_handle);
+    port->submit_lock = xSemaphoreCreateMutex();
+    port->sync_lock = xSemaphoreCreateMutex();
+    port->free_slots = xSemaphoreCreateCounting(I2C_QUEUE_DEPTH, I2C_QUEUE_DEPTH);
+    port->sync_done = xSemaphoreCreateBinary();
+    if (!port->submit_lock || !port->sync_lock || !port->free_slots || !port->sync_done) {
+        destroy_i2c_sync_objects(port);
+        return ESP_ERR_NO_MEM;
+    }
+
+    port->pending_head = port->pending_tail = 0;
+    port->sync_busy = false;
+
+    esp_err_t err = i2c_new_master_bus(&bus_config, &port->bus_handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to init I2C bus: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Failed to init I2C bus %d: %s", (int)port->num, esp_err_to_name(err));
+        destroy_i2c_sync_objects(port);
         return err;
     }
 
-    ESP_LOGI(TAG, "I2C bus ready.");
+    ESP_LOGI(TAG, "I2C bus %d ready.", (int)port->num);
     return ESP_OK;
 }
 
-esp_err_t destroy_i2c_bus(void)
+static esp_err_t i2c_port_destroy(i2c_port_t *port)
 {
-    if (!bus_handle) return ESP_ERR_INVALID_STATE;
+    if (!port->bus_handle) return ESP_ERR_INVALID_STATE;
 
-    for (size_t i = 0; i < device_count; i++) {
-        if (devices[i].dev) {
-            i2c_master_bus_rm_device(devices[i].dev);
-            devices[i].dev = NULL;
+    i2c_master_bus_wait_all_done(port->bus_handle, BUS_TIMEOUT_MS);
+
+    for (size_t i = 0; i < I2C_MAX_DEVICES; i++) {
+        if (port->devices[i].dev) {
+            i2c_master_bus_rm_device(port->devices[i].dev);
+            port->devices[i].dev = NULL;
         }
     }
-    device_count = 0;
 
-    esp_err_t err = i2c_del_master_bus(bus_handle);
-    bus_handle = NULL;
+    esp_err_t err = i2c_del_master_bus(port->bus_handle);
+    port->bus_handle = NULL;
+    destroy_i2c_sync_objects(port);
 
-    ESP_LOGI(TAG, "I2C bus destroyed.");
+    ESP_LOGI(TAG, "I2C bus %d destroyed.", (int)port->num);
     return err;
 }
 
-static i2c_master_dev_handle_t get_device_handle(uint8_t addr)
+static esp_err_t i2c_port_attach(i2c_port_t *port, const bus_device_config_t *config, bus_device_handle_t *dev)
 {
-    for (size_t i = 0; i < device_count; i++) {
-        if (devices[i].addr == addr)
-            return devices[i].dev;
+    if (!config || !dev) return ESP_ERR_INVALID_ARG;
+    if (!port->bus_handle) return ESP_ERR_INVALID_STATE;
+
+    struct bus_device_t *slot = NULL;
+    for (size_t i = 0; i < I2C_MAX_DEVICES; i++) {
+        if (port->devices[i].dev && port->devices[i].addr == config->addr) {
+            ESP_LOGE(TAG, "Device 0x%02X already attached", config->addr);
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (!port->devices[i].dev && !slot)
+            slot = &port->devices[i];
     }
 
-    if (device_count >= sizeof(devices)/sizeof(devices[0])) {
+    if (!slot) {
         ESP_LOGE(TAG, "I2C device table full!");
-        return NULL;
+        return ESP_ERR_NO_MEM;
     }
 
     i2c_device_config_t dev_cfg = {
-        .device_address = addr,
-        .scl_speed_hz = 400000,
+        .device_address = config->addr,
+        .scl_speed_hz = config->scl_speed_hz,
     };
 
-    i2c_master_dev_handle_t dev;
-    esp_err_t err = i2c_master_bus_add_device(bus_handle, &dev_cfg, &dev);
+    esp_err_t err = i2c_master_bus_add_device(port->bus_handle, &dev_cfg, &slot->dev);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add device 0x%02X: %s", config->addr, esp_err_to_name(err));
+        slot->dev = NULL;
+        return err;
+    }
+
+    i2c_master_event_callbacks_t cbs = {
+        .on_trans_done = i2c_trans_done,
+    };
+
+    err = i2c_master_register_event_callbacks(slot->dev, &cbs, port);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to add device 0x%02X: %s", addr, esp_err_to_name(err));
-        return NULL;
+        ESP_LOGE(TAG, "Failed to register callbacks for 0x%02X: %s", config->addr, esp_err_to_name(err));
+        i2c_master_bus_rm_device(slot->dev);
+        slot->dev = NULL;
+        return err;
     }
 
-    devices[device_count++] = (i2c_device_entry_t){ .addr = addr, .dev = dev };
-    ESP_LOGI(TAG, "Device 0x%02X registered on bus", addr);
-    return dev;
+    slot->port = port;
+    slot->addr = config->addr;
+    *dev = slot;
+
+    ESP_LOGI(TAG, "Device 0x%02X attached to bus %d at %u Hz", config->addr, (int)port->num, (unsigned)config->scl_speed_hz);
+    return ESP_OK;
+}
+
+esp_err_t init_i2c_bus(void)
+{
+    return i2c_port_init(&ports[0]);
+}
+
+esp_err_t destroy_i2c_bus(void)
+{
+    return i2c_port_destroy(&ports[0]);
+}
+
+esp_err_t attach_i2c_device(const bus_device_config_t *config, bus_device_handle_t *dev)
+{
+    return i2c_port_attach(&ports[0], config, dev);
+}
+
+#ifdef CONFIG_METEO_BUS_I2C1
+esp_err_t init_i2c1_bus(void)
+{
+    return i2c_port_init(&ports[1]);
+}
+
+esp_err_t destroy_i2c1_bus(void)
+{
+    return i2c_port_destroy(&ports[1]);
 }
 
-esp_err_t read_i2c_bus(uint8_t addr, uint8_t *data, size_t len)
+esp_err_t attach_i2c1_device(const bus_device_config_t *config, bus_device_handle_t *dev)
 {
-    if (!bus_handle) return ESP_ERR_INVALID_STATE;
-    i2c_master_dev_handle_t dev = get_device_handle(addr);
-    if (!dev) return ESP_FAIL;
+    return i2c_port_attach(&ports[1], config, dev);
+}
+#endif
+
+esp_err_t detach_i2c_device(bus_device_handle_t dev)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_ARG;
 
-    esp_err_t err = i2c_master_receive(dev, data, len, -1);
+    /* Queued transactions still reference the device and their buffers. */
+    esp_err_t err = i2c_master_bus_wait_all_done(dev->port->bus_handle, BUS_TIMEOUT_MS);
     if (err != ESP_OK)
-        ESP_LOGE(TAG, "I2C read error from 0x%02X: %s", addr, esp_err_to_name(err));
+        return err;
 
+    err = i2c_master_bus_rm_device(dev->dev);
+    dev->dev = NULL;
     return err;
 }
 
-esp_err_t write_i2c_bus(uint8_t addr, const uint8_t *data, size_t len)
+esp_err_t submit_i2c_bus(bus_device_handle_t dev, const bus_transaction_t *trans)
 {
-    if (!bus_handle) return ESP_ERR_INVALID_STATE;
-    i2c_master_dev_handle_t dev = get_device_handle(addr);
-    if (!dev) return ESP_FAIL;
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_STATE;
+    if (!trans || (trans->tx_len == 0 && trans->rx_len == 0)) return ESP_ERR_INVALID_ARG;
 
-    esp_err_t err = i2c_master_transmit(dev, data, len, -1);
+    i2c_port_t *port = dev->port;
+
+    if (xSemaphoreTake(port->free_slots, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+
+    xSemaphoreTake(port->submit_lock, portMAX_DELAY);
+
+    port->pending[port->pending_head] = (i2c_pending_t){ .done = trans->done, .arg = trans->arg };
+    port->pending_head = (port->pending_head + 1) % I2C_QUEUE_DEPTH;
+
+    esp_err_t err;
+    if (trans->tx_len && trans->rx_len)
+        err = i2c_master_transmit_receive(dev->dev, trans->tx, trans->tx_len, trans->rx, trans->rx_len, BUS_TIMEOUT_MS);
+    else if (trans->tx_len)
+        err = i2c_master_transmit(dev->dev, trans->tx, trans->tx_len, BUS_TIMEOUT_MS);
+    else
+        err = i2c_master_receive(dev->dev, trans->rx, trans->rx_len, BUS_TIMEOUT_MS);
+
+    if (err != ESP_OK) {
+        port->pending_head = (port->pending_head + I2C_QUEUE_DEPTH - 1) % I2C_QUEUE_DEPTH;
+        xSemaphoreGive(port->free_slots);
+    }
+
+    xSemaphoreGive(port->submit_lock);
+    return err;
+}
+
+static void sync_done(esp_err_t result, void *arg)
+{
+    i2c_port_t *port = arg;
+
+    port->sync_result = result;
+    port->sync_busy = false;
+
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(port->sync_done, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/* Waits for the sync transaction in flight, draining the queue if it is late. */
+static bool i2c_sync_settle(i2c_port_t *port)
+{
+    if (!port->sync_busy)
+        return true;
+
+    if (xSemaphoreTake(port->sync_done, pdMS_TO_TICKS(BUS_TIMEOUT_MS) + 1) != pdTRUE)
+        i2c_master_bus_wait_all_done(port->bus_handle, BUS_TIMEOUT_MS);
+
+    return !port->sync_busy;
+}
+
+/*
+ * Only one blocking transaction per port is in flight. One that outlives its
+ * caller's timeout keeps the bounce buffers: later calls fail with a timeout
+ * until it has completed, instead of overwriting what it still sends from or
+ * fills.
+ */
+static esp_err_t i2c_run_sync(bus_device_handle_t dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_STATE;
+    if (tx_len > I2C_SYNC_BUF_LEN || rx_len > I2C_SYNC_BUF_LEN) return ESP_ERR_INVALID_SIZE;
+
+    i2c_port_t *port = dev->port;
+
+    if (xSemaphoreTake(port->sync_lock, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+
+    if (!i2c_sync_settle(port)) {
+        xSemaphoreGive(port->sync_lock);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    /* Drop a completion of an earlier call that came after its timeout. */
+    xSemaphoreTake(port->sync_done, 0);
+
+    if (tx_len)
+        memcpy(port->sync_tx, tx, tx_len);
+    port->sync_result = ESP_ERR_TIMEOUT;
+    port->sync_busy = true;
+
+    bus_transaction_t trans = {
+        .tx = port->sync_tx,
+        .tx_len = tx_len,
+        .rx = port->sync_rx,
+        .rx_len = rx_len,
+        .done = sync_done,
+        .arg = port,
+    };
+
+    esp_err_t err = submit_i2c_bus(dev, &trans);
+    if (err != ESP_OK)
+        port->sync_busy = false;
+    else if (!i2c_sync_settle(port))
+        err = ESP_ERR_TIMEOUT;
+    else
+        err = port->sync_result;
+
+    if (err == ESP_OK && rx_len)
+        memcpy(rx, port->sync_rx, rx_len);
+
+    xSemaphoreGive(port->sync_lock);
+    return err;
+}
+
+esp_err_t read_i2c_bus(bus_device_handle_t dev, uint8_t *data, size_t len)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = i2c_run_sync(dev, NULL, 0, data, len);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "I2C read error from 0x%02X: %s", dev->addr, esp_err_to_name(err));
+
+    return err;
+}
+
+esp_err_t write_i2c_bus(bus_device_handle_t dev, const uint8_t *data, size_t len)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = i2c_run_sync(dev, data, len, NULL, 0);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "I2C write error to 0x%02X: %s", dev->addr, esp_err_to_name(err));
+
+    return err;
+}
+
+esp_err_t transfer_i2c_bus(bus_device_handle_t dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = i2c_run_sync(dev, tx, tx_len, rx, rx_len);
     if (err != ESP_OK)
-        ESP_LOGE(TAG, "I2C write error to 0x%02X: %s", addr, esp_err_to_name(err));
+        ESP_LOGE(TAG, "I2C transfer error with 0x%02X: %s", dev->addr, esp_err_to_name(err));
+
+    return err;
+}
 
+/*
+ * A slave that lost clocks mid-byte holds SDA low until it has shifted the
+ * byte out; the reset clocks SCL until SDA is released and sends a stop.
+ * Queued transactions end with a timeout event first, so the completion FIFO
+ * is empty when the controller is reset.
+ */
+esp_err_t recover_i2c_bus(bus_device_handle_t dev)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_STATE;
+
+    i2c_port_t *port = dev->port;
+
+    if (xSemaphoreTake(port->sync_lock, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+    xSemaphoreTake(port->submit_lock, portMAX_DELAY);
+
+    esp_err_t err = i2c_master_bus_wait_all_done(port->bus_handle, BUS_TIMEOUT_MS);
+    if (err == ESP_OK)
+        err = i2c_master_bus_reset(port->bus_handle);
+
+    xSemaphoreGive(port->submit_lock);
+    xSemaphoreGive(port->sync_lock);
+
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "I2C bus %d recovery failed: %s", (int)port->num, esp_err_to_name(err));
     return err;
 }
+
+#endif
@@ -1,28 +1,66 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_rom_sys.h>
 #include "bus.h"
+#include "../../../util/clock.h"
 
-bus_entry_t bus_table[MAX_BUSES_NUM];
+#ifdef CONFIG_IDF_TARGET_LINUX
+/* Provided by the host linker for sections named like C identifiers. */
+extern const bus_entry_t __start_meteo_bus_desc[];
+extern const bus_entry_t __stop_meteo_bus_desc[];
+#define BUS_DESC_START __start_meteo_bus_desc
+#define BUS_DESC_END   __stop_meteo_bus_desc
+#else
+/* Emitted by SURROUND(meteo_bus_desc) in linker.lf. */
+extern const bus_entry_t _meteo_bus_desc_start[];
+extern const bus_entry_t _meteo_bus_desc_end[];
+#define BUS_DESC_START _meteo_bus_desc_start
+#define BUS_DESC_END   _meteo_bus_desc_end
+#endif
+
+bus_t *bus_table[MAX_BUSES_NUM];
 bus_count_ty bus_count = 0;
 
+static void build_bus_table(void)
+{
+    if (bus_count)
+        return;
+
+    for (const bus_entry_t *entry = BUS_DESC_START; entry < BUS_DESC_END; ++entry) {
+        if (entry->bus == NULL || entry->bus->ops == NULL || entry->bus->ops->init == NULL) {
+            ESP_LOGE(SYSTEM_NAME, "Invalid ops or missing init() for bus [%d].", (int)entry->bus_id);
+            continue;
+        }
+
+        if (bus_table[entry->bus_id]) {
+            ESP_LOGE(SYSTEM_NAME, "Duplicate bus id [%d], ignored.", (int)entry->bus_id);
+            continue;
+        }
+
+        bus_table[entry->bus_id] = entry->bus;
+        bus_count++;
+    }
+}
+
 void init_buses(void) {
     ESP_LOGI(SYSTEM_NAME, "Start initializing buses...");
 
+    build_bus_table();
+
     for (bus_count_ty i = 0; i < MAX_BUSES_NUM; ++i) {
-        bus_entry_t *entry = &bus_table[i];
+        bus_t *bus = bus_table[i];
 
-        if (entry->bus == NULL) {
-            ESP_LOGI(SYSTEM_NAME, "Skipped free slot %d", i);
+        if (bus == NULL)
             continue;
-        }
 
-        bus_t *bus = entry->bus;
         esp_err_t err = bus->ops->init();
 
         if (err != ESP_OK) {
-            ESP_LOGE(SYSTEM_NAME, "Error init bus: [%d]. Code: %d", (int)entry->bus_id, err);
+            ESP_LOGE(SYSTEM_NAME, "Error init bus: [%d]. Code: %d", (int)i, err);
             continue;
         }
 
-        ESP_LOGI(SYSTEM_NAME, "Bus [%d] initialized successfully!", (int)entry->bus_id);
+        ESP_LOGI(SYSTEM_NAME, "Bus [%d] initialized successfully!", (int)i);
     }
 }
 
@@ -31,10 +69,121 @@ esp_err_t get_bus_by_id(bus_id id, bus_t **bus) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (bus_table[id].bus == NULL) {
+    if (bus_table[id] == NULL) {
         return ESP_ERR_INVALID_STATE;
     }
 
-    *bus = bus_table[id].bus;
+    *bus = bus_table[id];
+    return ESP_OK;
+}
+
+esp_err_t bus_set_policy(bus_id id, const bus_policy_t *policy)
+{
+    bus_t *bus = NULL;
+    esp_err_t err = get_bus_by_id(id, &bus);
+    if (err != ESP_OK)
+        return err;
+    if (!policy || policy->retries > BUS_MAX_RETRIES)
+        return ESP_ERR_INVALID_ARG;
+
+    bus->policy = *policy;
+    return ESP_OK;
+}
+
+esp_err_t bus_get_policy(bus_id id, bus_policy_t *policy)
+{
+    bus_t *bus = NULL;
+    esp_err_t err = get_bus_by_id(id, &bus);
+    if (err != ESP_OK)
+        return err;
+    if (!policy)
+        return ESP_ERR_INVALID_ARG;
+
+    *policy = bus->policy;
+    return ESP_OK;
+}
+
+/* Errors a glitch on the wire can cause; the rest would fail again. */
+static bool bus_transient(esp_err_t err)
+{
+    return err == ESP_FAIL || err == ESP_ERR_TIMEOUT || err == ESP_ERR_INVALID_RESPONSE || err == ESP_ERR_INVALID_CRC;
+}
+
+/*
+ * Backoffs of a tick or more sleep, rounded up to whole ticks. Shorter ones
+ * are delayed in place, since a tick would stretch them past the deadline.
+ */
+static void bus_backoff(uint32_t us)
+{
+    const uint32_t tick_us = 1000000 / configTICK_RATE_HZ;
+
+    if (us >= tick_us)
+        vTaskDelay((us + tick_us - 1) / tick_us);
+    else if (us)
+        esp_rom_delay_us(us);
+}
+
+bool bus_retry(bus_t *bus, bus_op_t op, bus_device_handle_t dev, bus_attempt_t *attempt, esp_err_t err)
+{
+    const bus_policy_t *p = &bus->policy;
+
+    if (err == ESP_OK || !bus_transient(err) || attempt->retries >= p->retries)
+        return false;
+
+    int64_t now = clock_now_us();
+    if (attempt->retries == 0)
+        attempt->first_fail_us = now;
+
+    /* Saturated at the deadline so a long backoff cannot wrap into a short one. */
+    uint64_t backoff = (uint64_t)p->backoff_us << attempt->retries;
+    if (backoff > p->deadline_us)
+        backoff = p->deadline_us;
+    if (now + (int64_t)backoff - attempt->first_fail_us > p->deadline_us)
+        return false;
+
+    if (err == ESP_ERR_TIMEOUT && p->recover && bus->ops->recover) {
+        esp_err_t rec = bus->ops->recover(dev);
+        if (rec == ESP_OK) {
+            bus->recoveries++;
+            ESP_LOGW(SYSTEM_NAME, "Bus [%d] recovered after a timeout", (int)bus->id);
+        } else if (rec != ESP_ERR_NOT_SUPPORTED) {
+            ESP_LOGE(SYSTEM_NAME, "Bus [%d] recovery failed: %s", (int)bus->id, esp_err_to_name(rec));
+        }
+    }
+
+    bus_backoff((uint32_t)backoff);
+    attempt->retries++;
+#ifdef CONFIG_METEO_INSTR
+    instr_retry(&bus->instr[op]);
+#endif
+    return true;
+}
+
+#ifdef CONFIG_METEO_INSTR
+bus_instr_pending_t *bus_instr_claim(bus_instr_pending_t *pool, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (!atomic_load_explicit(&pool[i].busy, memory_order_relaxed) &&
+            !atomic_exchange_explicit(&pool[i].busy, true, memory_order_acquire))
+            return &pool[i];
+    }
+    return NULL;
+}
+
+void bus_instr_release(bus_instr_pending_t *p)
+{
+    atomic_store_explicit(&p->busy, false, memory_order_release);
+}
+
+esp_err_t bus_get_instr(bus_id id, bus_op_t op, instr_snapshot_t *out)
+{
+    if (id >= MAX_BUSES_NUM || op >= BUS_OP_COUNT || !out)
+        return ESP_ERR_INVALID_ARG;
+
+    if (bus_table[id] == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    instr_snapshot(&bus_table[id]->instr[op], out);
     return ESP_OK;
-}
\ No newline at end of file
+}
+#endif
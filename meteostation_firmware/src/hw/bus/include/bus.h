@@ -2,25 +2,115 @@
 #define _BUS_H
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include <sdkconfig.h>
 #include <esp_err.h>
 #include <esp_log.h>
+#include "../../../util/instr.h"
 
 #define SYSTEM_NAME "Bus system"
 #define MAX_BUSES_NUM 8
+#define BUS_TIMEOUT_MS CONFIG_METEO_BUS_TIMEOUT_MS
 
 typedef uint8_t bus_count_ty;
 typedef uint64_t bus_id;
 
+/* Opaque per-device handle, defined by each bus backend. */
+typedef struct bus_device_t *bus_device_handle_t;
+
+typedef struct {
+    uint16_t addr;          /* I2C address */
+    uint32_t scl_speed_hz;  /* SCL on I2C, SCLK on SPI */
+    int cs_gpio;            /* SPI chip select */
+} bus_device_config_t;
+
+/*
+ * Completion callback of a submitted transaction. Hardware backends call it
+ * from interrupt context, so it must be short and only use ISR-safe calls.
+ */
+typedef void (*bus_done_cb_t)(esp_err_t result, void *arg);
+
+/*
+ * Write-then-read transaction; either phase may be empty. The buffers belong
+ * to the bus until done() has run.
+ */
+typedef struct {
+    const uint8_t *tx;
+    size_t tx_len;
+    uint8_t *rx;
+    size_t rx_len;
+    bus_done_cb_t done;
+    void *arg;
+} bus_transaction_t;
+
 typedef struct {
     esp_err_t (*init)(void);
     esp_err_t (*destruct)(void);
-    esp_err_t (*read)(uint8_t addr, uint8_t *data, size_t len);
-    esp_err_t (*write)(uint8_t addr, const uint8_t *data, size_t len);
+    esp_err_t (*attach)(const bus_device_config_t *config, bus_device_handle_t *dev);
+    /*
+     * Waits for the device's queued transactions, then removes it. Fails with
+     * ESP_ERR_TIMEOUT, the device still attached, if they do not finish.
+     */
+    esp_err_t (*detach)(bus_device_handle_t dev);
+    esp_err_t (*read)(bus_device_handle_t dev, uint8_t *data, size_t len);
+    esp_err_t (*write)(bus_device_handle_t dev, const uint8_t *data, size_t len);
+    esp_err_t (*transfer)(bus_device_handle_t dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len);
+    /* Queues a transaction and returns; ESP_ERR_TIMEOUT if the queue stays full for BUS_TIMEOUT_MS. */
+    esp_err_t (*submit)(bus_device_handle_t dev, const bus_transaction_t *trans);
+    /* Frees a bus held stuck by a device, e.g. by clocking SCL; ESP_ERR_NOT_SUPPORTED if there is nothing to free. */
+    esp_err_t (*recover)(bus_device_handle_t dev);
 } bus_operations_t;
 
+/*
+ * Error handling of the blocking operations. After a transient error (timeout,
+ * NACK, bad response) an operation is attempted again, waiting backoff_us
+ * before the first retry and twice as long before each next one, until
+ * `retries` are used up or deadline_us has passed since the first failure.
+ * With `recover` set, a timeout frees the bus before the retry. A submitted
+ * transaction's error reaches done(); the submitter applies the same policy
+ * with bus_retry(BUS_OP_SUBMIT) and submits it again.
+ */
+typedef struct {
+    uint32_t deadline_us;
+    uint32_t backoff_us;
+    uint8_t retries;
+    bool recover;
+} bus_policy_t;
+
+/* The backoff doubles per retry and is computed in 64 bits. */
+#define BUS_MAX_RETRIES 31
+
+#ifdef CONFIG_METEO_BUS_RECOVERY
+#define BUS_RECOVERY_DEFAULT true
+#else
+#define BUS_RECOVERY_DEFAULT false
+#endif
+
+#define BUS_POLICY_DEFAULT {                                  \
+    .deadline_us = CONFIG_METEO_BUS_DEADLINE_MS * 1000,       \
+    .backoff_us = CONFIG_METEO_BUS_BACKOFF_US,                \
+    .retries = CONFIG_METEO_BUS_RETRIES,                      \
+    .recover = BUS_RECOVERY_DEFAULT,                          \
+}
+
+/* Instrumented data operations, see bus_get_instr(). */
+typedef enum {
+    BUS_OP_READ,
+    BUS_OP_WRITE,
+    BUS_OP_TRANSFER,
+    /* From submit to done(), with the result done() got. */
+    BUS_OP_SUBMIT,
+    BUS_OP_COUNT,
+} bus_op_t;
+
 typedef struct {
     bus_id id;
     bus_operations_t *ops;
+    bus_policy_t policy;
+    uint32_t recoveries;         /* run by bus_retry() since boot */
+#ifdef CONFIG_METEO_INSTR
+    instr_stat_t instr[BUS_OP_COUNT];
+#endif
 } bus_t;
 
 typedef struct {
@@ -28,59 +118,224 @@ typedef struct {
     bus_t *bus;
 } bus_entry_t;
 
-extern bus_entry_t bus_table[MAX_BUSES_NUM];
+extern bus_t *bus_table[MAX_BUSES_NUM];
 extern bus_count_ty bus_count;
 
-#define REGISTER_BUS(id, bus_struct) \
-    do { \
-        if ((bus_struct) == NULL || (bus_struct)->bus == NULL) { \
-            ESP_LOGE(SYSTEM_NAME, "Null bus entry for bus [%d].", (int)(id)); \
-            break; \
-        } \
-        if ((bus_struct)->bus->ops == NULL || (bus_struct)->bus->ops->init == NULL) { \
-            ESP_LOGE(SYSTEM_NAME, "Invalid ops or missing init() for bus [%d].", (int)(id)); \
-            break; \
-        } \
-        if (bus_count < MAX_BUSES_NUM) { \
-            bus_table[bus_count].bus_id = (id); \
-            bus_table[bus_count].bus = (bus_struct)->bus; \
-            bus_count++; \
-            ESP_LOGI(SYSTEM_NAME, "Bus [%d] registered.", (int)(id)); \
-        } else { \
-            ESP_LOGE(SYSTEM_NAME, "Bus table full, cannot register [%d].", (int)(id)); \
-        } \
-    } while (0)
-
-#define DEFINE_BUS_REGISTER(ID, TAG_NAME, INIT_FN, DESTRUCT_FN, READ_FN, WRITE_FN)   \
+/*
+ * Bus descriptors are const entries collected in a dedicated linker section
+ * (see linker.lf); init_buses() indexes them by id once at boot.
+ */
+#define BUS_DESC_SECTION "meteo_bus_desc"
+
+#define BUS_CAT_(a, b) a##b
+#define BUS_CAT(a, b) BUS_CAT_(a, b)
+
+#ifdef CONFIG_METEO_INSTR
+/*
+ * Submitted transactions in flight on one bus that are being timed; past
+ * this many, further ones go through untimed.
+ */
+#define BUS_INSTR_PENDING 16
+
+/* Stands in for a submitted transaction's done() and arg until it completes. */
+typedef struct {
+    _Atomic bool busy;
+    uint32_t start;
+    size_t bytes;
+    bus_done_cb_t done;
+    void *arg;
+} bus_instr_pending_t;
+
+/* A free slot of the pool marked busy, NULL if all are in flight. ISR-safe. */
+bus_instr_pending_t *bus_instr_claim(bus_instr_pending_t *pool, size_t len);
+void bus_instr_release(bus_instr_pending_t *p);
+
+/* The ops table points at these wrappers, which time and count each call. */
+#define BUS_INSTR_THUNKS(TAG_NAME, READ_FN, WRITE_FN, TRANSFER_FN, SUBMIT_FN)           \
+    static esp_err_t TAG_NAME##_instr_read(bus_device_handle_t dev, uint8_t *data,   \
+                                           size_t len)                               \
+    {                                                                                \
+        uint32_t start = instr_cycles();                                             \
+        esp_err_t err = READ_FN(dev, data, len);                                     \
+        instr_record(&TAG_NAME##_bus.instr[BUS_OP_READ], start, len, err);           \
+        return err;                                                                  \
+    }                                                                                \
+                                                                                     \
+    static esp_err_t TAG_NAME##_instr_write(bus_device_handle_t dev,                 \
+                                            const uint8_t *data, size_t len)         \
+    {                                                                                \
+        uint32_t start = instr_cycles();                                             \
+        esp_err_t err = WRITE_FN(dev, data, len);                                    \
+        instr_record(&TAG_NAME##_bus.instr[BUS_OP_WRITE], start, len, err);          \
+        return err;                                                                  \
+    }                                                                                \
+                                                                                     \
+    static esp_err_t TAG_NAME##_instr_transfer(bus_device_handle_t dev,              \
+                                               const uint8_t *tx, size_t tx_len,     \
+                                               uint8_t *rx, size_t rx_len)           \
+    {                                                                                \
+        uint32_t start = instr_cycles();                                             \
+        esp_err_t err = TRANSFER_FN(dev, tx, tx_len, rx, rx_len);                    \
+        instr_record(&TAG_NAME##_bus.instr[BUS_OP_TRANSFER], start,                  \
+                     tx_len + rx_len, err);                                          \
+        return err;                                                                  \
+    }                                                                                \
+                                                                                     \
+    static bus_instr_pending_t TAG_NAME##_instr_pending[BUS_INSTR_PENDING];          \
+                                                                                     \
+    static void TAG_NAME##_instr_done(esp_err_t result, void *arg)                   \
+    {                                                                                \
+        bus_instr_pending_t *p = arg;                                                \
+        bus_done_cb_t done = p->done;                                                \
+        void *done_arg = p->arg;                                                     \
+        instr_record(&TAG_NAME##_bus.instr[BUS_OP_SUBMIT], p->start, p->bytes,      \
+                     result);                                                        \
+        bus_instr_release(p);                                                        \
+        if (done)                                                                    \
+            done(result, done_arg);                                                  \
+    }                                                                                \
+                                                                                     \
+    static esp_err_t TAG_NAME##_instr_submit(bus_device_handle_t dev,                \
+                                             const bus_transaction_t *trans)         \
+    {                                                                                \
+        bus_instr_pending_t *p = bus_instr_claim(TAG_NAME##_instr_pending,           \
+                                                 BUS_INSTR_PENDING);                 \
+        if (!p)                                                                      \
+            return SUBMIT_FN(dev, trans);                                            \
+                                                                                     \
+        bus_transaction_t timed = *trans;                                            \
+        p->done = trans->done;                                                       \
+        p->arg = trans->arg;                                                         \
+        p->bytes = trans->tx_len + trans->rx_len;                                    \
+        timed.done = TAG_NAME##_instr_done;                                          \
+        timed.arg = p;                                                               \
+        p->start = instr_cycles();                                                   \
+        esp_err_t err = SUBMIT_FN(dev, &timed);                                      \
+        if (err != ESP_OK) {                                                         \
+            instr_record(&TAG_NAME##_bus.instr[BUS_OP_SUBMIT], p->start, p->bytes,  \
+                         err);                                                       \
+            bus_instr_release(p);                                                    \
+        }                                                                            \
+        return err;                                                                  \
+    }
+
+#define BUS_INSTR_OP(TAG_NAME, OP, FN) TAG_NAME##_instr_##OP
+#else
+#define BUS_INSTR_THUNKS(TAG_NAME, READ_FN, WRITE_FN, TRANSFER_FN, SUBMIT_FN)
+#define BUS_INSTR_OP(TAG_NAME, OP, FN) FN
+#endif
+
+/* State of one operation across its attempts, see bus_retry(). */
+typedef struct {
+    int64_t first_fail_us;
+    uint8_t retries;
+} bus_attempt_t;
+
+/*
+ * Applies the bus policy after an attempt that returned err: true after
+ * waiting out the backoff (and recovering the bus) if the operation should be
+ * attempted again.
+ */
+bool bus_retry(bus_t *bus, bus_op_t op, bus_device_handle_t dev, bus_attempt_t *attempt, esp_err_t err);
+
+/* The blocking ops run these loops; the instrumentation wraps them whole. */
+#define BUS_POLICY_THUNKS(TAG_NAME, READ_FN, WRITE_FN, TRANSFER_FN)                       \
+    static bus_t TAG_NAME##_bus;                                                     \
+                                                                                     \
+    static esp_err_t TAG_NAME##_retry_read(bus_device_handle_t dev, uint8_t *data,   \
+                                           size_t len)                               \
+    {                                                                                \
+        bus_attempt_t attempt = { 0 };                                               \
+        esp_err_t err;                                                               \
+        do {                                                                         \
+            err = READ_FN(dev, data, len);                                           \
+        } while (bus_retry(&TAG_NAME##_bus, BUS_OP_READ, dev, &attempt, err));       \
+        return err;                                                                  \
+    }                                                                                \
+                                                                                     \
+    static esp_err_t TAG_NAME##_retry_write(bus_device_handle_t dev,                 \
+                                            const uint8_t *data, size_t len)         \
+    {                                                                                \
+        bus_attempt_t attempt = { 0 };                                               \
+        esp_err_t err;                                                               \
+        do {                                                                         \
+            err = WRITE_FN(dev, data, len);                                          \
+        } while (bus_retry(&TAG_NAME##_bus, BUS_OP_WRITE, dev, &attempt, err));      \
+        return err;                                                                  \
+    }                                                                                \
+                                                                                     \
+    static esp_err_t TAG_NAME##_retry_transfer(bus_device_handle_t dev,              \
+                                               const uint8_t *tx, size_t tx_len,     \
+                                               uint8_t *rx, size_t rx_len)           \
+    {                                                                                \
+        bus_attempt_t attempt = { 0 };                                               \
+        esp_err_t err;                                                               \
+        do {                                                                         \
+            err = TRANSFER_FN(dev, tx, tx_len, rx, rx_len);                          \
+        } while (bus_retry(&TAG_NAME##_bus, BUS_OP_TRANSFER, dev, &attempt, err));   \
+        return err;                                                                  \
+    }
+
+#define DEFINE_BUS_REGISTER(ID, TAG_NAME, INIT_FN, DESTRUCT_FN, ATTACH_FN, DETACH_FN, READ_FN, WRITE_FN, TRANSFER_FN, SUBMIT_FN, RECOVER_FN) \
     static esp_err_t INIT_FN(void);                                                  \
     static esp_err_t DESTRUCT_FN(void);                                              \
-    static esp_err_t READ_FN(uint8_t addr, uint8_t *data, size_t len);               \
-    static esp_err_t WRITE_FN(uint8_t addr, const uint8_t *data, size_t len);        \
+    static esp_err_t ATTACH_FN(const bus_device_config_t *config,                    \
+                               bus_device_handle_t *dev);                            \
+    static esp_err_t DETACH_FN(bus_device_handle_t dev);                             \
+    static esp_err_t READ_FN(bus_device_handle_t dev, uint8_t *data, size_t len);    \
+    static esp_err_t WRITE_FN(bus_device_handle_t dev, const uint8_t *data,          \
+                              size_t len);                                           \
+    static esp_err_t TRANSFER_FN(bus_device_handle_t dev, const uint8_t *tx,         \
+                                 size_t tx_len, uint8_t *rx, size_t rx_len);         \
+    static esp_err_t SUBMIT_FN(bus_device_handle_t dev,                              \
+                               const bus_transaction_t *trans);                      \
+    static esp_err_t RECOVER_FN(bus_device_handle_t dev);                            \
+                                                                                     \
+    BUS_POLICY_THUNKS(TAG_NAME, READ_FN, WRITE_FN, TRANSFER_FN)                      \
+    BUS_INSTR_THUNKS(TAG_NAME, TAG_NAME##_retry_read, TAG_NAME##_retry_write,        \
+                     TAG_NAME##_retry_transfer, SUBMIT_FN)                           \
                                                                                      \
     static bus_operations_t TAG_NAME##_ops = {                                       \
         .init = INIT_FN,                                                             \
         .destruct = DESTRUCT_FN,                                                     \
-        .read = READ_FN,                                                             \
-        .write = WRITE_FN                                                            \
+        .attach = ATTACH_FN,                                                         \
+        .detach = DETACH_FN,                                                         \
+        .read = BUS_INSTR_OP(TAG_NAME, read, TAG_NAME##_retry_read),                 \
+        .write = BUS_INSTR_OP(TAG_NAME, write, TAG_NAME##_retry_write),              \
+        .transfer = BUS_INSTR_OP(TAG_NAME, transfer, TAG_NAME##_retry_transfer),     \
+        .submit = BUS_INSTR_OP(TAG_NAME, submit, SUBMIT_FN),                         \
+        .recover = RECOVER_FN                                                        \
     };                                                                               \
                                                                                      \
     static bus_t TAG_NAME##_bus = {                                                  \
         .id = (ID),                                                                  \
-        .ops = &TAG_NAME##_ops                                                       \
+        .ops = &TAG_NAME##_ops,                                                      \
+        .policy = BUS_POLICY_DEFAULT                                                 \
     };                                                                               \
                                                                                      \
-    static bus_entry_t TAG_NAME##_entry = {                                          \
+    _Static_assert((ID) < MAX_BUSES_NUM, "Bus id out of range");                     \
+                                                                                     \
+    /* A second bus with the same id fails to link on this symbol. */               \
+    const char BUS_CAT(meteo_bus_id_, ID) = 0;                                       \
+                                                                                     \
+    static const bus_entry_t TAG_NAME##_entry                                        \
+        __attribute__((used, section(BUS_DESC_SECTION))) = {                         \
         .bus_id = (ID),                                                              \
         .bus = &TAG_NAME##_bus                                                       \
-    };                                                                               \
-                                                                                     \
-    __attribute__((constructor)) static void TAG_NAME##_auto_register(void) {        \
-        REGISTER_BUS(ID, &TAG_NAME##_entry);                                         \
-    }
+    };
 
 
 void init_buses(void);
 
 esp_err_t get_bus_by_id(bus_id id, bus_t **bus);
 
+/* ESP_ERR_INVALID_ARG if retries exceeds BUS_MAX_RETRIES. */
+esp_err_t bus_set_policy(bus_id id, const bus_policy_t *policy);
+esp_err_t bus_get_policy(bus_id id, bus_policy_t *policy);
+
+#ifdef CONFIG_METEO_INSTR
+/* Counters of one operation since boot. */
+esp_err_t bus_get_instr(bus_id id, bus_op_t op, instr_snapshot_t *out);
+#endif
+
 #endif
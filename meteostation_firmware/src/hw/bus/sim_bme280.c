@@ -0,0 +1,233 @@
+#include <sdkconfig.h>
+
+#if defined(CONFIG_METEO_BUS_SIM_I2C) || defined(CONFIG_METEO_BUS_SIM_SPI)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <esp_log.h>
+#include "sim_bme280.h"
+#include "../driver/bme280/bme_280_compensate.h"
+
+#define BME280_REG_DATA     0xF7
+#define BME280_REG_CHIP_ID  0xD0
+#define BME280_REG_CALIB1   0x88
+#define BME280_REG_CALIB2   0xE1
+#define BME280_REG_CTRL_HUM 0xF2
+#define BME280_REG_CTRL_MEAS 0xF4
+#define BME280_CHIP_ID      0x60
+
+static const char *TAG = "SIM_BME280";
+
+static const uint8_t bme280_calib1[BME280_CALIB1_LEN] = {
+    0x70, 0x6B, 0x43, 0x67, 0x18, 0xFC, 0x7D, 0x8E, 0x43, 0xD6, 0xD0, 0x0B, 0x27,
+    0x0B, 0x8C, 0x00, 0xF9, 0xFF, 0x8C, 0x3C, 0xF8, 0xC6, 0x70, 0x17, 0x00, 0x4B
+};
+
+static const uint8_t bme280_calib2[BME280_CALIB2_LEN] = {
+    0x6A, 0x01, 0x00, 0x13, 0x29, 0x03, 0x1E
+};
+
+static const uint8_t default_trace[][SIM_BME280_SAMPLE_LEN] = {
+    { 0x64, 0x40, 0x70, 0x7B, 0xBF, 0x00, 0x73, 0xE0 },
+    { 0x64, 0x56, 0xB0, 0x7C, 0x57, 0x90, 0x73, 0x96 },
+    { 0x64, 0x69, 0x90, 0x7C, 0xD8, 0xE0, 0x72, 0xCF },
+    { 0x64, 0x76, 0x20, 0x7D, 0x2F, 0x50, 0x71, 0xA8 },
+    { 0x64, 0x7A, 0x90, 0x7D, 0x4D, 0xB0, 0x70, 0x4E },
+    { 0x64, 0x76, 0x20, 0x7D, 0x2F, 0x50, 0x6E, 0xF6 },
+    { 0x64, 0x69, 0x90, 0x7C, 0xD8, 0xE0, 0x6D, 0xD2 },
+    { 0x64, 0x56, 0xB0, 0x7C, 0x57, 0x90, 0x6D, 0x10 },
+    { 0x64, 0x40, 0x70, 0x7B, 0xBF, 0x00, 0x6C, 0xCD },
+    { 0x64, 0x2A, 0x20, 0x7B, 0x26, 0x80, 0x6D, 0x13 },
+    { 0x64, 0x17, 0x30, 0x7A, 0xA5, 0x30, 0x6D, 0xD9 },
+    { 0x64, 0x0A, 0x80, 0x7A, 0x4E, 0xE0, 0x6F, 0x01 },
+    { 0x64, 0x06, 0x10, 0x7A, 0x30, 0x80, 0x70, 0x5D },
+    { 0x64, 0x0A, 0x80, 0x7A, 0x4E, 0xE0, 0x71, 0xB9 },
+    { 0x64, 0x17, 0x30, 0x7A, 0xA5, 0x30, 0x72, 0xDE },
+    { 0x64, 0x2A, 0x20, 0x7B, 0x26, 0x80, 0x73, 0x9F },
+};
+
+static const uint8_t (*trace)[SIM_BME280_SAMPLE_LEN] = default_trace;
+static size_t trace_len = sizeof(default_trace) / sizeof(default_trace[0]);
+static uint8_t *trace_file_buf = NULL;
+/* Incremented by every bus's sensors; they may run on different workers. */
+static _Atomic uint32_t samples_served = 0;
+
+/* A new trace restarts every sensor; checked on each data read. */
+static _Atomic uint32_t trace_gen = 0;
+
+void sim_bme280_power_cycle(sim_bme280_t *sensor)
+{
+    memset(sensor->regs, 0, sizeof(sensor->regs));
+    memcpy(&sensor->regs[BME280_REG_CALIB1], bme280_calib1, sizeof(bme280_calib1));
+    memcpy(&sensor->regs[BME280_REG_CALIB2], bme280_calib2, sizeof(bme280_calib2));
+    sensor->regs[BME280_REG_CHIP_ID] = BME280_CHIP_ID;
+}
+
+void sim_bme280_reset(sim_bme280_t *sensor)
+{
+    sim_bme280_power_cycle(sensor);
+    sensor->trace_pos = 0;
+    sensor->trace_gen = atomic_load(&trace_gen);
+}
+
+/* Channels with oversampling 0 read as the skip values, like after a reset. */
+static void apply_skipped(uint8_t *block, const uint8_t *regs)
+{
+    static const uint8_t skip20[3] = { 0x80, 0x00, 0x00 };
+
+    if (((regs[BME280_REG_CTRL_MEAS] >> 2) & 0x07) == 0)
+        memcpy(&block[0], skip20, 3);
+    if ((regs[BME280_REG_CTRL_MEAS] >> 5) == 0)
+        memcpy(&block[3], skip20, 3);
+    if ((regs[BME280_REG_CTRL_HUM] & 0x07) == 0) {
+        block[6] = 0x80;
+        block[7] = 0x00;
+    }
+}
+
+void sim_bme280_write(sim_bme280_t *sensor, uint8_t reg, uint8_t value)
+{
+    sensor->regs[reg] = value;
+}
+
+void sim_bme280_read(sim_bme280_t *sensor, uint8_t reg, uint8_t *data, size_t len)
+{
+    if (reg == BME280_REG_DATA && trace_len > 0) {
+        uint32_t gen = atomic_load(&trace_gen);
+        if (sensor->trace_gen != gen) {
+            sensor->trace_gen = gen;
+            sensor->trace_pos = 0;
+        }
+
+        memcpy(&sensor->regs[BME280_REG_DATA], trace[sensor->trace_pos], SIM_BME280_SAMPLE_LEN);
+        apply_skipped(&sensor->regs[BME280_REG_DATA], sensor->regs);
+        sensor->trace_pos = (sensor->trace_pos + 1) % trace_len;
+        atomic_fetch_add(&samples_served, 1);
+    }
+
+    for (size_t i = 0; i < len; i++)
+        data[i] = sensor->regs[reg++];
+}
+
+void sim_bme280_set_trace(const uint8_t (*samples)[SIM_BME280_SAMPLE_LEN], size_t count)
+{
+    trace = samples;
+    trace_len = count;
+    atomic_fetch_add(&trace_gen, 1);
+}
+
+esp_err_t sim_bme280_load_trace_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        ESP_LOGE(TAG, "Cannot open trace %s", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (size < SIM_BME280_SAMPLE_LEN || size % SIM_BME280_SAMPLE_LEN != 0) {
+        ESP_LOGE(TAG, "Trace %s has invalid size %ld", path, size);
+        fclose(f);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *buf = malloc(size);
+    if (!buf) {
+        fclose(f);
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t got = fread(buf, 1, size, f);
+    fclose(f);
+    if (got != (size_t)size) {
+        free(buf);
+        return ESP_FAIL;
+    }
+
+    free(trace_file_buf);
+    trace_file_buf = buf;
+    sim_bme280_set_trace((const uint8_t (*)[SIM_BME280_SAMPLE_LEN])buf, size / SIM_BME280_SAMPLE_LEN);
+
+    ESP_LOGI(TAG, "Loaded %ld trace samples from %s", size / SIM_BME280_SAMPLE_LEN, path);
+    return ESP_OK;
+}
+
+size_t sim_bme280_trace_len(void)
+{
+    return trace_len;
+}
+
+uint32_t sim_bme280_samples_served(void)
+{
+    return atomic_load(&samples_served);
+}
+
+static float get_temp(const bme280_data_t *d) { return d->temp; }
+static float get_pressure(const bme280_data_t *d) { return d->pressure; }
+static float get_humidity(const bme280_data_t *d) { return d->humidity; }
+
+/* Binary search over one raw field; compensation is monotonic in each of them. */
+static void invert_field(const bme_calibration_data_t *calib, bme280_raw_t *raw, int32_t *field, int bits,
+                         float (*get)(const bme280_data_t *), float want, bool rising)
+{
+    bme280_data_t out;
+    int32_t lo = 0, hi = (1 << bits) - 1;
+
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        *field = mid;
+        bme280_compensate(calib, raw, &out);
+        float v = get(&out);
+        if (rising ? v >= want : v <= want)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    /* lo is the first value past want; the one before may be closer. */
+    *field = lo;
+    bme280_compensate(calib, raw, &out);
+    float above = get(&out) - want;
+    if (lo > 0) {
+        *field = lo - 1;
+        bme280_compensate(calib, raw, &out);
+        if (fabsf(get(&out) - want) <= fabsf(above))
+            return;
+    }
+    *field = lo;
+}
+
+void sim_bme280_encode_sample(const bme280_data_t *data, uint8_t out[SIM_BME280_SAMPLE_LEN])
+{
+    static bme_calibration_data_t calib;
+    static bool parsed = false;
+
+    if (!parsed) {
+        bme280_parse_calibration(bme280_calib1, bme280_calib2, &calib);
+        parsed = true;
+    }
+
+    /* Temperature first: the other two depend on it through t_fine. */
+    bme280_raw_t raw = { .temp = 0x80000, .press = 0x80000, .hum = 0x8000 };
+    invert_field(&calib, &raw, &raw.temp, 20, get_temp, data->temp, true);
+    invert_field(&calib, &raw, &raw.press, 20, get_pressure, data->pressure, false);
+    invert_field(&calib, &raw, &raw.hum, 16, get_humidity, data->humidity, true);
+
+    out[0] = (uint8_t)(raw.press >> 12);
+    out[1] = (uint8_t)(raw.press >> 4);
+    out[2] = (uint8_t)(raw.press << 4);
+    out[3] = (uint8_t)(raw.temp >> 12);
+    out[4] = (uint8_t)(raw.temp >> 4);
+    out[5] = (uint8_t)(raw.temp << 4);
+    out[6] = (uint8_t)(raw.hum >> 8);
+    out[7] = (uint8_t)raw.hum;
+}
+
+#endif
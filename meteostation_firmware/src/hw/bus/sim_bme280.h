@@ -0,0 +1,58 @@
+#ifndef _SIM_BME280_H
+#define _SIM_BME280_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include "../driver/bme280/bme_280.h"
+
+#define SIM_BME280_SAMPLE_LEN 8
+
+/*
+ * Register model of one BME280 behind a simulated bus. Registers use the
+ * full 8-bit (I2C) addresses; the SPI bus restores bit 7 before calling in.
+ * Every sensor replays the same trace from its own position, as redundant
+ * sensors on one mast see the same air. Not locked: the owning bus
+ * serializes calls to each sensor.
+ */
+typedef struct {
+    uint8_t regs[256];
+    size_t trace_pos;
+    uint32_t trace_gen;
+} sim_bme280_t;
+
+void sim_bme280_reset(sim_bme280_t *sensor);
+
+/*
+ * Power-on reset: registers go back to their defaults, so the sensor sleeps
+ * with all oversampling off until reconfigured. The trace position is kept.
+ */
+void sim_bme280_power_cycle(sim_bme280_t *sensor);
+
+void sim_bme280_write(sim_bme280_t *sensor, uint8_t reg, uint8_t value);
+
+/* Burst read with auto-increment; a read at the data block serves the next trace sample. */
+void sim_bme280_read(sim_bme280_t *sensor, uint8_t reg, uint8_t *data, size_t len);
+
+/*
+ * Replace the replay trace. Each entry is the 8-byte data block the sensor
+ * exposes at 0xF7..0xFE; entries are served in order and wrap around.
+ * The buffer must outlive the buses.
+ */
+void sim_bme280_set_trace(const uint8_t (*samples)[SIM_BME280_SAMPLE_LEN], size_t count);
+
+/* Load a trace from a file of raw 8-byte data blocks. */
+esp_err_t sim_bme280_load_trace_file(const char *path);
+
+size_t sim_bme280_trace_len(void);
+
+/* Data blocks served by all sensors. */
+uint32_t sim_bme280_samples_served(void);
+
+/*
+ * The data block the simulated sensor reports for the given conditions
+ * (degC, hPa, %RH): the raw values whose compensation comes closest.
+ */
+void sim_bme280_encode_sample(const bme280_data_t *data, uint8_t out[SIM_BME280_SAMPLE_LEN]);
+
+#endif
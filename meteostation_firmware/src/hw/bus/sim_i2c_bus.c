@@ -0,0 +1,413 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_BUS_SIM_I2C
+
+#include <string.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include "include/bus.h"
+#include "sim_i2c_bus.h"
+#include "sim_bme280.h"
+
+#define I2C_BUS_ID          0x0
+#define I2C1_BUS_ID         0x2
+#define SIM_DEFAULT_SCL_HZ  100000
+#define SIM_MAX_DEVICES     8
+#define SIM_QUEUE_DEPTH     8
+#define SIM_WORKER_STACK    4096
+#define SIM_WORKER_PRIORITY 12
+
+static const char *TAG = "SIM_I2C_BUS";
+
+/* A BME280 answers at each of its two addresses on every port. */
+typedef struct {
+    sim_bme280_t model;
+    uint8_t reg_ptr;
+} sim_sensor_t;
+
+typedef struct sim_port_t sim_port_t;
+
+struct bus_device_t {
+    sim_port_t *port;
+    sim_sensor_t *sensor;   /* NULL: nothing at this address */
+    uint16_t addr;
+    uint32_t scl_speed_hz;
+    bool attached;
+};
+
+/*
+ * Submitted transactions are completed by a worker task per port, which
+ * stands in for the controller ISR, so the ports run in parallel like the
+ * two controllers do; the sensors are shared with blocking callers.
+ */
+typedef struct {
+    bus_device_handle_t dev;
+    bus_transaction_t trans;
+} sim_job_t;
+
+struct sim_port_t {
+    int num;
+    bool ready;
+    struct bus_device_t devices[SIM_MAX_DEVICES];
+    sim_sensor_t sensors[SIM_I2C_BME280_COUNT];
+    sim_i2c_stats_t stats;
+    sim_i2c_fault_t fault;
+    uint32_t fault_seen;
+    bool stuck;
+    QueueHandle_t jobs;
+    SemaphoreHandle_t lock;
+    TaskHandle_t worker;
+    /* Submitted jobs whose done() has not returned yet. */
+    atomic_uint in_flight;
+};
+
+static sim_port_t ports[SIM_I2C_PORTS] = {
+    { .num = 0 },
+    { .num = 1 },
+};
+
+
+DEFINE_BUS_REGISTER(
+    I2C_BUS_ID,
+    sim_i2c,
+    init_sim_i2c_bus,
+    destroy_sim_i2c_bus,
+    attach_sim_i2c_device,
+    detach_sim_i2c_device,
+    read_sim_i2c_bus,
+    write_sim_i2c_bus,
+    transfer_sim_i2c_bus,
+    submit_sim_i2c_bus,
+    recover_sim_i2c_bus
+)
+
+#ifdef CONFIG_METEO_BUS_I2C1
+DEFINE_BUS_REGISTER(
+    I2C1_BUS_ID,
+    sim_i2c1,
+    init_sim_i2c1_bus,
+    destroy_sim_i2c1_bus,
+    attach_sim_i2c1_device,
+    detach_sim_i2c_device,
+    read_sim_i2c_bus,
+    write_sim_i2c_bus,
+    transfer_sim_i2c_bus,
+    submit_sim_i2c_bus,
+    recover_sim_i2c_bus
+)
+#endif
+
+static void sim_worker(void *arg);
+
+static esp_err_t sim_port_init(sim_port_t *port)
+{
+    ESP_LOGI(TAG, "Initializing simulated I2C bus %d...", port->num);
+
+    if (port->ready) {
+        ESP_LOGW(TAG, "Bus already initialized");
+        return ESP_OK;
+    }
+
+    /* The worker outlives destroy/init cycles so no job is ever orphaned. */
+    if (!port->worker) {
+        port->jobs = xQueueCreate(SIM_QUEUE_DEPTH, sizeof(sim_job_t));
+        port->lock = xSemaphoreCreateMutex();
+        if (!port->jobs || !port->lock)
+            return ESP_ERR_NO_MEM;
+
+        if (xTaskCreate(sim_worker, "sim_i2c", SIM_WORKER_STACK, port, SIM_WORKER_PRIORITY, &port->worker) != pdPASS) {
+            port->worker = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    for (size_t i = 0; i < SIM_I2C_BME280_COUNT; i++) {
+        sim_bme280_reset(&port->sensors[i].model);
+        port->sensors[i].reg_ptr = 0;
+    }
+    port->ready = true;
+
+    ESP_LOGI(TAG, "Simulated I2C bus %d ready, %u trace samples.", port->num, (unsigned)sim_bme280_trace_len());
+    return ESP_OK;
+}
+
+static esp_err_t sim_port_destroy(sim_port_t *port)
+{
+    if (!port->ready) return ESP_ERR_INVALID_STATE;
+
+    for (size_t i = 0; i < SIM_MAX_DEVICES; i++)
+        port->devices[i].attached = false;
+    port->ready = false;
+
+    ESP_LOGI(TAG, "Simulated I2C bus %d destroyed.", port->num);
+    return ESP_OK;
+}
+
+static esp_err_t sim_port_attach(sim_port_t *port, const bus_device_config_t *config, bus_device_handle_t *dev)
+{
+    if (!config || !dev) return ESP_ERR_INVALID_ARG;
+    if (!port->ready) return ESP_ERR_INVALID_STATE;
+
+    struct bus_device_t *slot = NULL;
+    for (size_t i = 0; i < SIM_MAX_DEVICES; i++) {
+        if (port->devices[i].attached && port->devices[i].addr == config->addr)
+            return ESP_ERR_INVALID_STATE;
+        if (!port->devices[i].attached && !slot)
+            slot = &port->devices[i];
+    }
+
+    if (!slot) return ESP_ERR_NO_MEM;
+
+    unsigned sensor = config->addr - SIM_I2C_BME280_ADDR;
+
+    slot->port = port;
+    slot->sensor = sensor < SIM_I2C_BME280_COUNT ? &port->sensors[sensor] : NULL;
+    slot->addr = config->addr;
+    slot->scl_speed_hz = config->scl_speed_hz ? config->scl_speed_hz : SIM_DEFAULT_SCL_HZ;
+    slot->attached = true;
+    *dev = slot;
+    return ESP_OK;
+}
+
+esp_err_t init_sim_i2c_bus(void)
+{
+    return sim_port_init(&ports[0]);
+}
+
+esp_err_t destroy_sim_i2c_bus(void)
+{
+    return sim_port_destroy(&ports[0]);
+}
+
+esp_err_t attach_sim_i2c_device(const bus_device_config_t *config, bus_device_handle_t *dev)
+{
+    return sim_port_attach(&ports[0], config, dev);
+}
+
+#ifdef CONFIG_METEO_BUS_I2C1
+esp_err_t init_sim_i2c1_bus(void)
+{
+    return sim_port_init(&ports[1]);
+}
+
+esp_err_t destroy_sim_i2c1_bus(void)
+{
+    return sim_port_destroy(&ports[1]);
+}
+
+esp_err_t attach_sim_i2c1_device(const bus_device_config_t *config, bus_device_handle_t *dev)
+{
+    return sim_port_attach(&ports[1], config, dev);
+}
+#endif
+
+/* Like the controller queue, waits for every job of the port. */
+esp_err_t detach_sim_i2c_device(bus_device_handle_t dev)
+{
+    if (!dev || !dev->attached) return ESP_ERR_INVALID_ARG;
+
+    TickType_t waited = 0;
+    while (atomic_load(&dev->port->in_flight)) {
+        if (waited++ > pdMS_TO_TICKS(BUS_TIMEOUT_MS))
+            return ESP_ERR_TIMEOUT;
+        vTaskDelay(1);
+    }
+
+    dev->attached = false;
+    return ESP_OK;
+}
+
+/* BME280 write semantics: (register, value) pairs; a lone byte sets the read pointer. */
+static void sim_set_pointer(sim_sensor_t *sensor, const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+    for (; i + 1 < len; i += 2)
+        sim_bme280_write(&sensor->model, data[i], data[i + 1]);
+
+    if (i < len)
+        sensor->reg_ptr = data[i];
+}
+
+static void sim_read_regs(sim_sensor_t *sensor, uint8_t *data, size_t len)
+{
+    sim_bme280_read(&sensor->model, sensor->reg_ptr, data, len);
+    sensor->reg_ptr += len;
+}
+
+/*
+ * Time the transaction would hold a real bus: 9 clocks per byte including
+ * the address bytes, plus start, repeated start and stop.
+ */
+static uint64_t sim_wire_ns(const struct bus_device_t *dev, size_t tx_len, size_t rx_len)
+{
+    uint32_t clocks = 9 * (tx_len + rx_len) + 2;
+    if (tx_len)
+        clocks += 9;
+    if (rx_len)
+        clocks += 9;
+    if (tx_len && rx_len)
+        clocks += 1;
+
+    return (uint64_t)clocks * 1000000000ull / dev->scl_speed_hz;
+}
+
+/* Called with the port locked. */
+static esp_err_t sim_fault(sim_port_t *port)
+{
+    const sim_i2c_fault_t *f = &port->fault;
+    uint32_t n = ++port->fault_seen;
+
+    if (f->stick_at && n == f->stick_at)
+        port->stuck = true;
+
+    /* A slave stretching the clock; the port stays busy meanwhile. */
+    if (f->stall_at && n == f->stall_at)
+        vTaskDelay(pdMS_TO_TICKS(f->stall_ms));
+
+    esp_err_t err = ESP_OK;
+    if (port->stuck)
+        err = ESP_ERR_TIMEOUT;
+    else if (f->nack_every && n % f->nack_every == 0)
+        err = ESP_FAIL;
+
+    if (err != ESP_OK)
+        port->stats.faults++;
+    return err;
+}
+
+static esp_err_t sim_transaction(bus_device_handle_t dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    if (!dev || !dev->attached || !dev->port->ready) return ESP_ERR_INVALID_STATE;
+    if (!dev->sensor) return ESP_FAIL;
+
+    sim_port_t *port = dev->port;
+    if (xSemaphoreTake(port->lock, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+
+    esp_err_t err = sim_fault(port);
+    if (err != ESP_OK) {
+        xSemaphoreGive(port->lock);
+        return err;
+    }
+
+    if (tx_len)
+        sim_set_pointer(dev->sensor, tx, tx_len);
+    if (rx_len)
+        sim_read_regs(dev->sensor, rx, rx_len);
+
+    port->stats.transactions++;
+    port->stats.bytes += tx_len + rx_len;
+    port->stats.wire_ns += sim_wire_ns(dev, tx_len, rx_len);
+
+    xSemaphoreGive(port->lock);
+    return ESP_OK;
+}
+
+static void sim_worker(void *arg)
+{
+    sim_port_t *port = arg;
+    sim_job_t job;
+
+    while (1) {
+        if (xQueueReceive(port->jobs, &job, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        esp_err_t err = sim_transaction(job.dev, job.trans.tx, job.trans.tx_len, job.trans.rx, job.trans.rx_len);
+        if (job.trans.done)
+            job.trans.done(err, job.trans.arg);
+        atomic_fetch_sub(&port->in_flight, 1);
+    }
+}
+
+esp_err_t read_sim_i2c_bus(bus_device_handle_t dev, uint8_t *data, size_t len)
+{
+    return sim_transaction(dev, NULL, 0, data, len);
+}
+
+esp_err_t write_sim_i2c_bus(bus_device_handle_t dev, const uint8_t *data, size_t len)
+{
+    if (len == 0) return ESP_ERR_INVALID_ARG;
+
+    return sim_transaction(dev, data, len, NULL, 0);
+}
+
+esp_err_t transfer_sim_i2c_bus(bus_device_handle_t dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    if (tx_len == 0) return ESP_ERR_INVALID_ARG;
+
+    return sim_transaction(dev, tx, tx_len, rx, rx_len);
+}
+
+esp_err_t submit_sim_i2c_bus(bus_device_handle_t dev, const bus_transaction_t *trans)
+{
+    if (!dev || !dev->attached || !dev->port->ready) return ESP_ERR_INVALID_STATE;
+    if (!trans || (trans->tx_len == 0 && trans->rx_len == 0)) return ESP_ERR_INVALID_ARG;
+
+    sim_job_t job = { .dev = dev, .trans = *trans };
+
+    atomic_fetch_add(&dev->port->in_flight, 1);
+    if (xQueueSend(dev->port->jobs, &job, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != pdTRUE) {
+        atomic_fetch_sub(&dev->port->in_flight, 1);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return ESP_OK;
+}
+
+/* Clocking SCL frees a bus held by the sensor; the injected schedule continues. */
+esp_err_t recover_sim_i2c_bus(bus_device_handle_t dev)
+{
+    if (!dev || !dev->attached) return ESP_ERR_INVALID_STATE;
+
+    sim_port_t *port = dev->port;
+    if (xSemaphoreTake(port->lock, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+
+    port->stuck = false;
+    port->stats.recoveries++;
+
+    xSemaphoreGive(port->lock);
+    return ESP_OK;
+}
+
+void sim_i2c_get_stats(int port, sim_i2c_stats_t *out)
+{
+    *out = ports[port].stats;
+}
+
+void sim_i2c_reset_stats(int port)
+{
+    memset(&ports[port].stats, 0, sizeof(ports[port].stats));
+}
+
+void sim_i2c_set_fault(int port, const sim_i2c_fault_t *fault)
+{
+    sim_port_t *p = &ports[port];
+    if (!p->lock)
+        return;
+
+    xSemaphoreTake(p->lock, portMAX_DELAY);
+    p->fault = fault ? *fault : (sim_i2c_fault_t){ 0 };
+    p->fault_seen = 0;
+    p->stuck = false;
+    xSemaphoreGive(p->lock);
+}
+
+void sim_i2c_power_cycle(int port, uint16_t addr)
+{
+    sim_port_t *p = &ports[port];
+    unsigned sensor = addr - SIM_I2C_BME280_ADDR;
+
+    if (sensor >= SIM_I2C_BME280_COUNT || !p->lock)
+        return;
+
+    xSemaphoreTake(p->lock, portMAX_DELAY);
+    sim_bme280_power_cycle(&p->sensors[sensor].model);
+    p->sensors[sensor].reg_ptr = 0;
+    xSemaphoreGive(p->lock);
+}
+
+#endif
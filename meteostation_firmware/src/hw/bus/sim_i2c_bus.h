@@ -0,0 +1,42 @@
+#ifndef _SIM_I2C_BUS_H
+#define _SIM_I2C_BUS_H
+
+#include <stdint.h>
+
+/* Port 0 is bus 0; port 1 is bus 2 with CONFIG_METEO_BUS_I2C1. */
+#define SIM_I2C_PORTS         2
+
+/* Each port has BME280s at 0x76 and 0x77; other addresses NACK. */
+#define SIM_I2C_BME280_ADDR   0x76
+#define SIM_I2C_BME280_COUNT  2
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t bytes;
+    /* Time the same transactions would keep a real bus busy at each device's SCL rate. */
+    uint64_t wire_ns;
+    uint32_t faults;
+    uint32_t recoveries;
+} sim_i2c_stats_t;
+
+/*
+ * Injected faults, counted in transactions from sim_i2c_set_fault(). A stuck
+ * bus times out every transaction until it is recovered.
+ */
+typedef struct {
+    uint32_t nack_every;    /* every n-th transaction is NACKed; 0: never */
+    uint32_t stick_at;      /* the n-th transaction leaves SDA held low; 0: never */
+    uint32_t stall_at;      /* the n-th transaction completes only after stall_ms; 0: never */
+    uint32_t stall_ms;
+} sim_i2c_fault_t;
+
+void sim_i2c_get_stats(int port, sim_i2c_stats_t *stats);
+void sim_i2c_reset_stats(int port);
+
+/* NULL clears the faults, including a stuck bus. */
+void sim_i2c_set_fault(int port, const sim_i2c_fault_t *fault);
+
+/* Power-on reset of the BME280 at addr, as after a supply glitch. */
+void sim_i2c_power_cycle(int port, uint16_t addr);
+
+#endif
@@ -0,0 +1,260 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_BUS_SIM_SPI
+
+#include <string.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include "include/bus.h"
+#include "spi_frame.h"
+#include "sim_spi_bus.h"
+#include "sim_bme280.h"
+
+#define SPI_BUS_ID           0x1
+#define SIM_DEFAULT_SCLK_HZ  1000000
+#define SIM_MAX_DEVICES      4
+#define SIM_QUEUE_DEPTH      8
+#define SIM_WORKER_STACK     4096
+#define SIM_WORKER_PRIORITY  12
+
+static const char *TAG = "SIM_SPI_BUS";
+
+static bool bus_ready = false;
+
+static sim_spi_stats_t stats;
+static sim_bme280_t sensor;
+
+struct bus_device_t {
+    int cs_gpio;
+    uint32_t sclk_hz;
+    uint8_t reg_ptr;
+    bool attached;
+};
+
+static struct bus_device_t devices[SIM_MAX_DEVICES];
+
+/* As on the simulated I2C bus, a worker task completes submitted transactions. */
+typedef struct {
+    bus_device_handle_t dev;
+    bus_transaction_t trans;
+} sim_job_t;
+
+static QueueHandle_t jobs = NULL;
+static SemaphoreHandle_t sim_lock = NULL;
+static TaskHandle_t worker = NULL;
+static atomic_uint in_flight;
+
+
+DEFINE_BUS_REGISTER(
+    SPI_BUS_ID,
+    sim_spi,
+    init_sim_spi_bus,
+    destroy_sim_spi_bus,
+    attach_sim_spi_device,
+    detach_sim_spi_device,
+    read_sim_spi_bus,
+    write_sim_spi_bus,
+    transfer_sim_spi_bus,
+    submit_sim_spi_bus,
+    recover_sim_spi_bus
+)
+
+static void sim_worker(void *arg);
+
+esp_err_t init_sim_spi_bus(void)
+{
+    ESP_LOGI(TAG, "Initializing simulated SPI bus...");
+
+    if (bus_ready) {
+        ESP_LOGW(TAG, "Bus already initialized");
+        return ESP_OK;
+    }
+
+    if (!worker) {
+        jobs = xQueueCreate(SIM_QUEUE_DEPTH, sizeof(sim_job_t));
+        sim_lock = xSemaphoreCreateMutex();
+        if (!jobs || !sim_lock)
+            return ESP_ERR_NO_MEM;
+
+        if (xTaskCreate(sim_worker, "sim_spi", SIM_WORKER_STACK, NULL, SIM_WORKER_PRIORITY, &worker) != pdPASS) {
+            worker = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    sim_bme280_reset(&sensor);
+    bus_ready = true;
+
+    ESP_LOGI(TAG, "Simulated SPI bus ready, BME280 on CS %d.", SIM_SPI_BME280_CS);
+    return ESP_OK;
+}
+
+esp_err_t destroy_sim_spi_bus(void)
+{
+    if (!bus_ready) return ESP_ERR_INVALID_STATE;
+
+    for (size_t i = 0; i < SIM_MAX_DEVICES; i++)
+        devices[i].attached = false;
+    bus_ready = false;
+
+    ESP_LOGI(TAG, "Simulated SPI bus destroyed.");
+    return ESP_OK;
+}
+
+esp_err_t attach_sim_spi_device(const bus_device_config_t *config, bus_device_handle_t *dev)
+{
+    if (!config || !dev) return ESP_ERR_INVALID_ARG;
+    if (!bus_ready) return ESP_ERR_INVALID_STATE;
+
+    struct bus_device_t *slot = NULL;
+    for (size_t i = 0; i < SIM_MAX_DEVICES; i++) {
+        if (devices[i].attached && devices[i].cs_gpio == config->cs_gpio)
+            return ESP_ERR_INVALID_STATE;
+        if (!devices[i].attached && !slot)
+            slot = &devices[i];
+    }
+
+    if (!slot) return ESP_ERR_NO_MEM;
+
+    slot->cs_gpio = config->cs_gpio;
+    slot->sclk_hz = config->scl_speed_hz ? config->scl_speed_hz : SIM_DEFAULT_SCLK_HZ;
+    slot->reg_ptr = 0;
+    slot->attached = true;
+    *dev = slot;
+    return ESP_OK;
+}
+
+esp_err_t detach_sim_spi_device(bus_device_handle_t dev)
+{
+    if (!dev || !dev->attached) return ESP_ERR_INVALID_ARG;
+
+    TickType_t waited = 0;
+    while (atomic_load(&in_flight)) {
+        if (waited++ > pdMS_TO_TICKS(BUS_TIMEOUT_MS))
+            return ESP_ERR_TIMEOUT;
+        vTaskDelay(1);
+    }
+
+    dev->attached = false;
+    return ESP_OK;
+}
+
+/* The sensor side of one chip select cycle; MISO floats high without a device. */
+static void sim_frame(bus_device_handle_t dev, const uint8_t *frame, size_t len, uint8_t *rx)
+{
+    if (dev->cs_gpio != SIM_SPI_BME280_CS) {
+        if (rx)
+            memset(rx, 0xFF, len);
+    } else if (frame[0] & SPI_REG_READ) {
+        rx[0] = 0xFF;
+        sim_bme280_read(&sensor, frame[0], rx + 1, len - 1);
+    } else {
+        /* The BME280 drops bit 7 of register addresses in SPI mode. */
+        for (size_t i = 0; i + 1 < len; i += 2)
+            sim_bme280_write(&sensor, frame[i] | SPI_REG_READ, frame[i + 1]);
+    }
+
+    stats.frames++;
+    stats.bytes += len;
+    stats.wire_ns += (uint64_t)len * 8 * 1000000000ull / dev->sclk_hz;
+}
+
+/* Same framing as spi_bus.c, so the device model sees what the sensor would. */
+static esp_err_t sim_transaction(bus_device_handle_t dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    if (!bus_ready || !dev || !dev->attached) return ESP_ERR_INVALID_STATE;
+    if (tx_len > SPI_FRAME_MAX || rx_len > SPI_READ_MAX) return ESP_ERR_INVALID_SIZE;
+
+    if (xSemaphoreTake(sim_lock, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+
+    uint8_t frame[SPI_FRAME_MAX];
+    uint8_t in[SPI_FRAME_MAX];
+
+    if (tx_len >= 2)
+        sim_frame(dev, frame, spi_frame_write(tx, tx_len, frame), NULL);
+
+    if (tx_len & 1)
+        dev->reg_ptr = tx[tx_len - 1];
+
+    if (rx_len) {
+        sim_frame(dev, frame, spi_frame_read(dev->reg_ptr, rx_len, frame), in);
+        memcpy(rx, in + 1, rx_len);
+        dev->reg_ptr += rx_len;
+    }
+
+    xSemaphoreGive(sim_lock);
+    return ESP_OK;
+}
+
+static void sim_worker(void *arg)
+{
+    sim_job_t job;
+
+    while (1) {
+        if (xQueueReceive(jobs, &job, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        esp_err_t err = sim_transaction(job.dev, job.trans.tx, job.trans.tx_len, job.trans.rx, job.trans.rx_len);
+        if (job.trans.done)
+            job.trans.done(err, job.trans.arg);
+        atomic_fetch_sub(&in_flight, 1);
+    }
+}
+
+esp_err_t read_sim_spi_bus(bus_device_handle_t dev, uint8_t *data, size_t len)
+{
+    if (len == 0) return ESP_ERR_INVALID_ARG;
+
+    return sim_transaction(dev, NULL, 0, data, len);
+}
+
+esp_err_t write_sim_spi_bus(bus_device_handle_t dev, const uint8_t *data, size_t len)
+{
+    if (len == 0) return ESP_ERR_INVALID_ARG;
+
+    return sim_transaction(dev, data, len, NULL, 0);
+}
+
+esp_err_t transfer_sim_spi_bus(bus_device_handle_t dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    return sim_transaction(dev, tx, tx_len, rx, rx_len);
+}
+
+/* Same one-frame restriction as spi_bus.c. */
+esp_err_t submit_sim_spi_bus(bus_device_handle_t dev, const bus_transaction_t *trans)
+{
+    if (!bus_ready || !dev || !dev->attached) return ESP_ERR_INVALID_STATE;
+    if (!trans || (trans->tx_len == 0 && trans->rx_len == 0)) return ESP_ERR_INVALID_ARG;
+    if (trans->rx_len ? trans->tx_len > 1 : (trans->tx_len & 1)) return ESP_ERR_NOT_SUPPORTED;
+
+    sim_job_t job = { .dev = dev, .trans = *trans };
+
+    atomic_fetch_add(&in_flight, 1);
+    if (xQueueSend(jobs, &job, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != pdTRUE) {
+        atomic_fetch_sub(&in_flight, 1);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return ESP_OK;
+}
+
+void sim_spi_get_stats(sim_spi_stats_t *out)
+{
+    *out = stats;
+}
+
+void sim_spi_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+esp_err_t recover_sim_spi_bus(bus_device_handle_t dev)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
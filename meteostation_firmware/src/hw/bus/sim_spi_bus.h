@@ -0,0 +1,19 @@
+#ifndef _SIM_SPI_BUS_H
+#define _SIM_SPI_BUS_H
+
+#include <stdint.h>
+
+/* Chip select the simulated BME280 answers on; other devices read 0xFF. */
+#define SIM_SPI_BME280_CS   10
+
+typedef struct {
+    uint32_t frames;
+    uint32_t bytes;
+    /* Time the same frames would keep a real bus busy at each device's clock. */
+    uint64_t wire_ns;
+} sim_spi_stats_t;
+
+void sim_spi_get_stats(sim_spi_stats_t *stats);
+void sim_spi_reset_stats(void);
+
+#endif
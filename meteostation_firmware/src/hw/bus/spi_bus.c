@@ -0,0 +1,378 @@
+#include <sdkconfig.h>
+
+#if defined(CONFIG_METEO_BUS_SPI) && !defined(CONFIG_METEO_BUS_SIM_SPI)
+
+#include <string.h>
+#include "include/bus.h"
+#include "spi_frame.h"
+#include <esp_log.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <driver/spi_master.h>
+
+#define SPI_BUS_ID        0x1
+#define SPI_HOST_NUM      SPI2_HOST
+#define SPI_MOSI_IO       GPIO_NUM_11
+#define SPI_MISO_IO       GPIO_NUM_13
+#define SPI_SCLK_IO       GPIO_NUM_12
+#define SPI_MAX_DEVICES   4
+#define SPI_QUEUE_DEPTH   CONFIG_METEO_BUS_SPI_QUEUE_DEPTH
+
+static const char *TAG = "SPI_BUS";
+
+static bool bus_ready = false;
+
+/*
+ * One queued frame. The buffers are word aligned, padded to whole words and
+ * live in internal RAM, so the driver hands them to DMA without bounce copies.
+ */
+typedef struct {
+    spi_transaction_t t;
+    bus_done_cb_t done;
+    void *arg;
+    uint8_t *rx;
+    size_t rx_len;
+    WORD_ALIGNED_ATTR uint8_t tx_buf[SPI_FRAME_MAX];
+    WORD_ALIGNED_ATTR uint8_t rx_buf[SPI_FRAME_MAX];
+} spi_slot_t;
+
+/*
+ * The driver returns each device's frames in queue order, so the slots form
+ * a ring: head counts queued frames, tail the ones collected back. A slot is
+ * reused only once collected, even if its caller gave up waiting.
+ */
+struct bus_device_t {
+    int cs_gpio;
+    spi_device_handle_t dev;
+    SemaphoreHandle_t lock;
+    uint8_t reg_ptr;
+    uint32_t head;
+    uint32_t tail;
+    spi_slot_t slots[SPI_QUEUE_DEPTH];
+};
+
+static struct bus_device_t devices[SPI_MAX_DEVICES];
+
+
+DEFINE_BUS_REGISTER(
+    SPI_BUS_ID,
+    spi,
+    init_spi_bus,
+    destroy_spi_bus,
+    attach_spi_device,
+    detach_spi_device,
+    read_spi_bus,
+    write_spi_bus,
+    transfer_spi_bus,
+    submit_spi_bus,
+    recover_spi_bus
+)
+
+static void IRAM_ATTR spi_trans_done(spi_transaction_t *t)
+{
+    spi_slot_t *slot = t->user;
+
+    if (slot->rx)
+        memcpy(slot->rx, slot->rx_buf + 1, slot->rx_len);
+    if (slot->done)
+        slot->done(ESP_OK, slot->arg);
+}
+
+esp_err_t init_spi_bus(void)
+{
+    ESP_LOGI(TAG, "Initializing SPI bus...");
+
+    if (bus_ready) {
+        ESP_LOGW(TAG, "Bus already initialized");
+        return ESP_OK;
+    }
+
+    spi_bus_config_t bus_config = {
+        .mosi_io_num = SPI_MOSI_IO,
+        .miso_io_num = SPI_MISO_IO,
+        .sclk_io_num = SPI_SCLK_IO,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = SPI_FRAME_MAX,
+    };
+
+    esp_err_t err = spi_bus_initialize(SPI_HOST_NUM, &bus_config, SPI_DMA_CH_AUTO);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to init SPI bus: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    bus_ready = true;
+    ESP_LOGI(TAG, "SPI bus ready.");
+    return ESP_OK;
+}
+
+/* Collects one finished frame; ESP_ERR_TIMEOUT if none finishes within wait. */
+static esp_err_t spi_collect(struct bus_device_t *dev, TickType_t wait)
+{
+    spi_transaction_t *t;
+
+    esp_err_t err = spi_device_get_trans_result(dev->dev, &t, wait);
+    if (err == ESP_OK)
+        dev->tail++;
+    return err;
+}
+
+/* Next free slot of the device, waiting for one to finish if all are in flight. */
+static spi_slot_t *spi_take_slot(struct bus_device_t *dev)
+{
+    while (dev->head != dev->tail && spi_collect(dev, 0) == ESP_OK)
+        ;
+
+    if (dev->head - dev->tail == SPI_QUEUE_DEPTH &&
+        spi_collect(dev, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != ESP_OK)
+        return NULL;
+
+    return &dev->slots[dev->head % SPI_QUEUE_DEPTH];
+}
+
+static esp_err_t spi_queue_slot(struct bus_device_t *dev, spi_slot_t *slot, size_t len, bool read)
+{
+    slot->t = (spi_transaction_t){
+        .length = len * 8,
+        .tx_buffer = slot->tx_buf,
+        .rx_buffer = read ? slot->rx_buf : NULL,
+        .user = slot,
+    };
+
+    esp_err_t err = spi_device_queue_trans(dev->dev, &slot->t, pdMS_TO_TICKS(BUS_TIMEOUT_MS));
+    if (err == ESP_OK)
+        dev->head++;
+    return err;
+}
+
+/* Queues one frame and waits for it; the caller holds the device lock. */
+static esp_err_t spi_run_frame(struct bus_device_t *dev, spi_slot_t *slot, size_t len, bool read)
+{
+    slot->done = NULL;
+    slot->rx = NULL;
+
+    esp_err_t err = spi_queue_slot(dev, slot, len, read);
+    uint32_t mine = dev->head;
+
+    while (err == ESP_OK && dev->tail != mine)
+        err = spi_collect(dev, pdMS_TO_TICKS(BUS_TIMEOUT_MS));
+    return err;
+}
+
+/* Collects every queued frame, so none references the device or a caller's buffer. */
+static esp_err_t spi_drain(struct bus_device_t *dev)
+{
+    esp_err_t err = ESP_OK;
+
+    while (err == ESP_OK && dev->head != dev->tail)
+        err = spi_collect(dev, pdMS_TO_TICKS(BUS_TIMEOUT_MS));
+    return err;
+}
+
+static void destroy_spi_device(struct bus_device_t *dev)
+{
+    spi_drain(dev);
+    spi_bus_remove_device(dev->dev);
+    vSemaphoreDelete(dev->lock);
+    dev->dev = NULL;
+    dev->lock = NULL;
+}
+
+esp_err_t destroy_spi_bus(void)
+{
+    if (!bus_ready) return ESP_ERR_INVALID_STATE;
+
+    for (size_t i = 0; i < SPI_MAX_DEVICES; i++) {
+        if (devices[i].dev)
+            destroy_spi_device(&devices[i]);
+    }
+
+    esp_err_t err = spi_bus_free(SPI_HOST_NUM);
+    bus_ready = false;
+
+    ESP_LOGI(TAG, "SPI bus destroyed.");
+    return err;
+}
+
+esp_err_t attach_spi_device(const bus_device_config_t *config, bus_device_handle_t *dev)
+{
+    if (!config || !dev) return ESP_ERR_INVALID_ARG;
+    if (!bus_ready) return ESP_ERR_INVALID_STATE;
+
+    struct bus_device_t *slot = NULL;
+    for (size_t i = 0; i < SPI_MAX_DEVICES; i++) {
+        if (devices[i].dev && devices[i].cs_gpio == config->cs_gpio) {
+            ESP_LOGE(TAG, "Device on CS %d already attached", config->cs_gpio);
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (!devices[i].dev && !slot)
+            slot = &devices[i];
+    }
+
+    if (!slot) {
+        ESP_LOGE(TAG, "SPI device table full!");
+        return ESP_ERR_NO_MEM;
+    }
+
+    slot->lock = xSemaphoreCreateMutex();
+    if (!slot->lock)
+        return ESP_ERR_NO_MEM;
+
+    spi_device_interface_config_t dev_cfg = {
+        .mode = 0,
+        .clock_speed_hz = config->scl_speed_hz,
+        .spics_io_num = config->cs_gpio,
+        .queue_size = SPI_QUEUE_DEPTH,
+        .post_cb = spi_trans_done,
+    };
+
+    esp_err_t err = spi_bus_add_device(SPI_HOST_NUM, &dev_cfg, &slot->dev);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add device on CS %d: %s", config->cs_gpio, esp_err_to_name(err));
+        vSemaphoreDelete(slot->lock);
+        slot->lock = NULL;
+        slot->dev = NULL;
+        return err;
+    }
+
+    slot->cs_gpio = config->cs_gpio;
+    slot->reg_ptr = 0;
+    slot->head = slot->tail = 0;
+    *dev = slot;
+
+    ESP_LOGI(TAG, "Device on CS %d attached at %u Hz", config->cs_gpio, (unsigned)config->scl_speed_hz);
+    return ESP_OK;
+}
+
+esp_err_t detach_spi_device(bus_device_handle_t dev)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_ARG;
+
+    if (xSemaphoreTake(dev->lock, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+
+    esp_err_t err = spi_drain(dev);
+    xSemaphoreGive(dev->lock);
+    if (err != ESP_OK)
+        return err;
+
+    destroy_spi_device(dev);
+    return ESP_OK;
+}
+
+/* Register semantics of spi_frame.h: pairs, then the pointer, then a burst read. */
+static esp_err_t spi_run_sync(bus_device_handle_t dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_STATE;
+    if (tx_len > SPI_FRAME_MAX || rx_len > SPI_READ_MAX) return ESP_ERR_INVALID_SIZE;
+
+    if (xSemaphoreTake(dev->lock, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+
+    esp_err_t err = ESP_OK;
+    spi_slot_t *slot;
+
+    if (tx_len >= 2) {
+        slot = spi_take_slot(dev);
+        err = slot ? spi_run_frame(dev, slot, spi_frame_write(tx, tx_len, slot->tx_buf), false) : ESP_ERR_TIMEOUT;
+    }
+
+    if (err == ESP_OK && (tx_len & 1))
+        dev->reg_ptr = tx[tx_len - 1];
+
+    if (err == ESP_OK && rx_len) {
+        slot = spi_take_slot(dev);
+        err = slot ? spi_run_frame(dev, slot, spi_frame_read(dev->reg_ptr, rx_len, slot->tx_buf), true) : ESP_ERR_TIMEOUT;
+        if (err == ESP_OK) {
+            memcpy(rx, slot->rx_buf + 1, rx_len);
+            dev->reg_ptr += rx_len;
+        }
+    }
+
+    xSemaphoreGive(dev->lock);
+    return err;
+}
+
+/*
+ * Each submitted transaction must fit one frame: a write of whole pairs, or
+ * a burst read from tx[0] or, without tx, from the current pointer.
+ */
+esp_err_t submit_spi_bus(bus_device_handle_t dev, const bus_transaction_t *trans)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_STATE;
+    if (!trans || (trans->tx_len == 0 && trans->rx_len == 0)) return ESP_ERR_INVALID_ARG;
+    if (trans->rx_len ? trans->tx_len > 1 : (trans->tx_len & 1)) return ESP_ERR_NOT_SUPPORTED;
+    if (trans->tx_len > SPI_FRAME_MAX || trans->rx_len > SPI_READ_MAX) return ESP_ERR_INVALID_SIZE;
+
+    if (xSemaphoreTake(dev->lock, pdMS_TO_TICKS(BUS_TIMEOUT_MS)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    spi_slot_t *slot = spi_take_slot(dev);
+
+    if (slot) {
+        slot->done = trans->done;
+        slot->arg = trans->arg;
+
+        if (trans->rx_len) {
+            uint8_t reg = trans->tx_len ? trans->tx[0] : dev->reg_ptr;
+
+            slot->rx = trans->rx;
+            slot->rx_len = trans->rx_len;
+            err = spi_queue_slot(dev, slot, spi_frame_read(reg, trans->rx_len, slot->tx_buf), true);
+            if (err == ESP_OK)
+                dev->reg_ptr = reg + trans->rx_len;
+        } else {
+            slot->rx = NULL;
+            err = spi_queue_slot(dev, slot, spi_frame_write(trans->tx, trans->tx_len, slot->tx_buf), false);
+        }
+    }
+
+    xSemaphoreGive(dev->lock);
+    return err;
+}
+
+esp_err_t read_spi_bus(bus_device_handle_t dev, uint8_t *data, size_t len)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_STATE;
+    if (len == 0) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = spi_run_sync(dev, NULL, 0, data, len);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "SPI read error on CS %d: %s", dev->cs_gpio, esp_err_to_name(err));
+
+    return err;
+}
+
+esp_err_t write_spi_bus(bus_device_handle_t dev, const uint8_t *data, size_t len)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_STATE;
+    if (len == 0) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = spi_run_sync(dev, data, len, NULL, 0);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "SPI write error on CS %d: %s", dev->cs_gpio, esp_err_to_name(err));
+
+    return err;
+}
+
+esp_err_t transfer_spi_bus(bus_device_handle_t dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len)
+{
+    if (!dev || !dev->dev) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = spi_run_sync(dev, tx, tx_len, rx, rx_len);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "SPI transfer error on CS %d: %s", dev->cs_gpio, esp_err_to_name(err));
+
+    return err;
+}
+
+/* SPI has no shared data line a device could hold; CS deselect ends any frame. */
+esp_err_t recover_spi_bus(bus_device_handle_t dev)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
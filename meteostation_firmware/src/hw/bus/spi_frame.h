@@ -0,0 +1,52 @@
+#ifndef _SPI_FRAME_H
+#define _SPI_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Register framing of SPI sensors (Bosch BME/BMP, InvenSense and most
+ * others): under chip select the first byte is the register address with
+ * bit 7 set for a read, after which the device auto-increments for as long
+ * as it is clocked. Writes are (register, value) pairs with bit 7 clear.
+ *
+ * The SPI buses keep the I2C register semantics drivers are written
+ * against: write() takes (register, value) pairs and a trailing lone byte
+ * sets the read pointer, read() bursts from the pointer and transfer() is
+ * write() followed by read(). The pointer is kept per device handle.
+ */
+#define SPI_REG_READ   0x80
+
+/* Frame buffer size; a multiple of 4 so reads can DMA into it directly. */
+#define SPI_FRAME_MAX  36
+
+/* Largest burst read: the address byte takes the first slot. */
+#define SPI_READ_MAX   (SPI_FRAME_MAX - 1)
+
+/* Writes the pairs of data (an odd last byte excluded) as one frame; returns its length. */
+static inline size_t spi_frame_write(const uint8_t *data, size_t len, uint8_t *frame)
+{
+    size_t n = len & ~(size_t)1;
+
+    for (size_t i = 0; i < n; i += 2) {
+        frame[i] = data[i] & ~SPI_REG_READ;
+        frame[i + 1] = data[i + 1];
+    }
+    return n;
+}
+
+/*
+ * Burst read of rx_len bytes from reg; the data follows the address byte.
+ * The frame is padded to whole words, clocking out a few extra registers.
+ */
+static inline size_t spi_frame_read(uint8_t reg, size_t rx_len, uint8_t *frame)
+{
+    size_t n = (rx_len + 1 + 3) & ~(size_t)3;
+
+    frame[0] = reg | SPI_REG_READ;
+    memset(frame + 1, 0, n - 1);
+    return n;
+}
+
+#endif
@@ -1,39 +1,114 @@
+#include <sdkconfig.h>
 #include <esp_log.h>
 #include "../include/driver.h"
+#include "../include/regmap.h"
 #include "../../bus/include/bus.h"
 #include "bme_280.h"
+#include "bme_280_compensate.h"
+#include "bme_280_cache.h"
 
 static const char *TAG = "BME280_DRIVER";
 
-#define BME280_I2C_ADDR  0x76
+#define BME280_I2C_ADDR     0x76
+#define BME280_I2C_ADDR_ALT 0x77  /* SDO pulled high */
+#define BME280_I2C_SPEED    400000
 #define BME280_ID_REG    0xD0
 #define BME280_RESET_REG 0xE0
 #define BME280_CTRL_HUM  0xF2
+#define BME280_STATUS    0xF3
 #define BME280_CTRL_MEAS 0xF4
 #define BME280_CONFIG    0xF5
 #define BME280_TEMP_MSB  0xF7
 
-#define BME280_DRIVER_ID 0x00
+#define BME280_HUM_SKIPPED 0x8000
+
+#define BME280_MODE_SLEEP  0x00
+#define BME280_MODE_FORCED 0x01
+
+#define BME280_OSRS_SKIP 0x00
+#define BME280_OSRS_X1   0x01
+#define BME280_OSRS_X2   0x02
+#define BME280_OSRS_X4   0x03
+#define BME280_OSRS_X8   0x04
+#define BME280_OSRS_X16  0x05
+
+#define BME280_FILTER_OFF 0x00
+#define BME280_FILTER_2   0x01
+#define BME280_FILTER_4   0x02
+#define BME280_FILTER_8   0x03
+#define BME280_FILTER_16  0x04
+
+#ifdef CONFIG_METEO_BME280_PROFILE_HIGH_RATE
+#define BME280_DEFAULT_PROFILE BME280_PROFILE_HIGH_RATE
+#elif defined(CONFIG_METEO_BME280_PROFILE_LOW_NOISE)
+#define BME280_DEFAULT_PROFILE BME280_PROFILE_LOW_NOISE
+#else
+#define BME280_DEFAULT_PROFILE BME280_PROFILE_WEATHER
+#endif
+
 #define I2C_BUS_ID       0x00
+#define SPI_BUS_ID       0x01
+#define I2C1_BUS_ID      0x02
+
+#ifdef CONFIG_METEO_BME280_BUS_SPI
+#define BME280_BUS_ID    SPI_BUS_ID
+#define BME280_BUS_SPEED CONFIG_METEO_BME280_SPI_CLOCK_HZ
+#define BME280_CS_GPIO   CONFIG_METEO_BME280_SPI_CS
+#else
+#define BME280_BUS_ID    I2C_BUS_ID
+#define BME280_BUS_SPEED BME280_I2C_SPEED
+#define BME280_CS_GPIO   -1
+#endif
 
 typedef struct {
-    uint16_t t1;
-    int16_t t2, t3;
-
-    uint16_t p1;
-    int16_t p2, p3, p4, p5, p6, p7, p8, p9;
+    uint8_t osrs_t;
+    uint8_t osrs_p;
+    uint8_t osrs_h;
+    uint8_t filter;
+} bme280_settings_t;
+
+static const bme280_settings_t profiles[BME280_PROFILE_COUNT] = {
+    [BME280_PROFILE_WEATHER]   = { BME280_OSRS_X1, BME280_OSRS_X1,  BME280_OSRS_X1,  BME280_FILTER_OFF },
+    [BME280_PROFILE_HIGH_RATE] = { BME280_OSRS_X1, BME280_OSRS_X4,  BME280_OSRS_X1,  BME280_FILTER_4 },
+    [BME280_PROFILE_LOW_NOISE] = { BME280_OSRS_X2, BME280_OSRS_X16, BME280_OSRS_X16, BME280_FILTER_16 },
+};
 
-    uint8_t h1;
-    int16_t h2;
-    uint8_t h3;
-    int16_t h4;
-    int16_t h5;
-    int8_t  h6;
-} bme_calibration_data_t;
+typedef struct {
+    bus_id bus;
+    uint16_t addr;
+    uint32_t speed_hz;
+    int cs_gpio;
+} bme280_config_t;
+
+/*
+ * Sensor instances in the order CONFIG_METEO_BME280_INSTANCES takes them:
+ * one per controller first, so that two sensors are already read in parallel.
+ */
+static const bme280_config_t bme280_configs[BME280_MAX_INSTANCES] = {
+    { BME280_BUS_ID, BME280_I2C_ADDR,     BME280_BUS_SPEED, BME280_CS_GPIO },
+    { I2C1_BUS_ID,   BME280_I2C_ADDR,     BME280_I2C_SPEED, -1 },
+    { I2C_BUS_ID,    BME280_I2C_ADDR_ALT, BME280_I2C_SPEED, -1 },
+    { I2C1_BUS_ID,   BME280_I2C_ADDR_ALT, BME280_I2C_SPEED, -1 },
+};
+
+/* Control registers; status in between changes on its own. */
+static const regmap_config_t bme280_regmap = {
+    .first = BME280_CTRL_HUM,
+    .count = BME280_CONFIG - BME280_CTRL_HUM + 1,
+    .format = REGMAP_WRITE_PAIRS,
+    .volatile_mask = 1u << (BME280_STATUS - BME280_CTRL_HUM),
+};
 
 typedef struct {
-    uint8_t address;
+    /* Calibration cache tag: bus id above the address. */
+    uint16_t address;
+    bus_device_handle_t dev;
     bme_calibration_data_t calibration_data;
+    /* ctrl_hum .. config; ctrl_meas is shadowed in sleep mode. */
+    regmap_t regs;
+    uint32_t measure_time_us;
+    /* Forced-mode command of bme280_submit_start(), owned by the bus until done. */
+    uint8_t start_cmd[2];
 } bme280_ctx_t;
 
 static esp_err_t bme280_init(driver_t *driver);
@@ -45,13 +120,95 @@ static esp_err_t bme280_write(driver_t *driver, const void* data, size_t len);
 DEFINE_DRIVER_REGISTER(
     BME280_DRIVER_ID,
     bme280,
-    NULL,
+    BME280_BUS_ID,
+    0,
+    bme280_ctx_t,
     bme280_init,
     bme280_destruct,
     bme280_read,
     bme280_write
 );
 
+#if BME280_INSTANCES > 1
+DEFINE_DRIVER_INSTANCE(0x01, bme280, 1, I2C1_BUS_ID, 0, &bme280_configs[1])
+#endif
+#if BME280_INSTANCES > 2
+DEFINE_DRIVER_INSTANCE(0x02, bme280, 2, I2C_BUS_ID, 0, &bme280_configs[2])
+#endif
+#if BME280_INSTANCES > 3
+DEFINE_DRIVER_INSTANCE(0x03, bme280, 3, I2C1_BUS_ID, 0, &bme280_configs[3])
+#endif
+
+_Static_assert(BME280_INSTANCES >= 1 && BME280_INSTANCES <= BME280_MAX_INSTANCES, "BME280 instance count out of range");
+
+/* The registration above covers instance 0 and has no config of its own. */
+static const bme280_config_t *bme280_config(const driver_t *driver)
+{
+    return driver->config ? driver->config : &bme280_configs[0];
+}
+
+static esp_err_t bme280_read_regs(driver_t *driver, uint8_t reg, uint8_t *data, size_t len)
+{
+    bme280_ctx_t *ctx = (bme280_ctx_t *)driver->ctx;
+    return driver->bus->ops->transfer(ctx->dev, &reg, 1, data, len);
+}
+
+static uint32_t oversampling_factor(uint8_t osrs)
+{
+    return osrs == BME280_OSRS_SKIP ? 0 : 1u << (osrs - 1);
+}
+
+/* Datasheet 9.1: t_measure,max = 1.25 + 2.3*T + (2.3*P + 0.575) + (2.3*H + 0.575) ms. */
+static uint32_t bme280_measure_time_us(const bme280_settings_t *s)
+{
+    uint32_t t = 1250 + 2300 * oversampling_factor(s->osrs_t);
+
+    if (s->osrs_p != BME280_OSRS_SKIP)
+        t += 2300 * oversampling_factor(s->osrs_p) + 575;
+    if (s->osrs_h != BME280_OSRS_SKIP)
+        t += 2300 * oversampling_factor(s->osrs_h) + 575;
+
+    return t;
+}
+
+/*
+ * Changed registers go out as (register, value) pairs of a single
+ * transaction in address order: ctrl_hum, then ctrl_meas in sleep mode, then
+ * config, which is only reliably written in sleep mode. A ctrl_hum change
+ * without a ctrl_meas one takes effect with the next forced start.
+ */
+static esp_err_t bme280_apply_settings(driver_t *driver, const bme280_settings_t *s)
+{
+    bme280_ctx_t *ctx = (bme280_ctx_t *)driver->ctx;
+
+    regmap_write(&ctx->regs, BME280_CTRL_HUM, s->osrs_h);
+    regmap_write(&ctx->regs, BME280_CTRL_MEAS, (s->osrs_t << 5) | (s->osrs_p << 2) | BME280_MODE_SLEEP);
+    regmap_write(&ctx->regs, BME280_CONFIG, s->filter << 2);
+
+    esp_err_t err = regmap_sync(&ctx->regs);
+    if (err != ESP_OK)
+        return err;
+
+    ctx->measure_time_us = bme280_measure_time_us(s);
+    return ESP_OK;
+}
+
+/*
+ * Forced mode falls back to sleep after the conversion, so the start command
+ * bypasses the shadow and leaves it right.
+ */
+static esp_err_t bme280_start_cmd(bme280_ctx_t *ctx, uint8_t cmd[2])
+{
+    uint8_t ctrl_meas = 0;
+    esp_err_t err = regmap_cached(&ctx->regs, BME280_CTRL_MEAS, &ctrl_meas);
+    if (err != ESP_OK)
+        return err;
+
+    cmd[0] = BME280_CTRL_MEAS;
+    cmd[1] = ctrl_meas | BME280_MODE_FORCED;
+    return ESP_OK;
+}
+
 esp_err_t calibrate(driver_t* driver)
 {
     if (!driver || !driver->ctx)
@@ -60,111 +217,119 @@ esp_err_t calibrate(driver_t* driver)
     bme280_ctx_t* ctx = (bme280_ctx_t*)driver->ctx;
     bme_calibration_data_t* cd = &ctx->calibration_data;
 
-    uint8_t calib1[26]; 
-    uint8_t calib2[7];   
-
-    bus_t* bus = driver->bus;
-
-    uint8_t reg = 0x88;
-    esp_err_t err = bus->ops->write(ctx->address, &reg, 1);
-    if (err != ESP_OK) return err;
-
-    err = bus->ops->read(ctx->address, calib1, 26);
-    if (err != ESP_OK) return err;
+    uint8_t calib1[BME280_CALIB1_LEN];
+    uint8_t calib2[BME280_CALIB2_LEN];
 
-    reg = 0xE1;
-    err = bus->ops->write(ctx->address, &reg, 1);
+    esp_err_t err = bme280_read_regs(driver, 0x88, calib1, sizeof(calib1));
     if (err != ESP_OK) return err;
 
-    err = bus->ops->read(ctx->address, calib2, 7);
+    err = bme280_read_regs(driver, 0xE1, calib2, sizeof(calib2));
     if (err != ESP_OK) return err;
 
-    cd->t1 = (uint16_t)(calib1[1] << 8 | calib1[0]);
-    cd->t2 = (int16_t)(calib1[3] << 8 | calib1[2]);
-    cd->t3 = (int16_t)(calib1[5] << 8 | calib1[4]);
-
-    cd->p1 = (uint16_t)(calib1[7] << 8 | calib1[6]);
-    cd->p2 = (int16_t)(calib1[9] << 8 | calib1[8]);
-    cd->p3 = (int16_t)(calib1[11] << 8 | calib1[10]);
-    cd->p4 = (int16_t)(calib1[13] << 8 | calib1[12]);
-    cd->p5 = (int16_t)(calib1[15] << 8 | calib1[14]);
-    cd->p6 = (int16_t)(calib1[17] << 8 | calib1[16]);
-    cd->p7 = (int16_t)(calib1[19] << 8 | calib1[18]);
-    cd->p8 = (int16_t)(calib1[21] << 8 | calib1[20]);
-    cd->p9 = (int16_t)(calib1[23] << 8 | calib1[22]);
+    bme280_parse_calibration(calib1, calib2, cd);
 
-    cd->h1 = calib1[25];
-
-    cd->h2 = (int16_t)(calib2[1] << 8 | calib2[0]);
-    cd->h3 = calib2[2];
+    ESP_LOGI(TAG, "Calibration data loaded.");
 
-    cd->h4 = (int16_t)((calib2[3] << 4) | (calib2[4] & 0x0F));
-    cd->h5 = (int16_t)((calib2[5] << 4) | (calib2[4] >> 4));
+    return ESP_OK;
+}
 
-    cd->h6 = (int8_t)calib2[6];
 
-    ESP_LOGI(TAG, "Calibration data loaded.");
+/*
+ * Detaches the sensor and releases the context. Both stay if transactions
+ * queued on the device do not finish: they still point into the context.
+ */
+static esp_err_t bme280_release(driver_t *driver)
+{
+    bme280_ctx_t *ctx = (bme280_ctx_t *)driver->ctx;
+    if (driver->bus && ctx->dev) {
+        esp_err_t err = driver->bus->ops->detach(ctx->dev);
+        if (err == ESP_ERR_TIMEOUT)
+            return err;
+        ctx->dev = NULL;
+    }
 
+    driver_ctx_free(driver);
     return ESP_OK;
 }
 
+/* Undoes a partial init; the context is released on every failure path. */
+static esp_err_t bme280_abort(driver_t *driver, esp_err_t err)
+{
+    bme280_release(driver);
+    return err;
+}
 
 static esp_err_t bme280_init(driver_t *driver)
 {
     ESP_LOGI(TAG, "Initializing BME280 driver...");
 
-    bme280_ctx_t *ctx = calloc(1, sizeof(bme280_ctx_t));
+    const bme280_config_t *cfg = bme280_config(driver);
+
+    bme280_ctx_t *ctx = driver_ctx_alloc(driver);
     if (!ctx)
         return ESP_ERR_NO_MEM;
 
-    ctx->address = BME280_I2C_ADDR;
+    ctx->address = (uint16_t)(cfg->bus << 8) | cfg->addr;
 
     bus_t *bus = NULL;
-    esp_err_t err = get_bus_by_id(I2C_BUS_ID, &bus);
+    esp_err_t err = get_bus_by_id(driver->bus_id, &bus);
     if (err != ESP_OK || bus == NULL) {
-        ESP_LOGE(TAG, "Failed to get I2C bus: %s", esp_err_to_name(err));
-        free(ctx);
-        return err;
+        ESP_LOGE(TAG, "Failed to get bus %d: %s", (int)driver->bus_id, esp_err_to_name(err));
+        return bme280_abort(driver, err);
+    }
+
+    bus_device_config_t dev_cfg = {
+        .addr = cfg->addr,
+        .scl_speed_hz = cfg->speed_hz,
+        .cs_gpio = cfg->cs_gpio,
+    };
+
+    err = bus->ops->attach(&dev_cfg, &ctx->dev);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to attach BME280 at 0x%02X on bus %d: %s", cfg->addr, (int)cfg->bus, esp_err_to_name(err));
+        return bme280_abort(driver, err);
     }
 
-    driver->ctx = ctx;
     driver->bus = bus;
 
-    uint8_t reg = BME280_ID_REG;
+    err = regmap_init(&ctx->regs, &bme280_regmap, driver, ctx->dev);
+    if (err != ESP_OK)
+        return bme280_abort(driver, err);
+
     uint8_t id_val = 0;
 
-    err = bus->ops->write(ctx->address, &reg, 1);
-    if (err == ESP_OK)
-        err = bus->ops->read(ctx->address, &id_val, 1);
+    err = bme280_read_regs(driver, BME280_ID_REG, &id_val, 1);
 
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "BME280 not responding at 0x%02X", ctx->address);
-        free(ctx);
-        return err;
+        ESP_LOGE(TAG, "BME280 not responding at 0x%02X on bus %d", cfg->addr, (int)cfg->bus);
+        return bme280_abort(driver, err);
     }
 
     ESP_LOGI(TAG, "BME280 ID = 0x%02X", id_val);
 
-    uint8_t setup[] = {
-        BME280_CTRL_HUM,  0x05,
-        BME280_CTRL_MEAS, 0x57,
-        BME280_CONFIG,    0xB0
-    };
-
-    for (int i = 0; i < sizeof(setup); i += 2)
-        bus->ops->write(ctx->address, &setup[i], 2);
+    if (bme280_cache_load(id_val, ctx->address, &ctx->calibration_data) == ESP_OK) {
+        ESP_LOGI(TAG, "Calibration data restored from cache.");
+    } else {
+        ESP_LOGI(TAG, "Start reading calibration data...");
 
-    ESP_LOGI(TAG, "BME280 initialized successfully.");
+        err = calibrate(driver);
 
-    ESP_LOGI(TAG, "Start reading calibration data...");
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Calibration is not successful!. Abort");
+            return bme280_abort(driver, ESP_ERR_NOT_FINISHED);
+        }
 
-    err = calibrate(driver);
+        bme280_cache_store(id_val, ctx->address, &ctx->calibration_data);
+    }
 
+    err = bme280_apply_settings(driver, &profiles[BME280_DEFAULT_PROFILE]);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Calibration is not successful!. Abort");
-        return ESP_ERR_NOT_FINISHED;
+        ESP_LOGE(TAG, "Failed to configure BME280: %s", esp_err_to_name(err));
+        return bme280_abort(driver, err);
     }
 
+    ESP_LOGI(TAG, "BME280 initialized successfully, measurement time %u us.", (unsigned)ctx->measure_time_us);
+
     return ESP_OK;
 }
 
@@ -173,158 +338,299 @@ static esp_err_t bme280_destruct(driver_t *driver)
     if (!driver || !driver->ctx)
         return ESP_ERR_INVALID_ARG;
 
-    free(driver->ctx);
-    driver->ctx = NULL;
+    esp_err_t err = bme280_release(driver);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "BME280 [%d] still has transactions queued: %s", driver->id, esp_err_to_name(err));
+        return err;
+    }
+
     ESP_LOGI(TAG, "BME280 driver destroyed.");
     return ESP_OK;
 }
 
 static esp_err_t bme280_read(driver_t *driver, void* data, size_t len)
+{
+    if (!driver || !driver->ctx)
+        return ESP_ERR_INVALID_ARG;
+
+    return bme280_read_regs(driver, BME280_TEMP_MSB, data, len);
+}
+
+static esp_err_t bme280_write(driver_t *driver, const void *data, size_t len)
 {
     if (!driver || !driver->ctx)
         return ESP_ERR_INVALID_ARG;
 
     bme280_ctx_t *ctx = (bme280_ctx_t *)driver->ctx;
+    return driver->bus->ops->write(ctx->dev, data, len);
+}
+
+static esp_err_t bme280_get_driver(uint8_t instance, driver_t **drv)
+{
+    if (instance >= BME280_INSTANCES)
+        return ESP_ERR_INVALID_ARG;
 
-    uint8_t reg = BME280_TEMP_MSB;
-    esp_err_t err = driver->bus->ops->write(ctx->address, &reg, 1);
+    esp_err_t err = get_driver_by_id(BME280_DRIVER_ID + instance, drv);
     if (err != ESP_OK)
         return err;
 
-    return driver->bus->ops->read(ctx->address, data, len);
+    if (!*drv || !(*drv)->ctx)
+        return ESP_ERR_INVALID_STATE;
+
+    return ESP_OK;
 }
 
-static esp_err_t bme280_write(driver_t *driver, const void *data, size_t len)
+esp_err_t bme280_read_id(uint8_t instance, uint8_t *id)
 {
-    if (!driver || !driver->ctx)
+    driver_t *drv = NULL;
+    esp_err_t err = bme280_get_driver(instance, &drv);
+    if (err != ESP_OK)
+        return err;
+
+    return bme280_read_regs(drv, BME280_ID_REG, id, 1);
+}
+
+esp_err_t bme280_set_profile(uint8_t instance, bme280_profile_t profile)
+{
+    if (profile >= BME280_PROFILE_COUNT)
         return ESP_ERR_INVALID_ARG;
 
-    bme280_ctx_t *ctx = (bme280_ctx_t *)driver->ctx;
-    return driver->bus->ops->write(ctx->address, data, len);
+    driver_t *drv = NULL;
+    esp_err_t err = bme280_get_driver(instance, &drv);
+    if (err != ESP_OK)
+        return err;
+
+    return bme280_apply_settings(drv, &profiles[profile]);
 }
 
-esp_err_t bme280_read_id(uint8_t *id)
+esp_err_t bme280_start_measurement(uint8_t instance, uint32_t *wait_us)
 {
     driver_t *drv = NULL;
-    esp_err_t err = get_driver_by_id(BME280_DRIVER_ID, &drv);
+    esp_err_t err = bme280_get_driver(instance, &drv);
     if (err != ESP_OK)
         return err;
 
-    if (!drv || !drv->ctx)
-        return ESP_ERR_INVALID_STATE;
+    bme280_ctx_t *ctx = (bme280_ctx_t *)drv->ctx;
+    uint8_t cmd[2];
 
-    uint8_t reg = BME280_ID_REG;
-    err = drv->ops->write(drv, &reg, 1);   
+    err = bme280_start_cmd(ctx, cmd);
+    if (err == ESP_OK)
+        err = drv->ops->write(drv, cmd, sizeof(cmd));
     if (err != ESP_OK)
         return err;
 
-    return drv->ops->read(drv, id, 1);     
+    if (wait_us)
+        *wait_us = ctx->measure_time_us;
+
+    return ESP_OK;
 }
 
-typedef struct {
-    float temp_degree;
-    int32_t fine_tune_temp;
-} temp_data_t;
+esp_err_t bme280_submit_start(uint8_t instance, uint32_t *wait_us, bus_done_cb_t done, void *arg)
+{
+    driver_t *drv = NULL;
+    esp_err_t err = bme280_get_driver(instance, &drv);
+    if (err != ESP_OK)
+        return err;
+
+    bme280_ctx_t *ctx = (bme280_ctx_t *)drv->ctx;
+    err = bme280_start_cmd(ctx, ctx->start_cmd);
+    if (err != ESP_OK)
+        return err;
+
+    bus_transaction_t trans = {
+        .tx = ctx->start_cmd,
+        .tx_len = sizeof(ctx->start_cmd),
+        .done = done,
+        .arg = arg,
+    };
+
+    err = drv->bus->ops->submit(ctx->dev, &trans);
+    if (err != ESP_OK)
+        return err;
+
+    if (wait_us)
+        *wait_us = ctx->measure_time_us;
+
+    return ESP_OK;
+}
 
-temp_data_t compensate_temp(bme_calibration_data_t* calib, float raw_temp) {
-    double var1, var2;
+void bme280_decode_raw(const uint8_t *buf, bme280_raw_t *raw)
+{
+    raw->press = ((int32_t)buf[0] << 12) | ((int32_t)buf[1] << 4) | (buf[2] >> 4);
+    raw->temp  = ((int32_t)buf[3] << 12) | ((int32_t)buf[4] << 4) | (buf[5] >> 4);
+    raw->hum   = ((int32_t)buf[6] << 8) | buf[7];
+}
 
-    var1 = (((double)raw_temp)/16384.0 - ((double)calib->t1)/1024.0) * ((double)calib->t2);
+static esp_err_t bme280_fetch_raw(driver_t *drv, bme280_raw_t *raw)
+{
+    uint8_t raw_data[BME280_RAW_LEN];
 
-    var2 = ((((double)raw_temp)/131072.0 - ((double)calib->t1)/8192.0) *
-         (((double)raw_temp)/131072.0 - ((double)calib->t1)/8192.0)) * ((double)calib->t3);
+    esp_err_t err = drv->ops->read(drv, raw_data, BME280_RAW_LEN);
 
-    temp_data_t temp_data = {
-        .fine_tune_temp = (var1 + var2),
-        .temp_degree = (var1 + var2) / 5120.0
+    if (err != ESP_OK)
+        return err;
+
+    bme280_decode_raw(raw_data, raw);
+
+    return ESP_OK;
+}
+
+esp_err_t bme280_submit_read(uint8_t instance, uint8_t *buf, bus_done_cb_t done, void *arg)
+{
+    static const uint8_t data_reg = BME280_TEMP_MSB;
+
+    if (!buf)
+        return ESP_ERR_INVALID_ARG;
+
+    driver_t *drv = NULL;
+    esp_err_t err = bme280_get_driver(instance, &drv);
+    if (err != ESP_OK)
+        return err;
+
+    bme280_ctx_t *ctx = (bme280_ctx_t *)drv->ctx;
+    bus_transaction_t trans = {
+        .tx = &data_reg,
+        .tx_len = 1,
+        .rx = buf,
+        .rx_len = BME280_RAW_LEN,
+        .done = done,
+        .arg = arg,
     };
 
-    return temp_data;
+    return drv->bus->ops->submit(ctx->dev, &trans);
 }
 
-float compensate_humidity(bme_calibration_data_t* calib, int32_t fine_temp, float raw_humidity) {
-    double var_H;
+bool bme280_submit_retry(uint8_t instance, bus_attempt_t *attempt, esp_err_t err)
+{
+    driver_t *drv = NULL;
+    if (bme280_get_driver(instance, &drv) != ESP_OK)
+        return false;
 
-    var_H = (((double)fine_temp) - 76800.0);
+    bme280_ctx_t *ctx = (bme280_ctx_t *)drv->ctx;
+    return bus_retry(drv->bus, BUS_OP_SUBMIT, ctx->dev, attempt, err);
+}
 
-    var_H = (raw_humidity - (((double)calib->h4) * 64.0 + ((double)calib->h5) / 16384.0 * var_H)) *
-        (((double)calib->h2) / 65536.0 * (1.0 + ((double)calib->h6) / 67108864.0 * var_H *
-        (1.0 + ((double)calib->h3) / 67108864.0 * var_H)));
-    var_H = var_H * (1.0 - ((double)calib->h1) * var_H / 524288.0);
+esp_err_t bme280_read_raw(uint8_t instance, bme280_raw_t *raw)
+{
+    driver_t *drv = NULL;
+    esp_err_t err = bme280_get_driver(instance, &drv);
+    if (err != ESP_OK)
+        return err;
 
-    if(var_H > 100.0)
-        var_H = 100.0;
-    else if(var_H < 0.0)
-        var_H = 0.0;
+    return bme280_fetch_raw(drv, raw);
+}
 
-    return var_H;
+/*
+ * After a power-on reset the sensor sleeps with ctrl_hum cleared, and the
+ * forced conversions that follow skip humidity. The skip value is also a
+ * valid reading, so ctrl_hum decides; a reset sensor is initialised again
+ * and the sample is dropped.
+ */
+static esp_err_t bme280_check_reset(driver_t *drv, const bme280_raw_t *raw)
+{
+    bme280_ctx_t *ctx = (bme280_ctx_t *)drv->ctx;
+    uint8_t expected = BME280_OSRS_SKIP;
+
+    if (raw->hum != BME280_HUM_SKIPPED || regmap_cached(&ctx->regs, BME280_CTRL_HUM, &expected) != ESP_OK
+        || expected == BME280_OSRS_SKIP)
+        return ESP_OK;
+
+    /* The device, not the shadow, tells whether it was reset. */
+    uint8_t ctrl_hum = 0;
+    esp_err_t err = bme280_read_regs(drv, BME280_CTRL_HUM, &ctrl_hum, 1);
+    if (err != ESP_OK || (ctrl_hum & 0x07) == expected)
+        return err;
+
+    ESP_LOGW(TAG, "BME280 [%d] was reset, initializing again", drv->id);
+    err = driver_reinit(drv);
+    return err == ESP_OK ? ESP_ERR_INVALID_RESPONSE : err;
 }
 
-float compensate_pressure(bme_calibration_data_t* calib, int32_t fine_temp, float raw_humidity) {
-    double var1, var2, p;
-    double pressure_min = 30000.0;
-	double pressure_max = 110000.0;
+static void bme280_process(driver_t *drv, const bme280_raw_t *raw, bme280_data_t *data)
+{
+    bme280_ctx_t* ctx = (bme280_ctx_t*)drv->ctx;
 
-    var1 = ((double)fine_temp/2.0) - 64000.0;
-    var2 = var1 * var1 * ((double)calib->p6) / 32768.0;
-    var2 = var2 + var1 * ((double)calib->p5) * 2.0;
-    var2 = (var2 / 4.0) + (((double)calib->p4) * 65536.0);
-    var1 = (((double)calib->p3) * var1 * var1 / 524288.0 + ((double)calib->p2) * var1) / 524288.0;
-    var1 = (1.0 + var1 / 32768.0) * ((double)calib->p1);
+    INSTR_BEGIN(start);
+    bme280_compensate(&ctx->calibration_data, raw, data);
+    INSTR_END(&drv->instr[DRIVER_OP_PROCESS], start, BME280_RAW_LEN, ESP_OK);
+}
 
-    if(var1 == 0.0){
-        return 0;
-    }
+esp_err_t bme280_read_data(uint8_t instance, bme280_data_t *data)
+{
+    driver_t *drv = NULL;
+    esp_err_t err = bme280_get_driver(instance, &drv);
+    if (err != ESP_OK)
+        return err;
 
-    if(var1){
-        p = 1048576.0 - (double)raw_humidity;
-        p = (p - (var2 / 4096.0)) * 6250.0 / var1;
-        var1 = ((double)calib->p9) * p * p / 2147483648.0;
-        var2 = p * ((double)calib->p8) / 32768.0;
-        p = p + (var1 + var2 + ((double)calib->p7)) / 16.0;
-        
-        if (p < pressure_min)
-            p = pressure_min;
-        else if (p > pressure_max)
-            p = pressure_max;
+    bme280_raw_t raw;
+    err = bme280_fetch_raw(drv, &raw);
+    if (err == ESP_OK)
+        err = bme280_check_reset(drv, &raw);
+    if (err != ESP_OK)
+        return err;
 
-    } else {
-        p = pressure_min;
-    }
+    bme280_process(drv, &raw, data);
+    return ESP_OK;
+}
 
-    return p/100.0; 
+esp_err_t bme280_compensate_raw(uint8_t instance, const bme280_raw_t *raw, bme280_data_t *data)
+{
+    if (!raw || !data)
+        return ESP_ERR_INVALID_ARG;
+
+    driver_t *drv = NULL;
+    esp_err_t err = bme280_get_driver(instance, &drv);
+    if (err == ESP_OK)
+        err = bme280_check_reset(drv, raw);
+    if (err != ESP_OK)
+        return err;
+
+    bme280_process(drv, raw, data);
+    return ESP_OK;
 }
 
-esp_err_t bme280_read_data(bme280_data_t *data)
+esp_err_t bme280_reinit(uint8_t instance)
 {
+    if (instance >= BME280_INSTANCES)
+        return ESP_ERR_INVALID_ARG;
+
     driver_t *drv = NULL;
-    esp_err_t err = get_driver_by_id(BME280_DRIVER_ID, &drv);
+    esp_err_t err = get_driver_by_id(BME280_DRIVER_ID + instance, &drv);
     if (err != ESP_OK)
         return err;
 
-    if (!drv || !drv->ctx)
-        return ESP_ERR_INVALID_STATE;
+    return driver_reinit(drv);
+}
 
-    uint8_t raw_data[8];
-    
-    err = bme280_read(drv, raw_data, 8);
+esp_err_t bme280_get_regmap_stats(uint8_t instance, regmap_stats_t *stats)
+{
+    if (!stats)
+        return ESP_ERR_INVALID_ARG;
 
+    driver_t *drv = NULL;
+    esp_err_t err = bme280_get_driver(instance, &drv);
     if (err != ESP_OK)
         return err;
 
-    uint32_t raw_pres = (raw_data[0] << 12) | (raw_data[1] << 4) | (raw_data[2] >> 4); 
-    uint32_t raw_temp = (raw_data[3] << 12) | (raw_data[4] << 4) | (raw_data[5] >> 4); 
-    uint32_t raw_hum = (raw_data[6] << 8) | raw_data[7];  
+    *stats = ((bme280_ctx_t *)drv->ctx)->regs.stats;
+    return ESP_OK;
+}
 
-    bme280_ctx_t* ctx = (bme280_ctx_t*)drv->ctx;
+esp_err_t bme280_compensate_burst(uint8_t instance, const bme280_raw_batch_t *raw, bme280_data_batch_t *out, size_t count)
+{
+    if (!raw || !out)
+        return ESP_ERR_INVALID_ARG;
+
+    driver_t *drv = NULL;
+    esp_err_t err = bme280_get_driver(instance, &drv);
+    if (err != ESP_OK)
+        return err;
 
-    temp_data_t temp_data = compensate_temp(&ctx->calibration_data, raw_temp);
-    float compensated_hum = compensate_humidity(&ctx->calibration_data, (int32_t)temp_data.fine_tune_temp, raw_hum);
-    float compensated_press = compensate_pressure(&ctx->calibration_data, (int32_t)temp_data.fine_tune_temp, raw_pres);
+    bme280_ctx_t* ctx = (bme280_ctx_t*)drv->ctx;
 
-    data->temp = temp_data.temp_degree;
-    data->humidity = compensated_hum;
-    data->pressure = compensated_press;
+    INSTR_BEGIN(start);
+    bme280_compensate_batch(&ctx->calibration_data, raw, out, count);
+    INSTR_END(&drv->instr[DRIVER_OP_PROCESS], start, count * BME280_RAW_LEN, ESP_OK);
 
     return ESP_OK;
 }
@@ -1,7 +1,18 @@
 #ifndef _BME_280_h
 #define _BME_280_h
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sdkconfig.h>
 #include <esp_err.h>
+#include "../../bus/include/bus.h"
+#include "../include/regmap.h"
+
+/* Instance n is driver BME280_DRIVER_ID + n; see bme280_configs in bme_280.c. */
+#define BME280_DRIVER_ID     0x00
+#define BME280_MAX_INSTANCES 4
+#define BME280_INSTANCES     CONFIG_METEO_BME280_INSTANCES
+#define BME280_RAW_LEN       8
 
 typedef struct {
     float temp;
@@ -9,7 +20,79 @@ typedef struct {
     float humidity;
 } bme280_data_t;
 
-esp_err_t bme280_read_id(uint8_t *id);
-esp_err_t bme280_read_data(bme280_data_t *data);
+/* Raw ADC values: 20-bit temperature and pressure, 16-bit humidity. */
+typedef struct {
+    int32_t temp;
+    int32_t press;
+    int32_t hum;
+} bme280_raw_t;
+
+/* Structure-of-arrays views over a burst of samples. */
+typedef struct {
+    const int32_t *temp;
+    const int32_t *press;
+    const int32_t *hum;
+} bme280_raw_batch_t;
+
+typedef struct {
+    float *temp;
+    float *pressure;
+    float *humidity;
+} bme280_data_batch_t;
+
+typedef enum {
+    BME280_PROFILE_WEATHER,     /* T/P/H x1, filter off */
+    BME280_PROFILE_HIGH_RATE,   /* T x1, P x4, H x1, filter 4 */
+    BME280_PROFILE_LOW_NOISE,   /* T x2, P x16, H x16, filter 16 */
+    BME280_PROFILE_COUNT
+} bme280_profile_t;
+
+/* All calls take the sensor instance, 0 .. BME280_INSTANCES - 1. */
+esp_err_t bme280_read_id(uint8_t instance, uint8_t *id);
+
+/* Applies oversampling and IIR filter settings; the sensor is left in sleep mode. */
+esp_err_t bme280_set_profile(uint8_t instance, bme280_profile_t profile);
+
+/*
+ * Starts a forced-mode conversion. *wait_us is the datasheet maximum
+ * measurement time for the active profile; the data registers hold the new
+ * sample once it has elapsed.
+ */
+esp_err_t bme280_start_measurement(uint8_t instance, uint32_t *wait_us);
+
+/* Queued bme280_start_measurement(); *wait_us counts from done(). */
+esp_err_t bme280_submit_start(uint8_t instance, uint32_t *wait_us, bus_done_cb_t done, void *arg);
+
+esp_err_t bme280_read_data(uint8_t instance, bme280_data_t *data);
+esp_err_t bme280_read_raw(uint8_t instance, bme280_raw_t *raw);
+
+/*
+ * Queues a read of the BME280_RAW_LEN byte data block into buf and returns;
+ * done() runs once buf is filled. Decode it with bme280_decode_raw().
+ */
+esp_err_t bme280_submit_read(uint8_t instance, uint8_t *buf, bus_done_cb_t done, void *arg);
+
+/*
+ * Bus policy for a submitted start or read whose done() reported err: true,
+ * after the backoff, if it should be submitted again.
+ */
+bool bme280_submit_retry(uint8_t instance, bus_attempt_t *attempt, esp_err_t err);
+void bme280_decode_raw(const uint8_t *buf, bme280_raw_t *raw);
+
+/*
+ * Compensation with the instance's calibration. Like bme280_read_data(), it
+ * fails with ESP_ERR_INVALID_RESPONSE on a sample taken after the sensor
+ * lost its configuration in a reset, and reinitialises the instance.
+ */
+esp_err_t bme280_compensate_raw(uint8_t instance, const bme280_raw_t *raw, bme280_data_t *data);
+
+/* Initialises the instance again, e.g. after it stopped answering. */
+esp_err_t bme280_reinit(uint8_t instance);
+
+/* Shadow register counters since the instance was last initialised. */
+esp_err_t bme280_get_regmap_stats(uint8_t instance, regmap_stats_t *stats);
+
+/* Compensates `count` raw samples in one pass with the integer formulas. */
+esp_err_t bme280_compensate_burst(uint8_t instance, const bme280_raw_batch_t *raw, bme280_data_batch_t *out, size_t count);
 
-#endif
\ No newline at end of file
+#endif
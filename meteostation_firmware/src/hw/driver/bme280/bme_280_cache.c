@@ -0,0 +1,132 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_BME280_CALIB_CACHE
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <nvs.h>
+#include "bme_280_cache.h"
+
+#define CACHE_NAMESPACE "bme280"
+#define CACHE_VERSION   1
+
+static const char *TAG = "BME280_CACHE";
+
+typedef struct {
+    uint8_t version;
+    uint8_t chip_id;
+    uint16_t address;
+    bme_calibration_data_t calib;
+    uint32_t crc;
+} calib_record_t;
+
+static void cache_key(uint16_t address, char *key, size_t len)
+{
+    snprintf(key, len, "calib_%02x", address);
+}
+
+static uint32_t record_crc(const calib_record_t *rec)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)rec, offsetof(calib_record_t, crc));
+}
+
+esp_err_t bme280_cache_load(uint8_t chip_id, uint16_t address, bme_calibration_data_t *calib)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CACHE_NAMESPACE, NVS_READONLY, &nvs);
+    if (err != ESP_OK)
+        return err;
+
+    char key[16];
+    calib_record_t rec;
+    size_t len = sizeof(rec);
+
+    cache_key(address, key, sizeof(key));
+    err = nvs_get_blob(nvs, key, &rec, &len);
+    nvs_close(nvs);
+
+    if (err != ESP_OK)
+        return err;
+
+    if (len != sizeof(rec) || rec.version != CACHE_VERSION || rec.crc != record_crc(&rec)) {
+        ESP_LOGW(TAG, "Cached calibration for 0x%02X is corrupt", address);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    if (rec.chip_id != chip_id || rec.address != address) {
+        ESP_LOGW(TAG, "Cached calibration belongs to chip 0x%02X at 0x%02X", rec.chip_id, rec.address);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    *calib = rec.calib;
+    return ESP_OK;
+}
+
+esp_err_t bme280_cache_store(uint8_t chip_id, uint16_t address, const bme_calibration_data_t *calib)
+{
+    calib_record_t rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.version = CACHE_VERSION;
+    rec.chip_id = chip_id;
+    rec.address = address;
+    rec.calib = *calib;
+    rec.crc = record_crc(&rec);
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CACHE_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK)
+        return err;
+
+    char key[16];
+    cache_key(address, key, sizeof(key));
+
+    err = nvs_set_blob(nvs, key, &rec, sizeof(rec));
+    if (err == ESP_OK)
+        err = nvs_commit(nvs);
+
+    nvs_close(nvs);
+    return err;
+}
+
+esp_err_t bme280_cache_erase(uint16_t address)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CACHE_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK)
+        return err;
+
+    char key[16];
+    cache_key(address, key, sizeof(key));
+
+    err = nvs_erase_key(nvs, key);
+    if (err == ESP_OK)
+        err = nvs_commit(nvs);
+
+    nvs_close(nvs);
+    return err;
+}
+
+#else
+
+#include "bme_280_cache.h"
+
+esp_err_t bme280_cache_load(uint8_t chip_id, uint16_t address, bme_calibration_data_t *calib)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t bme280_cache_store(uint8_t chip_id, uint16_t address, const bme_calibration_data_t *calib)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t bme280_cache_erase(uint16_t address)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
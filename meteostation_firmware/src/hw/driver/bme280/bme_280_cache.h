@@ -0,0 +1,17 @@
+#ifndef _BME_280_CACHE_H
+#define _BME_280_CACHE_H
+
+#include <stdint.h>
+#include <esp_err.h>
+#include "bme_280_compensate.h"
+
+/*
+ * Parsed calibration block kept in NVS, tagged with the chip ID and bus
+ * address it was read from and protected by a CRC. NVS must be initialised
+ * by the application; without it every lookup misses.
+ */
+esp_err_t bme280_cache_load(uint8_t chip_id, uint16_t address, bme_calibration_data_t *calib);
+esp_err_t bme280_cache_store(uint8_t chip_id, uint16_t address, const bme_calibration_data_t *calib);
+esp_err_t bme280_cache_erase(uint16_t address);
+
+#endif
@@ -0,0 +1,287 @@
+#include <sdkconfig.h>
+#include "bme_280_compensate.h"
+
+#define BME280_PRESSURE_MIN_PA 30000
+#define BME280_PRESSURE_MAX_PA 110000
+#define BME280_BATCH_CHUNK     32
+
+void bme280_parse_calibration(const uint8_t calib1[BME280_CALIB1_LEN], const uint8_t calib2[BME280_CALIB2_LEN],
+                              bme_calibration_data_t *cd)
+{
+    cd->t1 = (uint16_t)(calib1[1] << 8 | calib1[0]);
+    cd->t2 = (int16_t)(calib1[3] << 8 | calib1[2]);
+    cd->t3 = (int16_t)(calib1[5] << 8 | calib1[4]);
+
+    cd->p1 = (uint16_t)(calib1[7] << 8 | calib1[6]);
+    cd->p2 = (int16_t)(calib1[9] << 8 | calib1[8]);
+    cd->p3 = (int16_t)(calib1[11] << 8 | calib1[10]);
+    cd->p4 = (int16_t)(calib1[13] << 8 | calib1[12]);
+    cd->p5 = (int16_t)(calib1[15] << 8 | calib1[14]);
+    cd->p6 = (int16_t)(calib1[17] << 8 | calib1[16]);
+    cd->p7 = (int16_t)(calib1[19] << 8 | calib1[18]);
+    cd->p8 = (int16_t)(calib1[21] << 8 | calib1[20]);
+    cd->p9 = (int16_t)(calib1[23] << 8 | calib1[22]);
+
+    cd->h1 = calib1[25];
+
+    cd->h2 = (int16_t)(calib2[1] << 8 | calib2[0]);
+    cd->h3 = calib2[2];
+
+    cd->h4 = (int16_t)((calib2[3] << 4) | (calib2[4] & 0x0F));
+    cd->h5 = (int16_t)((calib2[5] << 4) | (calib2[4] >> 4));
+
+    cd->h6 = (int8_t)calib2[6];
+}
+
+temp_data_t compensate_temp(const bme_calibration_data_t* calib, int32_t raw_temp) {
+    double var1, var2;
+
+    var1 = (((double)raw_temp)/16384.0 - ((double)calib->t1)/1024.0) * ((double)calib->t2);
+
+    var2 = ((((double)raw_temp)/131072.0 - ((double)calib->t1)/8192.0) *
+         (((double)raw_temp)/131072.0 - ((double)calib->t1)/8192.0)) * ((double)calib->t3);
+
+    temp_data_t temp_data = {
+        .fine_tune_temp = (var1 + var2),
+        .temp_degree = (var1 + var2) / 5120.0
+    };
+
+    return temp_data;
+}
+
+float compensate_humidity(const bme_calibration_data_t* calib, int32_t fine_temp, int32_t raw_humidity) {
+    double var_H;
+
+    var_H = (((double)fine_temp) - 76800.0);
+
+    var_H = (raw_humidity - (((double)calib->h4) * 64.0 + ((double)calib->h5) / 16384.0 * var_H)) *
+        (((double)calib->h2) / 65536.0 * (1.0 + ((double)calib->h6) / 67108864.0 * var_H *
+        (1.0 + ((double)calib->h3) / 67108864.0 * var_H)));
+    var_H = var_H * (1.0 - ((double)calib->h1) * var_H / 524288.0);
+
+    if(var_H > 100.0)
+        var_H = 100.0;
+    else if(var_H < 0.0)
+        var_H = 0.0;
+
+    return var_H;
+}
+
+float compensate_pressure(const bme_calibration_data_t* calib, int32_t fine_temp, int32_t raw_pressure) {
+    double var1, var2, p;
+    double pressure_min = BME280_PRESSURE_MIN_PA;
+    double pressure_max = BME280_PRESSURE_MAX_PA;
+
+    var1 = ((double)fine_temp/2.0) - 64000.0;
+    var2 = var1 * var1 * ((double)calib->p6) / 32768.0;
+    var2 = var2 + var1 * ((double)calib->p5) * 2.0;
+    var2 = (var2 / 4.0) + (((double)calib->p4) * 65536.0);
+    var1 = (((double)calib->p3) * var1 * var1 / 524288.0 + ((double)calib->p2) * var1) / 524288.0;
+    var1 = (1.0 + var1 / 32768.0) * ((double)calib->p1);
+
+    if(var1 == 0.0){
+        return 0;
+    }
+
+    p = 1048576.0 - (double)raw_pressure;
+    p = (p - (var2 / 4096.0)) * 6250.0 / var1;
+    var1 = ((double)calib->p9) * p * p / 2147483648.0;
+    var2 = p * ((double)calib->p8) / 32768.0;
+    p = p + (var1 + var2 + ((double)calib->p7)) / 16.0;
+
+    if (p < pressure_min)
+        p = pressure_min;
+    else if (p > pressure_max)
+        p = pressure_max;
+
+    return p/100.0;
+}
+
+int32_t compensate_temp_int(const bme_calibration_data_t* calib, int32_t raw_temp, int32_t *fine_temp) {
+    int32_t var1, var2;
+
+    var1 = ((((raw_temp >> 3) - ((int32_t)calib->t1 << 1))) * ((int32_t)calib->t2)) >> 11;
+    var2 = (((((raw_temp >> 4) - ((int32_t)calib->t1)) * ((raw_temp >> 4) - ((int32_t)calib->t1))) >> 12) *
+        ((int32_t)calib->t3)) >> 14;
+
+    *fine_temp = var1 + var2;
+    return (*fine_temp * 5 + 128) >> 8;
+}
+
+uint32_t compensate_humidity_int(const bme_calibration_data_t* calib, int32_t fine_temp, int32_t raw_humidity) {
+    int32_t v;
+
+    v = fine_temp - ((int32_t)76800);
+    v = (((((raw_humidity << 14) - (((int32_t)calib->h4) << 20) - (((int32_t)calib->h5) * v)) +
+        ((int32_t)16384)) >> 15) * (((((((v * ((int32_t)calib->h6)) >> 10) *
+        (((v * ((int32_t)calib->h3)) >> 11) + ((int32_t)32768))) >> 10) +
+        ((int32_t)2097152)) * ((int32_t)calib->h2) + 8192) >> 14));
+    v = v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t)calib->h1)) >> 4);
+
+    if (v < 0)
+        v = 0;
+    else if (v > 419430400)
+        v = 419430400;
+
+    return (uint32_t)(v >> 12);
+}
+
+uint32_t compensate_pressure_int(const bme_calibration_data_t* calib, int32_t fine_temp, int32_t raw_pressure) {
+    int64_t var1, var2, p;
+
+    var1 = ((int64_t)fine_temp) - 128000;
+    var2 = var1 * var1 * (int64_t)calib->p6;
+    var2 = var2 + ((var1 * (int64_t)calib->p5) * 131072);
+    var2 = var2 + (((int64_t)calib->p4) * 34359738368LL);
+    var1 = ((var1 * var1 * (int64_t)calib->p3) >> 8) + ((var1 * (int64_t)calib->p2) * 4096);
+    var1 = ((((int64_t)1) << 47) + var1) * ((int64_t)calib->p1) >> 33;
+
+    if (var1 == 0)
+        return 0;
+
+    p = 1048576 - raw_pressure;
+    p = (((p * 2147483648LL) - var2) * 3125) / var1;
+    var1 = (((int64_t)calib->p9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t)calib->p8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t)calib->p7) << 4);
+
+    if (p < (int64_t)BME280_PRESSURE_MIN_PA << 8)
+        p = (int64_t)BME280_PRESSURE_MIN_PA << 8;
+    else if (p > (int64_t)BME280_PRESSURE_MAX_PA << 8)
+        p = (int64_t)BME280_PRESSURE_MAX_PA << 8;
+
+    return (uint32_t)p;
+}
+
+void bme280_compensate_float(const bme_calibration_data_t* calib, const bme280_raw_t *raw, bme280_data_t *out)
+{
+    temp_data_t temp_data = compensate_temp(calib, raw->temp);
+
+    out->temp = temp_data.temp_degree;
+    out->humidity = compensate_humidity(calib, temp_data.fine_tune_temp, raw->hum);
+    out->pressure = compensate_pressure(calib, temp_data.fine_tune_temp, raw->press);
+}
+
+void bme280_compensate_int(const bme_calibration_data_t* calib, const bme280_raw_t *raw, bme280_data_t *out)
+{
+    int32_t fine_temp;
+    int32_t temp = compensate_temp_int(calib, raw->temp, &fine_temp);
+
+    out->temp = (float)temp / 100.0f;
+    out->humidity = (float)compensate_humidity_int(calib, fine_temp, raw->hum) / 1024.0f;
+    out->pressure = (float)compensate_pressure_int(calib, fine_temp, raw->press) / 25600.0f;
+}
+
+typedef struct {
+    int32_t t1, t1_x2, t2, t3;
+    int32_t h1, h2, h3, h4_x2p20, h5, h6;
+    int64_t p1, p2_x2p12, p3, p4_x2p35, p5_x2p17, p6, p7_x2p4, p8, p9;
+} batch_coeffs_t;
+
+static void load_batch_coeffs(const bme_calibration_data_t* calib, batch_coeffs_t *k)
+{
+    k->t1 = calib->t1;
+    k->t1_x2 = (int32_t)calib->t1 << 1;
+    k->t2 = calib->t2;
+    k->t3 = calib->t3;
+
+    k->h1 = calib->h1;
+    k->h2 = calib->h2;
+    k->h3 = calib->h3;
+    k->h4_x2p20 = (int32_t)calib->h4 << 20;
+    k->h5 = calib->h5;
+    k->h6 = calib->h6;
+
+    k->p1 = calib->p1;
+    k->p2_x2p12 = (int64_t)calib->p2 * 4096;
+    k->p3 = calib->p3;
+    k->p4_x2p35 = (int64_t)calib->p4 * 34359738368LL;
+    k->p5_x2p17 = (int64_t)calib->p5 * 131072;
+    k->p6 = calib->p6;
+    k->p7_x2p4 = (int64_t)calib->p7 << 4;
+    k->p8 = calib->p8;
+    k->p9 = calib->p9;
+}
+
+static void batch_temp(const batch_coeffs_t *k, const int32_t *adc, int32_t *fine, float *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        int32_t var1 = (((adc[i] >> 3) - k->t1_x2) * k->t2) >> 11;
+        int32_t d = (adc[i] >> 4) - k->t1;
+        int32_t var2 = (((d * d) >> 12) * k->t3) >> 14;
+
+        fine[i] = var1 + var2;
+        out[i] = (float)((fine[i] * 5 + 128) >> 8) / 100.0f;
+    }
+}
+
+static void batch_humidity(const batch_coeffs_t *k, const int32_t *adc, const int32_t *fine, float *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        int32_t v = fine[i] - 76800;
+
+        v = ((((adc[i] << 14) - k->h4_x2p20 - (k->h5 * v)) + 16384) >> 15) *
+            (((((((v * k->h6) >> 10) * (((v * k->h3) >> 11) + 32768)) >> 10) + 2097152) * k->h2 + 8192) >> 14);
+        v = v - (((((v >> 15) * (v >> 15)) >> 7) * k->h1) >> 4);
+        v = v < 0 ? 0 : v;
+        v = v > 419430400 ? 419430400 : v;
+
+        out[i] = (float)(v >> 12) / 1024.0f;
+    }
+}
+
+static void batch_pressure(const batch_coeffs_t *k, const int32_t *adc, const int32_t *fine, float *out, size_t n)
+{
+    const int64_t p_min = (int64_t)BME280_PRESSURE_MIN_PA << 8;
+    const int64_t p_max = (int64_t)BME280_PRESSURE_MAX_PA << 8;
+
+    for (size_t i = 0; i < n; i++) {
+        int64_t var1 = (int64_t)fine[i] - 128000;
+        int64_t var2 = var1 * var1 * k->p6 + var1 * k->p5_x2p17 + k->p4_x2p35;
+
+        var1 = ((var1 * var1 * k->p3) >> 8) + var1 * k->p2_x2p12;
+        var1 = ((((int64_t)1) << 47) + var1) * k->p1 >> 33;
+
+        if (var1 == 0) {
+            out[i] = 0.0f;
+            continue;
+        }
+
+        int64_t p = 1048576 - adc[i];
+        p = (((p * 2147483648LL) - var2) * 3125) / var1;
+        int64_t var3 = (k->p9 * (p >> 13) * (p >> 13)) >> 25;
+        int64_t var4 = (k->p8 * p) >> 19;
+        p = ((p + var3 + var4) >> 8) + k->p7_x2p4;
+
+        p = p < p_min ? p_min : p;
+        p = p > p_max ? p_max : p;
+
+        out[i] = (float)(uint32_t)p / 25600.0f;
+    }
+}
+
+void bme280_compensate_batch(const bme_calibration_data_t* calib, const bme280_raw_batch_t *raw,
+                             bme280_data_batch_t *out, size_t count)
+{
+    batch_coeffs_t k;
+    int32_t fine[BME280_BATCH_CHUNK];
+
+    load_batch_coeffs(calib, &k);
+
+    for (size_t base = 0; base < count; base += BME280_BATCH_CHUNK) {
+        size_t n = count - base < BME280_BATCH_CHUNK ? count - base : BME280_BATCH_CHUNK;
+
+        batch_temp(&k, raw->temp + base, fine, out->temp + base, n);
+        batch_humidity(&k, raw->hum + base, fine, out->humidity + base, n);
+        batch_pressure(&k, raw->press + base, fine, out->pressure + base, n);
+    }
+}
+
+void bme280_compensate(const bme_calibration_data_t* calib, const bme280_raw_t *raw, bme280_data_t *out)
+{
+#ifdef CONFIG_METEO_BME280_COMPENSATION_FLOAT
+    bme280_compensate_float(calib, raw, out);
+#else
+    bme280_compensate_int(calib, raw, out);
+#endif
+}
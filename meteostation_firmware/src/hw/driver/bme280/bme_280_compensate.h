@@ -0,0 +1,62 @@
+#ifndef _BME_280_COMPENSATE_H
+#define _BME_280_COMPENSATE_H
+
+#include <stdint.h>
+#include "bme_280.h"
+
+typedef struct {
+    uint16_t t1;
+    int16_t t2, t3;
+
+    uint16_t p1;
+    int16_t p2, p3, p4, p5, p6, p7, p8, p9;
+
+    uint8_t h1;
+    int16_t h2;
+    uint8_t h3;
+    int16_t h4;
+    int16_t h5;
+    int8_t  h6;
+} bme_calibration_data_t;
+
+/* Calibration blocks at 0x88 and 0xE1. */
+#define BME280_CALIB1_LEN 26
+#define BME280_CALIB2_LEN 7
+
+void bme280_parse_calibration(const uint8_t calib1[BME280_CALIB1_LEN], const uint8_t calib2[BME280_CALIB2_LEN],
+                              bme_calibration_data_t *cd);
+
+typedef struct {
+    float temp_degree;
+    int32_t fine_tune_temp;
+} temp_data_t;
+
+/* Bosch double precision formulas. */
+temp_data_t compensate_temp(const bme_calibration_data_t* calib, int32_t raw_temp);
+float compensate_humidity(const bme_calibration_data_t* calib, int32_t fine_temp, int32_t raw_humidity);
+float compensate_pressure(const bme_calibration_data_t* calib, int32_t fine_temp, int32_t raw_pressure);
+
+/*
+ * Bosch integer formulas. Temperature in 0.01 degC, humidity in Q22.10 %RH,
+ * pressure in Q24.8 Pa.
+ */
+int32_t compensate_temp_int(const bme_calibration_data_t* calib, int32_t raw_temp, int32_t *fine_temp);
+uint32_t compensate_humidity_int(const bme_calibration_data_t* calib, int32_t fine_temp, int32_t raw_humidity);
+uint32_t compensate_pressure_int(const bme_calibration_data_t* calib, int32_t fine_temp, int32_t raw_pressure);
+
+void bme280_compensate_float(const bme_calibration_data_t* calib, const bme280_raw_t *raw, bme280_data_t *out);
+void bme280_compensate_int(const bme_calibration_data_t* calib, const bme280_raw_t *raw, bme280_data_t *out);
+
+/*
+ * Batch kernel over structure-of-arrays input, bit-exact with
+ * bme280_compensate_int. Each quantity is done in its own pass over a chunk
+ * with the calibration terms hoisted, which keeps the inner loops free of
+ * reloads and lets the compiler vectorise the 32-bit passes.
+ */
+void bme280_compensate_batch(const bme_calibration_data_t* calib, const bme280_raw_batch_t *raw,
+                             bme280_data_batch_t *out, size_t count);
+
+/* Compensates one sample with the path selected by CONFIG_METEO_BME280_COMPENSATION_*. */
+void bme280_compensate(const bme_calibration_data_t* calib, const bme280_raw_t *raw, bme280_data_t *out);
+
+#endif
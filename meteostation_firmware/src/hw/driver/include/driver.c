@@ -1,33 +1,180 @@
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
 #include "driver.h"
+#include "../../../util/clock.h"
 
-driver_entry_t driver_table[MAX_DRIVERS_NUM];
+#define DRIVER_INIT_STACK      4096
+#define DRIVER_INIT_TIMEOUT_MS 2000
+
+#ifdef CONFIG_IDF_TARGET_LINUX
+extern const driver_entry_t __start_meteo_driver_desc[];
+extern const driver_entry_t __stop_meteo_driver_desc[];
+#define DRIVER_DESC_START __start_meteo_driver_desc
+#define DRIVER_DESC_END   __stop_meteo_driver_desc
+#else
+extern const driver_entry_t _meteo_driver_desc_start[];
+extern const driver_entry_t _meteo_driver_desc_end[];
+#define DRIVER_DESC_START _meteo_driver_desc_start
+#define DRIVER_DESC_END   _meteo_driver_desc_end
+#endif
+
+driver_t *driver_table[MAX_DRIVERS_NUM];
 driver_count_ty driver_count = 0;
 
-void init_drivers(void)
+static void build_driver_table(void)
 {
-    ESP_LOGI(DRIVER_SYSTEM_NAME, "Start initializing drivers...");
+    if (driver_count)
+        return;
+
+    for (const driver_entry_t *entry = DRIVER_DESC_START; entry < DRIVER_DESC_END; ++entry) {
+        driver_t *drv = entry->driver;
 
-    for (driver_count_ty i = 0; i < driver_count; ++i) {
-        driver_entry_t *entry = &driver_table[i];
-        if (entry == NULL || entry->driver == NULL) {
-            ESP_LOGW(DRIVER_SYSTEM_NAME, "Skipped null slot %d", i);
+        if (drv == NULL || drv->ops == NULL || drv->ops->init == NULL) {
+            ESP_LOGE(DRIVER_SYSTEM_NAME, "Driver [%d] missing init()", entry->id);
             continue;
         }
 
-        driver_t *drv = entry->driver;
-        if (drv->ops == NULL || drv->ops->init == NULL) {
-            ESP_LOGE(DRIVER_SYSTEM_NAME, "Driver [%d] missing init()", drv->id);
+        if (driver_table[entry->id]) {
+            ESP_LOGE(DRIVER_SYSTEM_NAME, "Duplicate driver id [%d], ignored.", entry->id);
             continue;
         }
 
-        esp_err_t err = drv->ops->init(drv);
-        if (err != ESP_OK) {
-            ESP_LOGE(DRIVER_SYSTEM_NAME, "Error initializing driver [%d]: %s", drv->id, esp_err_to_name(err));
+        driver_table[entry->id] = drv;
+        driver_count++;
+    }
+}
+
+typedef struct {
+    driver_count_ty count;
+    driver_t *drivers[MAX_DRIVERS_NUM];
+    SemaphoreHandle_t done;
+} init_group_t;
+
+static init_group_t groups[MAX_BUSES_NUM];
+static SemaphoreHandle_t lazy_lock = NULL;
+
+static void init_one(driver_t *drv)
+{
+    drv->state = DRIVER_STATE_INITIALIZING;
+
+    int64_t start = clock_now_us();
+    esp_err_t err = drv->ops->init(drv);
+    drv->init_time_us = clock_now_us() - start;
+    drv->init_err = err;
+    drv->state = err == ESP_OK ? DRIVER_STATE_READY : DRIVER_STATE_FAILED;
+
+    if (err != ESP_OK) {
+        ESP_LOGE(DRIVER_SYSTEM_NAME, "Error initializing driver [%d]: %s", drv->id, esp_err_to_name(err));
+        return;
+    }
+
+    ESP_LOGI(DRIVER_SYSTEM_NAME, "Driver [%d] initialized in %lld us", drv->id, (long long)drv->init_time_us);
+}
+
+static void init_group(init_group_t *group)
+{
+    for (driver_count_ty i = 0; i < group->count; ++i)
+        init_one(group->drivers[i]);
+}
+
+static void init_group_task(void *arg)
+{
+    init_group_t *group = arg;
+
+    init_group(group);
+    xSemaphoreGive(group->done);
+    vTaskDelete(NULL);
+}
+
+void init_drivers(void)
+{
+    ESP_LOGI(DRIVER_SYSTEM_NAME, "Start initializing drivers...");
+
+    int64_t start = clock_now_us();
+
+    build_driver_table();
+
+    if (!lazy_lock)
+        lazy_lock = xSemaphoreCreateMutex();
+
+    init_group_t *active[MAX_BUSES_NUM];
+    size_t active_count = 0;
+
+    for (size_t i = 0; i < MAX_BUSES_NUM; ++i)
+        groups[i].count = 0;
+
+    for (driver_count_ty i = 0; i < MAX_DRIVERS_NUM; ++i) {
+        driver_t *drv = driver_table[i];
+        if (drv == NULL || drv->state != DRIVER_STATE_PENDING || (drv->flags & DRIVER_FLAG_LAZY))
+            continue;
+
+        if (drv->bus_id >= MAX_BUSES_NUM) {
+            ESP_LOGE(DRIVER_SYSTEM_NAME, "Driver [%d] on invalid bus [%d]", drv->id, (int)drv->bus_id);
+            drv->init_err = ESP_ERR_INVALID_ARG;
+            drv->state = DRIVER_STATE_FAILED;
             continue;
         }
 
-        ESP_LOGI(DRIVER_SYSTEM_NAME, "Driver [%d] initialized successfully!", drv->id);
+        /* Claimed now, so a lazy lookup never starts a second init of it. */
+        drv->state = DRIVER_STATE_INITIALIZING;
+
+        init_group_t *group = &groups[drv->bus_id];
+        if (group->count == 0)
+            active[active_count++] = group;
+        group->drivers[group->count++] = drv;
     }
+
+    /* The first group runs on the calling task, the rest on pinned workers. */
+    SemaphoreHandle_t done = active_count > 1 ? xSemaphoreCreateCounting(active_count, 0) : NULL;
+    size_t spawned = 0;
+
+    for (size_t i = 1; done && i < active_count; ++i) {
+        active[i]->done = done;
+        BaseType_t core = (BaseType_t)(i % portNUM_PROCESSORS);
+
+        if (xTaskCreatePinnedToCore(init_group_task, "drv_init", DRIVER_INIT_STACK, active[i],
+                                    uxTaskPriorityGet(NULL), NULL, core) == pdPASS) {
+            spawned++;
+        } else {
+            init_group(active[i]);
+        }
+    }
+
+    if (active_count > 0)
+        init_group(active[0]);
+
+    /* Only a run without workers may run the remaining groups inline. */
+    for (size_t i = 1; !done && i < active_count; ++i)
+        init_group(active[i]);
+
+    for (size_t i = 0; i < spawned; ++i) {
+        if (xSemaphoreTake(done, pdMS_TO_TICKS(DRIVER_INIT_TIMEOUT_MS)) != pdTRUE) {
+            ESP_LOGE(DRIVER_SYSTEM_NAME, "Driver init workers did not finish in %d ms", DRIVER_INIT_TIMEOUT_MS);
+            done = NULL;
+            break;
+        }
+    }
+
+    if (done)
+        vSemaphoreDelete(done);
+
+    ESP_LOGI(DRIVER_SYSTEM_NAME, "Drivers initialized in %lld us", (long long)(clock_now_us() - start));
+}
+
+/* Waits out an init running on a boot worker that outlived init_drivers(). */
+static bool wait_initialized(driver_t *drv)
+{
+    int64_t until = clock_now_us() + (int64_t)DRIVER_INIT_TIMEOUT_MS * 1000;
+
+    while (drv->state == DRIVER_STATE_INITIALIZING) {
+        if (clock_now_us() > until)
+            return false;
+        vTaskDelay(1);
+    }
+    return true;
 }
 
 esp_err_t get_driver_by_id(driver_id id, driver_t **driver) {
@@ -35,11 +182,82 @@ esp_err_t get_driver_by_id(driver_id id, driver_t **driver) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (driver_table[id].driver == NULL) {
+    driver_t *drv = driver_table[id];
+    if (drv == NULL) {
         return ESP_ERR_INVALID_STATE;
     }
 
-    *driver = driver_table[id].driver;
+    if (drv->state == DRIVER_STATE_PENDING) {
+        if (lazy_lock)
+            xSemaphoreTake(lazy_lock, portMAX_DELAY);
+        if (drv->state == DRIVER_STATE_PENDING)
+            init_one(drv);
+        if (lazy_lock)
+            xSemaphoreGive(lazy_lock);
+    }
+
+    if (!wait_initialized(drv))
+        return ESP_ERR_TIMEOUT;
+
+    *driver = drv;
 
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+esp_err_t driver_reinit(driver_t *driver)
+{
+    if (!driver)
+        return ESP_ERR_INVALID_ARG;
+
+    if (!wait_initialized(driver))
+        return ESP_ERR_TIMEOUT;
+
+    if (lazy_lock)
+        xSemaphoreTake(lazy_lock, portMAX_DELAY);
+
+    /* A driver that cannot let go of its device keeps running as it is. */
+    esp_err_t err = driver->ctx ? driver->ops->destruct(driver) : ESP_OK;
+    if (err == ESP_OK) {
+        init_one(driver);
+        err = driver->init_err;
+    }
+
+    if (lazy_lock)
+        xSemaphoreGive(lazy_lock);
+
+    return err;
+}
+
+void *driver_ctx_alloc(driver_t *driver)
+{
+#ifdef CONFIG_METEO_DRIVER_STATIC_CTX
+    driver->ctx = driver->ctx_storage;
+    if (driver->ctx)
+        memset(driver->ctx, 0, driver->ctx_size);
+#else
+    driver->ctx = calloc(1, driver->ctx_size);
+#endif
+    return driver->ctx;
+}
+
+void driver_ctx_free(driver_t *driver)
+{
+#ifndef CONFIG_METEO_DRIVER_STATIC_CTX
+    free(driver->ctx);
+#endif
+    driver->ctx = NULL;
+}
+
+#ifdef CONFIG_METEO_INSTR
+esp_err_t driver_get_instr(driver_id id, driver_op_t op, instr_snapshot_t *out)
+{
+    if (id >= MAX_DRIVERS_NUM || op >= DRIVER_OP_COUNT || !out)
+        return ESP_ERR_INVALID_ARG;
+
+    if (driver_table[id] == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    instr_snapshot(&driver_table[id]->instr[op], out);
+    return ESP_OK;
+}
+#endif
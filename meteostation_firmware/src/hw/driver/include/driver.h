@@ -12,8 +12,32 @@
 typedef uint8_t driver_id;
 typedef uint8_t driver_count_ty;
 
+/* Initialise on first get_driver_by_id() instead of at boot. */
+#define DRIVER_FLAG_LAZY 0x01
+
+/* Static contexts start on a cache line of their own. */
+#define DRIVER_CTX_ALIGN 32
+
+typedef enum {
+    DRIVER_STATE_PENDING,
+    /* Claimed by a boot worker or a lazy init; others wait for the result. */
+    DRIVER_STATE_INITIALIZING,
+    DRIVER_STATE_READY,
+    DRIVER_STATE_FAILED,
+} driver_state_t;
+
 typedef struct driver_t driver_t;
 
+/* Instrumented operations, see driver_get_instr(). */
+typedef enum {
+    DRIVER_OP_INIT,
+    DRIVER_OP_READ,
+    DRIVER_OP_WRITE,
+    /* Driver-side data processing outside the ops, e.g. compensation. */
+    DRIVER_OP_PROCESS,
+    DRIVER_OP_COUNT,
+} driver_op_t;
+
 typedef struct {
     esp_err_t (*init)(driver_t *driver);
     esp_err_t (*destruct)(driver_t *driver);
@@ -23,9 +47,20 @@ typedef struct {
 
 struct driver_t {
     driver_id id;
+    bus_id bus_id;               /* bus the driver depends on */
+    uint8_t flags;
     bus_t *bus;                  
     driver_operations_t *ops;    
+    const void *config;          /* per-instance settings, see DEFINE_DRIVER_INSTANCE */
     void *ctx;                   
+    void *ctx_storage;           /* static context, NULL when it comes from the heap */
+    size_t ctx_size;
+    volatile driver_state_t state;
+    esp_err_t init_err;
+    int64_t init_time_us;
+#ifdef CONFIG_METEO_INSTR
+    instr_stat_t instr[DRIVER_OP_COUNT];
+#endif
 };
 
 typedef struct {
@@ -33,62 +68,169 @@ typedef struct {
     driver_t *driver;
 } driver_entry_t;
 
-extern driver_entry_t driver_table[MAX_DRIVERS_NUM];
+extern driver_t *driver_table[MAX_DRIVERS_NUM];
 extern driver_count_ty driver_count;
 
-#define REGISTER_DRIVER(ID, DRIVER_ENTRY_PTR)                                          \
-    do {                                                                               \
-        if ((DRIVER_ENTRY_PTR) == NULL || (DRIVER_ENTRY_PTR)->driver == NULL) {        \
-            ESP_LOGE(DRIVER_SYSTEM_NAME, "Null driver entry for driver [%d].", (int)(ID)); \
-            break;                                                                     \
-        }                                                                              \
-        driver_t *_drv = (DRIVER_ENTRY_PTR)->driver;                                   \
-        if (_drv->ops == NULL || _drv->ops->init == NULL) {                            \
-            ESP_LOGE(DRIVER_SYSTEM_NAME, "Invalid ops or missing init() for driver [%d].", (int)(ID)); \
-            break;                                                                     \
-        }                                                                              \
-        if (driver_count < MAX_DRIVERS_NUM) {                                          \
-            driver_table[driver_count].id = (ID);                                      \
-            driver_table[driver_count].driver = _drv;                                  \
-            driver_count++;                                                            \
-            ESP_LOGI(DRIVER_SYSTEM_NAME, "Driver [%d] registered.", (int)(ID));        \
-        } else {                                                                       \
-            ESP_LOGE(DRIVER_SYSTEM_NAME, "Driver table full, cannot register [%d].", (int)(ID)); \
-        }                                                                              \
-    } while (0)
-
-#define DEFINE_DRIVER_REGISTER(ID, TAG_NAME, BUS_PTR, INIT_FN, DESTRUCT_FN, READ_FN, WRITE_FN) \
+/* Driver descriptors live in their own linker section, like buses. */
+#define DRIVER_DESC_SECTION "meteo_driver_desc"
+
+#ifdef CONFIG_METEO_INSTR
+#define DRIVER_INSTR_THUNKS(TAG_NAME, INIT_FN, READ_FN, WRITE_FN)                                \
+    static esp_err_t TAG_NAME##_instr_init(driver_t *driver)                                   \
+    {                                                                                          \
+        uint32_t start = instr_cycles();                                                       \
+        esp_err_t err = INIT_FN(driver);                                                       \
+        instr_record(&driver->instr[DRIVER_OP_INIT], start, 0, err);                           \
+        return err;                                                                            \
+    }                                                                                          \
+                                                                                               \
+    static esp_err_t TAG_NAME##_instr_read(driver_t *driver, void *data, size_t len)           \
+    {                                                                                          \
+        uint32_t start = instr_cycles();                                                       \
+        esp_err_t err = READ_FN(driver, data, len);                                            \
+        instr_record(&driver->instr[DRIVER_OP_READ], start, len, err);                         \
+        return err;                                                                            \
+    }                                                                                          \
+                                                                                               \
+    static esp_err_t TAG_NAME##_instr_write(driver_t *driver, const void *data, size_t len)    \
+    {                                                                                          \
+        uint32_t start = instr_cycles();                                                       \
+        esp_err_t err = WRITE_FN(driver, data, len);                                           \
+        instr_record(&driver->instr[DRIVER_OP_WRITE], start, len, err);                        \
+        return err;                                                                            \
+    }
+
+#define DRIVER_INSTR_OP(TAG_NAME, OP, FN) TAG_NAME##_instr_##OP
+#else
+#define DRIVER_INSTR_THUNKS(TAG_NAME, INIT_FN, READ_FN, WRITE_FN)
+#define DRIVER_INSTR_OP(TAG_NAME, OP, FN) FN
+#endif
+
+#ifdef CONFIG_METEO_DRIVER_STATIC_CTX
+#define DRIVER_CTX_STORAGE(NAME, CTX_TYPE)                                                      \
+    static CTX_TYPE NAME __attribute__((aligned(DRIVER_CTX_ALIGN)));
+#define DRIVER_CTX_PTR(NAME) (&NAME)
+
+/*
+ * Allocator calls after the registration stop the compile; cmake/driver_heap.cmake
+ * checks the objects, including what the poison cannot see.
+ */
+#define DRIVER_HEAP_POISON                                                                      \
+    _Pragma("GCC poison malloc calloc realloc free heap_caps_malloc heap_caps_calloc heap_caps_realloc")
+#else
+#define DRIVER_CTX_STORAGE(NAME, CTX_TYPE)
+#define DRIVER_CTX_PTR(NAME) NULL
+#define DRIVER_HEAP_POISON
+#endif
+
+/*
+ * CTX_TYPE is the type driver_ctx_alloc() hands out; it must be complete here.
+ * With CONFIG_METEO_DRIVER_STATIC_CTX each instance gets its own storage.
+ */
+#define DEFINE_DRIVER_REGISTER(ID, TAG_NAME, BUS_ID, FLAGS, CTX_TYPE, INIT_FN, DESTRUCT_FN, READ_FN, WRITE_FN) \
     static esp_err_t INIT_FN(driver_t *driver);                                                \
     static esp_err_t DESTRUCT_FN(driver_t *driver);                                            \
     static esp_err_t READ_FN(driver_t *driver, void *data, size_t len);                        \
     static esp_err_t WRITE_FN(driver_t *driver, const void *data, size_t len);                 \
                                                                                                \
+    DRIVER_INSTR_THUNKS(TAG_NAME, INIT_FN, READ_FN, WRITE_FN)                                  \
+                                                                                               \
     static driver_operations_t TAG_NAME##_ops = {                                              \
-        .init = INIT_FN,                                                                       \
+        .init = DRIVER_INSTR_OP(TAG_NAME, init, INIT_FN),                                      \
         .destruct = DESTRUCT_FN,                                                               \
-        .read = READ_FN,                                                                       \
-        .write = WRITE_FN                                                                      \
+        .read = DRIVER_INSTR_OP(TAG_NAME, read, READ_FN),                                      \
+        .write = DRIVER_INSTR_OP(TAG_NAME, write, WRITE_FN)                                    \
     };                                                                                         \
                                                                                                \
+    typedef CTX_TYPE TAG_NAME##_ctx_type;                                                      \
+    DRIVER_CTX_STORAGE(TAG_NAME##_ctx_storage, TAG_NAME##_ctx_type)                            \
+                                                                                               \
     static driver_t TAG_NAME##_driver = {                                                      \
         .id = (ID),                                                                            \
-        .bus = (BUS_PTR),                                                                      \
+        .bus_id = (BUS_ID),                                                                    \
+        .flags = (FLAGS),                                                                      \
+        .bus = NULL,                                                                           \
         .ops = &TAG_NAME##_ops,                                                                \
-        .ctx = NULL                                                                            \
+        .config = NULL,                                                                        \
+        .ctx = NULL,                                                                           \
+        .ctx_storage = DRIVER_CTX_PTR(TAG_NAME##_ctx_storage),                                 \
+        .ctx_size = sizeof(CTX_TYPE)                                                           \
     };                                                                                         \
                                                                                                \
-    static driver_entry_t TAG_NAME##_entry = {                                                 \
+    _Static_assert((ID) < MAX_DRIVERS_NUM, "Driver id out of range");                          \
+    _Static_assert((BUS_ID) < MAX_BUSES_NUM, "Driver bus id out of range");                    \
+                                                                                               \
+    /* A second driver with the same id fails to link on this symbol. */                      \
+    const char BUS_CAT(meteo_driver_id_, ID) = 0;                                              \
+                                                                                               \
+    static const driver_entry_t TAG_NAME##_entry                                               \
+        __attribute__((used, section(DRIVER_DESC_SECTION))) = {                                \
         .id = (ID),                                                                            \
         .driver = &TAG_NAME##_driver                                                           \
     };                                                                                         \
                                                                                                \
-    __attribute__((constructor)) static void TAG_NAME##_auto_register(void) {                  \
-        REGISTER_DRIVER(ID, &TAG_NAME##_entry);                                                \
-    }
+    DRIVER_HEAP_POISON
 
+/*
+ * Another instance of a driver defined with DEFINE_DRIVER_REGISTER in the same
+ * file: it shares TAG_NAME's ops and context type but has its own id, bus,
+ * state, ctx and counters. CONFIG reaches the ops as driver->config.
+ */
+#define DEFINE_DRIVER_INSTANCE(ID, TAG_NAME, INSTANCE, BUS_ID, FLAGS, CONFIG)                   \
+    DRIVER_CTX_STORAGE(TAG_NAME##_##INSTANCE##_ctx_storage, TAG_NAME##_ctx_type)               \
+                                                                                               \
+    static driver_t TAG_NAME##_##INSTANCE##_driver = {                                         \
+        .id = (ID),                                                                            \
+        .bus_id = (BUS_ID),                                                                    \
+        .flags = (FLAGS),                                                                      \
+        .bus = NULL,                                                                           \
+        .ops = &TAG_NAME##_ops,                                                                \
+        .config = (CONFIG),                                                                    \
+        .ctx = NULL,                                                                           \
+        .ctx_storage = DRIVER_CTX_PTR(TAG_NAME##_##INSTANCE##_ctx_storage),                    \
+        .ctx_size = sizeof(TAG_NAME##_ctx_type)                                                \
+    };                                                                                         \
+                                                                                               \
+    _Static_assert((ID) < MAX_DRIVERS_NUM, "Driver id out of range");                          \
+    _Static_assert((BUS_ID) < MAX_BUSES_NUM, "Driver bus id out of range");                    \
+                                                                                               \
+    const char BUS_CAT(meteo_driver_id_, ID) = 0;                                              \
+                                                                                               \
+    static const driver_entry_t TAG_NAME##_##INSTANCE##_entry                                  \
+        __attribute__((used, section(DRIVER_DESC_SECTION))) = {                                \
+        .id = (ID),                                                                            \
+        .driver = &TAG_NAME##_##INSTANCE##_driver                                              \
+    };
 
+/*
+ * Initialises all non-lazy drivers. Drivers sharing a bus run in order on one
+ * worker; workers for different buses run concurrently, spread across cores.
+ */
 void init_drivers(void);
 
+/* Initialises a lazy driver on first use. */
 esp_err_t get_driver_by_id(driver_id id, driver_t **driver);
 
+/*
+ * Destructs and initialises the driver again, e.g. after its device lost its
+ * configuration in a reset. Also brings back a driver whose init failed.
+ * If destruct fails, e.g. because the bus could not drain the device's
+ * queue, the driver is left as it was and the error returned.
+ */
+esp_err_t driver_reinit(driver_t *driver);
+
+/*
+ * Zeroed context of the registered type, set as driver->ctx: the driver's
+ * static storage in heap-free builds, calloc() otherwise.
+ */
+void *driver_ctx_alloc(driver_t *driver);
+
+/* Releases driver->ctx and clears it. */
+void driver_ctx_free(driver_t *driver);
+
+#ifdef CONFIG_METEO_INSTR
+/* Counters of one operation since boot; does not initialise lazy drivers. */
+esp_err_t driver_get_instr(driver_id id, driver_op_t op, instr_snapshot_t *out);
+#endif
+
 #endif
@@ -0,0 +1,167 @@
+#include <string.h>
+#include "regmap.h"
+
+static bool regmap_index(const regmap_t *map, uint8_t reg, uint8_t *index)
+{
+    if (reg < map->config->first || reg - map->config->first >= map->config->count)
+        return false;
+
+    *index = reg - map->config->first;
+    return true;
+}
+
+esp_err_t regmap_init(regmap_t *map, const regmap_config_t *config, driver_t *driver, bus_device_handle_t dev)
+{
+    if (!map || !config || !driver || !dev)
+        return ESP_ERR_INVALID_ARG;
+    if (config->count == 0 || config->count > REGMAP_MAX_REGS || config->first + config->count > 0x100)
+        return ESP_ERR_INVALID_SIZE;
+
+    memset(map, 0, sizeof(*map));
+    map->config = config;
+    map->driver = driver;
+    map->dev = dev;
+    return ESP_OK;
+}
+
+void regmap_invalidate(regmap_t *map)
+{
+    map->valid = 0;
+    map->dirty = 0;
+}
+
+esp_err_t regmap_read(regmap_t *map, uint8_t reg, uint8_t *val)
+{
+    uint8_t i;
+    if (!val || !regmap_index(map, reg, &i))
+        return ESP_ERR_INVALID_ARG;
+
+    const uint16_t bit = 1u << i;
+    map->stats.reads++;
+
+    /* A staged value is what the device will hold. */
+    if (!(map->config->volatile_mask & bit) && ((map->valid | map->dirty) & bit)) {
+        map->stats.reads_cached++;
+        *val = map->value[i];
+        return ESP_OK;
+    }
+
+    bus_t *bus = map->driver->bus;
+    esp_err_t err = bus->ops->transfer(map->dev, &reg, 1, val, 1);
+    if (err != ESP_OK || (map->config->volatile_mask & bit))
+        return err;
+
+    map->value[i] = *val;
+    map->valid |= bit;
+    return ESP_OK;
+}
+
+esp_err_t regmap_cached(const regmap_t *map, uint8_t reg, uint8_t *val)
+{
+    uint8_t i;
+    if (!val || !regmap_index(map, reg, &i))
+        return ESP_ERR_INVALID_ARG;
+
+    if (!((map->valid | map->dirty) & (1u << i)) || (map->config->volatile_mask & (1u << i)))
+        return ESP_ERR_INVALID_STATE;
+
+    *val = map->value[i];
+    return ESP_OK;
+}
+
+esp_err_t regmap_write(regmap_t *map, uint8_t reg, uint8_t val)
+{
+    uint8_t i;
+    if (!regmap_index(map, reg, &i))
+        return ESP_ERR_INVALID_ARG;
+
+    const uint16_t bit = 1u << i;
+    map->stats.writes++;
+
+    if (!(map->config->volatile_mask & bit) && ((map->valid | map->dirty) & bit) && map->value[i] == val) {
+        map->stats.writes_skipped++;
+        return ESP_OK;
+    }
+
+    map->value[i] = val;
+    map->dirty |= bit;
+    return ESP_OK;
+}
+
+esp_err_t regmap_update_bits(regmap_t *map, uint8_t reg, uint8_t mask, uint8_t val)
+{
+    uint8_t old = 0;
+    esp_err_t err = regmap_read(map, reg, &old);
+    if (err != ESP_OK)
+        return err;
+
+    return regmap_write(map, reg, (old & ~mask) | (val & mask));
+}
+
+/* Registers [from, to) went out, or may have partly; the shadow follows. */
+static void regmap_settle(regmap_t *map, uint8_t from, uint8_t to, esp_err_t err)
+{
+    for (uint8_t i = from; i < to; ++i) {
+        const uint16_t bit = 1u << i;
+        if (!(map->dirty & bit))
+            continue;
+
+        if (err != ESP_OK) {
+            /* Still staged, but nothing is known about the device any more. */
+            map->valid &= ~bit;
+            continue;
+        }
+
+        map->dirty &= ~bit;
+        if (!(map->config->volatile_mask & bit))
+            map->valid |= bit;
+        map->stats.registers_written++;
+    }
+}
+
+esp_err_t regmap_sync(regmap_t *map)
+{
+    if (!map->dirty)
+        return ESP_OK;
+
+    bus_t *bus = map->driver->bus;
+    const uint8_t count = map->config->count;
+    uint8_t buf[2 * REGMAP_MAX_REGS];
+    size_t len = 0;
+
+    if (map->config->format == REGMAP_WRITE_PAIRS) {
+        for (uint8_t i = 0; i < count; ++i) {
+            if (!(map->dirty & (1u << i)))
+                continue;
+            buf[len++] = map->config->first + i;
+            buf[len++] = map->value[i];
+        }
+
+        map->stats.bursts++;
+        esp_err_t err = bus->ops->write(map->dev, buf, len);
+        regmap_settle(map, 0, count, err);
+        return err;
+    }
+
+    for (uint8_t i = 0; i < count; ) {
+        if (!(map->dirty & (1u << i))) {
+            ++i;
+            continue;
+        }
+
+        uint8_t end = i;
+        len = 0;
+        buf[len++] = map->config->first + i;
+        while (end < count && (map->dirty & (1u << end)))
+            buf[len++] = map->value[end++];
+
+        map->stats.bursts++;
+        esp_err_t err = bus->ops->write(map->dev, buf, len);
+        regmap_settle(map, i, end, err);
+        if (err != ESP_OK)
+            return err;
+        i = end;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,74 @@
+#ifndef _REGMAP_H
+#define _REGMAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "driver.h"
+
+/* Registers one map shadows, in one contiguous address range. */
+#define REGMAP_MAX_REGS 16
+
+/* How regmap_sync() frames the registers it writes. */
+typedef enum {
+    /* (register, value) pairs, any registers in one transaction. */
+    REGMAP_WRITE_PAIRS,
+    /* Register then values of an auto-incrementing run; one transaction per run. */
+    REGMAP_WRITE_BURST,
+} regmap_format_t;
+
+typedef struct {
+    uint8_t first;               /* lowest shadowed register */
+    uint8_t count;               /* registers first .. first + count - 1 */
+    regmap_format_t format;
+    uint16_t volatile_mask;      /* bit n: first + n changes on its own, never cached */
+} regmap_config_t;
+
+/*
+ * Transactions saved against one bus transaction per register access:
+ * writes - writes_skipped - bursts + reads_cached.
+ */
+typedef struct {
+    uint32_t writes;             /* register values staged */
+    uint32_t writes_skipped;     /* staged values the device already held */
+    uint32_t registers_written;
+    uint32_t bursts;             /* bus transactions of regmap_sync() */
+    uint32_t reads;
+    uint32_t reads_cached;       /* reads served from the shadow */
+} regmap_stats_t;
+
+/*
+ * Shadow of a driver's configuration registers. Writes are staged and go out
+ * with regmap_sync(); like the driver itself, a map is not locked.
+ */
+typedef struct {
+    const regmap_config_t *config;
+    driver_t *driver;
+    bus_device_handle_t dev;
+    uint8_t value[REGMAP_MAX_REGS];
+    uint16_t valid;
+    uint16_t dirty;
+    regmap_stats_t stats;
+} regmap_t;
+
+/* Starts with an empty shadow; the first access of a register goes to the device. */
+esp_err_t regmap_init(regmap_t *map, const regmap_config_t *config, driver_t *driver, bus_device_handle_t dev);
+
+/* Forgets the shadow, e.g. after the device was reset behind the driver's back. */
+void regmap_invalidate(regmap_t *map);
+
+esp_err_t regmap_read(regmap_t *map, uint8_t reg, uint8_t *val);
+
+/* Shadowed value without bus access; ESP_ERR_INVALID_STATE if there is none. */
+esp_err_t regmap_cached(const regmap_t *map, uint8_t reg, uint8_t *val);
+
+/* Stages a write; a value the shadow already holds is dropped. */
+esp_err_t regmap_write(regmap_t *map, uint8_t reg, uint8_t val);
+
+/* Read-modify-write of the bits in mask, with the read served from the shadow. */
+esp_err_t regmap_update_bits(regmap_t *map, uint8_t reg, uint8_t mask, uint8_t val);
+
+/* Writes staged registers in ascending address order. */
+esp_err_t regmap_sync(regmap_t *map);
+
+#endif
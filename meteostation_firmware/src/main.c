@@ -1,33 +1,282 @@
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "driver/gpio.h"
 #include "esp_log.h"
+#include "nvs_flash.h"
 #include "sdkconfig.h"
 #include "hw/bus/include/bus.h"
 #include "hw/driver/include/driver.h"
 #include "hw/driver/bme280/bme_280.h"
+#include "acq/acquisition.h"
+#include "acq/feature_pipeline.h"
+#include "nn/forecast.h"
+#include "storage/sample_log.h"
+#include "telemetry/telemetry.h"
+#include "util/clock.h"
+#include "util/instr.h"
+#include "bench/bench.h"
+#include "replay/replay.h"
 static const char *TAG = "example";
 
+#ifdef CONFIG_METEO_LOG
+static sample_log_t history;
+static bool history_open;
+static int64_t history_next_us;
+
+/* Logs one sample per CONFIG_METEO_LOG_PERIOD_S. */
+static void history_add(const acq_sample_t *sample)
+{
+    if (!history_open || sample->timestamp_us < history_next_us)
+        return;
+
+    history_next_us = sample->timestamp_us + (int64_t)CONFIG_METEO_LOG_PERIOD_S * 1000000;
+
+    /* The log outlives this boot, so it keeps wall-clock time. */
+    acq_sample_t entry = *sample;
+    entry.timestamp_us = clock_epoch_us(sample->timestamp_us);
+    esp_err_t err = sample_log_append(&history, &entry);
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "Sample log append failed: %s", esp_err_to_name(err));
+}
+#endif
+
+#ifdef CONFIG_METEO_TELEMETRY
+static void report_batch(const acq_sample_t *span, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        telemetry_send_sample(&span[i]);
+}
+
+static void report_features(const feature_row_t *row)
+{
+    telemetry_send_features(row);
+}
+
+static void report_stats(const acq_stats_t *stats)
+{
+    telemetry_send_stats(stats);
+}
+#else
+static void report_batch(const acq_sample_t *span, size_t n)
+{
+    bme280_data_t avg = { 0 };
+
+    for (size_t i = 0; i < n; i++) {
+        avg.temp += span[i].data.temp;
+        avg.humidity += span[i].data.humidity;
+        avg.pressure += span[i].data.pressure;
+    }
+
+    ESP_LOGI(TAG, "temp: %f", avg.temp / n);
+    ESP_LOGI(TAG, "hum: %f", avg.humidity / n);
+    ESP_LOGI(TAG, "pressure: %f", avg.pressure / n);
+}
+
+static void report_features(const feature_row_t *row)
+{
+    ESP_LOGI(TAG, "features: T %.2f RH %.1f Td %.2f MSL %.2f month %.3f/%.3f, %u samples, fallback 0x%02x",
+        row->v[FEATURE_TEMP], row->v[FEATURE_HUMIDITY], row->v[FEATURE_DEW_POINT],
+        row->v[FEATURE_PRESSURE_MSL], row->v[FEATURE_MONTH_SIN], row->v[FEATURE_MONTH_COS],
+        (unsigned)row->samples, (unsigned)row->fallback);
+}
+
+static void report_stats(const acq_stats_t *stats)
+{
+    ESP_LOGI(TAG, "samples: %u, errors: %u, overruns: %u, high water: %u",
+        (unsigned)stats->samples, (unsigned)stats->read_errors,
+        (unsigned)stats->overruns, (unsigned)stats->high_water);
+}
+#endif
+
+#ifdef CONFIG_METEO_INSTR
+static instr_stat_t forecast_instr;
+static int64_t instr_next_us;
+
+static void report_instr_op(instr_kind_t kind, unsigned id, unsigned op, const instr_snapshot_t *s)
+{
+#ifdef CONFIG_METEO_TELEMETRY
+    telemetry_send_instr(kind, (uint8_t)id, (uint8_t)op, s);
+#else
+    static const char *kinds[] = { "bus", "driver", "forecast" };
+    ESP_LOGI(TAG, "%s %u op %u: %u calls, %u errors, %u retries, %u B, p50 < %u, p99 < %u, max %u cycles",
+        kinds[kind], id, op, (unsigned)s->calls, (unsigned)s->errors, (unsigned)s->retries,
+        (unsigned)s->bytes, (unsigned)instr_percentile(s, 50), (unsigned)instr_percentile(s, 99),
+        (unsigned)s->max_cycles);
+#endif
+}
+
+/* Every CONFIG_METEO_INSTR_EXPORT_S, all operations that have run so far. */
+static void report_instr(void)
+{
+    int64_t now = clock_now_us();
+    if (now < instr_next_us)
+        return;
+    instr_next_us = now + (int64_t)CONFIG_METEO_INSTR_EXPORT_S * 1000000;
+
+    instr_snapshot_t s;
+    for (unsigned id = 0; id < MAX_BUSES_NUM; id++)
+        for (unsigned op = 0; op < BUS_OP_COUNT; op++)
+            if (bus_get_instr(id, op, &s) == ESP_OK && s.calls)
+                report_instr_op(INSTR_BUS, id, op, &s);
+
+    for (unsigned id = 0; id < MAX_DRIVERS_NUM; id++)
+        for (unsigned op = 0; op < DRIVER_OP_COUNT; op++)
+            if (driver_get_instr(id, op, &s) == ESP_OK && s.calls)
+                report_instr_op(INSTR_DRIVER, id, op, &s);
+
+    instr_snapshot(&forecast_instr, &s);
+    if (s.calls)
+        report_instr_op(INSTR_FORECAST, 0, 0, &s);
+}
+#endif
+
+#ifdef CONFIG_METEO_FORECAST
+_Static_assert(FEATURE_COUNT == FORECAST_FEATURES, "Feature rows do not match the model input");
+
+/* Feeds one closed feature row to the streaming forecast. */
+static void forecast_row(const feature_row_t *row)
+{
+    int8_t q[FEATURE_COUNT];
+    float probs[FORECAST_CLASSES];
+
+    features_quantize(row, q);
+    INSTR_BEGIN(start);
+    esp_err_t err = forecast_push(q, probs);
+    INSTR_END(&forecast_instr, start, sizeof(q), err == ESP_ERR_NOT_FINISHED ? ESP_OK : err);
+
+    /* A gap follows this row and breaks the hourly series the model expects. */
+    if (row->skipped)
+        forecast_reset();
+
+    if (err == ESP_ERR_NOT_FINISHED)
+        return;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Forecast failed: %s", esp_err_to_name(err));
+        return;
+    }
+
+#ifdef CONFIG_METEO_TELEMETRY
+    telemetry_send_forecast(probs);
+#else
+    int best = 0;
+    for (int c = 1; c < FORECAST_CLASSES; c++)
+        if (probs[c] > probs[best])
+            best = c;
+    ESP_LOGI(TAG, "forecast: class %d, p %.2f", best, probs[best]);
+#endif
+}
+#endif
+
+static esp_err_t init_nvs(void)
+{
+    esp_err_t err = nvs_flash_init();
+
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+
+    return err;
+}
+
 void app_main(void)
 {
+    esp_err_t nvs_err = init_nvs();
+    if (nvs_err != ESP_OK)
+        ESP_LOGW(TAG, "NVS unavailable, calibration cache disabled: %s", esp_err_to_name(nvs_err));
+
     init_buses();
     init_drivers();
 
+#ifdef CONFIG_METEO_FORECAST
+    esp_err_t nn_err = forecast_init();
+    if (nn_err != ESP_OK)
+        ESP_LOGE(TAG, "Forecast model unavailable: %s", esp_err_to_name(nn_err));
+#endif
+
+#ifdef CONFIG_METEO_BENCH
+    esp_err_t bench_err = bench_run();
+    if (bench_err != ESP_OK)
+        ESP_LOGE(TAG, "Benchmark failed: %s", esp_err_to_name(bench_err));
+#ifdef CONFIG_IDF_TARGET_LINUX
+    exit(bench_err == ESP_OK ? 0 : 1);
+#endif
+    return;
+#endif
+
+#ifdef CONFIG_METEO_REPLAY
+    exit(replay_run());
+#endif
+
+#ifdef CONFIG_METEO_TELEMETRY
+    esp_err_t tm_err = telemetry_init();
+    if (tm_err != ESP_OK)
+        ESP_LOGE(TAG, "Telemetry unavailable: %s", esp_err_to_name(tm_err));
+#endif
+
+    acq_config_t acq_cfg = {
+        .period_ms = CONFIG_METEO_ACQ_PERIOD_MS,
+        .core = CONFIG_METEO_ACQ_CORE,
+        .priority = CONFIG_METEO_ACQ_PRIORITY,
+        .consumer = xTaskGetCurrentTaskHandle(),
+        .notify_every = CONFIG_METEO_ACQ_BATCH,
+    };
+
+    esp_err_t err = acquisition_start(&acq_cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "error: %s", esp_err_to_name(err));
+        return;
+    }
+
+    sample_ring_t *ring = acquisition_ring();
+
+    features_acc_t features;
+    features_init(&features, (int64_t)CONFIG_METEO_FEATURE_PERIOD_S * 1000000, CONFIG_METEO_STATION_ALTITUDE_M);
+
+#ifdef CONFIG_METEO_LOG
+    esp_err_t log_err = sample_log_open(&history, CONFIG_METEO_LOG_PARTITION);
+    if (log_err != ESP_OK)
+        ESP_LOGW(TAG, "Sample log unavailable: %s", esp_err_to_name(log_err));
+    history_open = log_err == ESP_OK;
+#endif
+
     while (1) {
-        bme280_data_t data;
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-        esp_err_t err = bme280_read_data(&data);
+        const acq_sample_t *span;
+        size_t n;
 
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "error: %s", esp_err_to_name(err));
-            break;
-        }
+        while ((n = sample_ring_peek(ring, &span)) > 0) {
+            report_batch(span, n);
 
-        ESP_LOGI(TAG, "temp: %f", data.temp);
-        ESP_LOGI(TAG, "hum: %f", data.humidity);
-        ESP_LOGI(TAG, "pressure: %f", data.pressure);
+            for (size_t i = 0; i < n; i++) {
+#ifdef CONFIG_METEO_LOG
+                history_add(&span[i]);
+#endif
+
+                feature_row_t row;
+                if (features_add(&features, &span[i], &row)) {
+                    report_features(&row);
+                    if (row.skipped)
+                        ESP_LOGW(TAG, "No samples for %u feature periods", (unsigned)row.skipped);
+#ifdef CONFIG_METEO_FORECAST
+                    forecast_row(&row);
+#endif
+#ifdef CONFIG_METEO_LOG
+                    if (history_open && sample_log_flush(&history) != ESP_OK)
+                        ESP_LOGW(TAG, "Sample log flush failed");
+#endif
+                }
+            }
+
+            sample_ring_release(ring, n);
+        }
 
-        vTaskDelay(pdTICKS_TO_MS(100));
+        acq_stats_t stats;
+        acquisition_get_stats(&stats);
+        report_stats(&stats);
+#ifdef CONFIG_METEO_INSTR
+        report_instr();
+#endif
     }
-}
\ No newline at end of file
+}
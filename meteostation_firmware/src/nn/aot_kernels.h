@@ -0,0 +1,274 @@
+#ifndef _AOT_KERNELS_H
+#define _AOT_KERNELS_H
+
+/*
+ * int8 kernels called by the code that meteostation_nn/tflite_to_c.py
+ * generates. The generator passes every shape as a literal, so with the
+ * kernels inlined the loops are fully specialised at compile time.
+ *
+ * The arithmetic follows the TFLite Micro reference kernels step by step
+ * (double rounding requantisation, gemmlowp fixed point softmax), so results
+ * are bit-exact with the interpreter. The input zero point is folded into the
+ * biases by the generator.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define AOT_INLINE static inline __attribute__((always_inline))
+
+AOT_INLINE int32_t aot_rounding_doubling_high_mul(int32_t a, int32_t b)
+{
+    if (a == INT32_MIN && b == INT32_MIN)
+        return INT32_MAX;
+    int64_t ab = (int64_t)a * b;
+    int32_t nudge = ab >= 0 ? (1 << 30) : (1 - (1 << 30));
+    return (int32_t)((ab + nudge) / (1ll << 31));
+}
+
+AOT_INLINE int32_t aot_rounding_divide_by_pot(int32_t x, int exponent)
+{
+    const int32_t mask = (int32_t)((1ll << exponent) - 1);
+    const int32_t remainder = x & mask;
+    const int32_t threshold = (mask >> 1) + (x < 0 ? 1 : 0);
+    return (x >> exponent) + (remainder > threshold ? 1 : 0);
+}
+
+AOT_INLINE int32_t aot_saturating_mul_by_pot(int32_t x, int exponent)
+{
+    if (exponent <= 0)
+        return aot_rounding_divide_by_pot(x, -exponent);
+    const int32_t threshold = (int32_t)((1ll << (31 - exponent)) - 1);
+    if (x > threshold)
+        return INT32_MAX;
+    if (x < -threshold)
+        return INT32_MIN;
+    return (int32_t)((uint32_t)x << exponent);
+}
+
+AOT_INLINE int32_t aot_requantize(int32_t x, int32_t mult, int shift)
+{
+    int left = shift > 0 ? shift : 0;
+    int right = shift > 0 ? 0 : -shift;
+    return aot_rounding_divide_by_pot(aot_rounding_doubling_high_mul((int32_t)((uint32_t)x << left), mult), right);
+}
+
+AOT_INLINE int8_t aot_clamp(int32_t x, int32_t lo, int32_t hi)
+{
+    return (int8_t)(x < lo ? lo : (x > hi ? hi : x));
+}
+
+/*
+ * Convolution over a single row (Conv2D with a 1xK filter) with the fused
+ * activation range [act_min, act_max]. in is [width][cin], filter
+ * [cout][k][cin], out [width][cout]; bias is [width][cout] so edge positions
+ * carry their own folded input offset.
+ */
+AOT_INLINE void aot_conv1d_s8(const int8_t *in, int width, int cin,
+                              const int8_t *filter, int k, int pad,
+                              const int32_t *bias, const int32_t *mult, const int8_t *shift,
+                              int cout, int32_t out_zp, int32_t act_min, int32_t act_max,
+                              int8_t *out)
+{
+    for (int x = 0; x < width; x++) {
+        for (int co = 0; co < cout; co++) {
+            int32_t acc = bias[x * cout + co];
+            for (int t = 0; t < k; t++) {
+                int ix = x + t - pad;
+                if (ix < 0 || ix >= width)
+                    continue;
+                const int8_t *ip = in + ix * cin;
+                const int8_t *fp = filter + (co * k + t) * cin;
+                for (int ci = 0; ci < cin; ci++)
+                    acc += ip[ci] * fp[ci];
+            }
+            acc = aot_requantize(acc, mult[co], shift[co]) + out_zp;
+            out[x * cout + co] = aot_clamp(acc, act_min, act_max);
+        }
+    }
+}
+
+/*
+ * Streaming state of one convolution. For every input column in the window
+ * it keeps the column and its per-tap products; have[] marks which taps are
+ * valid. The columns form a ring that advances by one on every call.
+ */
+typedef struct {
+    int32_t *taps;      /* [width][k][cout] */
+    int8_t *cols;       /* [width][cin] */
+    uint8_t *have;      /* [width] tap bitmask */
+    int head;
+    uint32_t macs;
+} aot_conv_stream_t;
+
+/*
+ * aot_conv1d_s8() for a window that slid by one column since the previous
+ * call. Columns whose contents are unchanged keep their tap products, so only
+ * the new row and the columns next to the padded edges are multiplied again.
+ * The sums are the same integers in a different order, so the output is
+ * identical to a full recomputation whatever the input.
+ */
+AOT_INLINE void aot_conv1d_stream_s8(aot_conv_stream_t *s, const int8_t *in, int width, int cin,
+                                     const int8_t *filter, int k, int pad,
+                                     const int32_t *bias, const int32_t *mult, const int8_t *shift,
+                                     int cout, int32_t out_zp, int32_t act_min, int32_t act_max,
+                                     int8_t *out)
+{
+    s->head = s->head + 1 == width ? 0 : s->head + 1;
+
+    for (int p = 0; p < width; p++) {
+        int slot = (s->head + p) % width;
+        int8_t *col = s->cols + slot * cin;
+        if (memcmp(col, in + p * cin, cin) != 0) {
+            memcpy(col, in + p * cin, cin);
+            s->have[slot] = 0;
+        }
+
+        for (int t = 0; t < k; t++) {
+            int x = p - t + pad;    /* output position that reads this column through tap t */
+            if (x < 0 || x >= width || (s->have[slot] & (1u << t)))
+                continue;
+            int32_t *tp = s->taps + (slot * k + t) * cout;
+            for (int co = 0; co < cout; co++) {
+                const int8_t *fp = filter + (co * k + t) * cin;
+                int32_t acc = 0;
+                for (int ci = 0; ci < cin; ci++)
+                    acc += col[ci] * fp[ci];
+                tp[co] = acc;
+            }
+            s->have[slot] |= 1u << t;
+            s->macs += cin * cout;
+        }
+    }
+
+    for (int x = 0; x < width; x++) {
+        for (int co = 0; co < cout; co++) {
+            int32_t acc = bias[x * cout + co];
+            for (int t = 0; t < k; t++) {
+                int ix = x + t - pad;
+                if (ix < 0 || ix >= width)
+                    continue;
+                acc += s->taps[(((s->head + ix) % width) * k + t) * cout + co];
+            }
+            acc = aot_requantize(acc, mult[co], shift[co]) + out_zp;
+            out[x * cout + co] = aot_clamp(acc, act_min, act_max);
+        }
+    }
+}
+
+/* Mean over the leading axis of [count][channels]; mult already includes 1/count. */
+AOT_INLINE void aot_mean_s8(const int8_t *in, int count, int channels, int32_t in_zp,
+                            int32_t mult, int shift, int32_t out_zp, int8_t *out)
+{
+    for (int c = 0; c < channels; c++) {
+        int32_t sum = 0;
+        for (int i = 0; i < count; i++)
+            sum += in[i * channels + c];
+        sum -= in_zp * count;
+        out[c] = aot_clamp(aot_requantize(sum, mult, shift) + out_zp, -128, 127);
+    }
+}
+
+AOT_INLINE void aot_fully_connected_s8(const int8_t *in, int nin, const int8_t *weights,
+                                       const int32_t *bias, const int32_t *mult, const int8_t *shift,
+                                       int nout, int32_t out_zp, int32_t act_min, int32_t act_max,
+                                       int8_t *out)
+{
+    for (int o = 0; o < nout; o++) {
+        const int8_t *wp = weights + o * nin;
+        int32_t acc = bias[o];
+        for (int i = 0; i < nin; i++)
+            acc += in[i] * wp[i];
+        acc = aot_requantize(acc, mult[o], shift[o]) + out_zp;
+        out[o] = aot_clamp(acc, act_min, act_max);
+    }
+}
+
+/* gemmlowp exp(x) for x in [-1/4, 0), Q0.31 in and out. */
+AOT_INLINE int32_t aot_exp_quarter(int32_t a)
+{
+    const int32_t constant_term = 1895147668;      /* exp(-1/8) */
+    const int32_t constant_1_over_3 = 715827883;
+    int32_t x = a + (1 << 28);
+    int32_t x2 = aot_rounding_doubling_high_mul(x, x);
+    int32_t x3 = aot_rounding_doubling_high_mul(x2, x);
+    int32_t x4 = aot_rounding_doubling_high_mul(x2, x2);
+    int32_t x4_over_4 = aot_rounding_divide_by_pot(x4, 2);
+    int32_t poly = aot_rounding_divide_by_pot(
+        aot_rounding_doubling_high_mul(x4_over_4 + x3, constant_1_over_3) + x2, 1);
+    return constant_term + aot_rounding_doubling_high_mul(constant_term, x + poly);
+}
+
+/* gemmlowp exp_on_negative_values(): Q5.26 in, Q0.31 out. */
+AOT_INLINE int32_t aot_exp_on_negative_values(int32_t a)
+{
+    static const int32_t barrel[] = {
+        1672461947, 1302514674, 790015084, 290630308, 39332535, 720401, 242,
+    };
+    const int32_t one_quarter = 1 << 24;
+    int32_t a_mod_quarter_minus_one_quarter = (a & (one_quarter - 1)) - one_quarter;
+    int32_t result = aot_exp_quarter(aot_saturating_mul_by_pot(a_mod_quarter_minus_one_quarter, 5));
+    int32_t remainder = a_mod_quarter_minus_one_quarter - a;
+
+    for (int e = 0; e < 7; e++) {
+        if (remainder & (1 << (24 + e)))
+            result = aot_rounding_doubling_high_mul(result, barrel[e]);
+    }
+    return a == 0 ? INT32_MAX : result;
+}
+
+/* gemmlowp one_over_one_plus_x_for_x_in_0_1(), Q0.31 in and out. */
+AOT_INLINE int32_t aot_one_over_one_plus_x(int32_t a)
+{
+    int64_t sum = (int64_t)a + INT32_MAX;
+    int32_t half_denominator = (int32_t)((sum + (sum >= 0 ? 1 : -1)) / 2);
+    const int32_t constant_48_over_17 = 1515870810;
+    const int32_t constant_neg_32_over_17 = -1010580540;
+    int32_t x = constant_48_over_17 + aot_rounding_doubling_high_mul(half_denominator, constant_neg_32_over_17);
+
+    for (int i = 0; i < 3; i++) {
+        int32_t half_denominator_times_x = aot_rounding_doubling_high_mul(half_denominator, x);
+        int32_t one_minus = (1 << 29) - half_denominator_times_x;
+        x = x + aot_saturating_mul_by_pot(aot_rounding_doubling_high_mul(x, one_minus), 2);
+    }
+    return aot_saturating_mul_by_pot(x, 1);
+}
+
+/* Softmax to int8 with scale 1/256 and zero point -128; input scaling is precomputed. */
+AOT_INLINE void aot_softmax_s8(const int8_t *in, int n, int32_t mult, int left_shift,
+                               int32_t diff_min, int8_t *out)
+{
+    int8_t max_in = INT8_MIN;
+    for (int i = 0; i < n; i++)
+        max_in = in[i] > max_in ? in[i] : max_in;
+
+    /* Sum of exponentials in Q12.19. */
+    int32_t sum_of_exps = 0;
+    for (int i = 0; i < n; i++) {
+        int32_t diff = in[i] - max_in;
+        if (diff >= diff_min) {
+            int32_t scaled = aot_rounding_doubling_high_mul(diff * (1 << left_shift), mult);
+            sum_of_exps += aot_rounding_divide_by_pot(aot_exp_on_negative_values(scaled), 12);
+        }
+    }
+
+    int headroom_plus_one = __builtin_clz((uint32_t)sum_of_exps);
+    int num_bits_over_unit = 12 - headroom_plus_one;
+    int32_t shifted_sum_minus_one = (int32_t)(((uint32_t)sum_of_exps << headroom_plus_one) - (1u << 31));
+    int32_t shifted_scale = aot_one_over_one_plus_x(shifted_sum_minus_one);
+
+    for (int i = 0; i < n; i++) {
+        int32_t diff = in[i] - max_in;
+        if (diff >= diff_min) {
+            int32_t scaled = aot_rounding_doubling_high_mul(diff * (1 << left_shift), mult);
+            int32_t exp_in_0 = aot_exp_on_negative_values(scaled);
+            int32_t unsat = aot_rounding_divide_by_pot(aot_rounding_doubling_high_mul(shifted_scale, exp_in_0),
+                                                       num_bits_over_unit + 31 - 8);
+            out[i] = aot_clamp(unsat - 128, -128, 127);
+        } else {
+            out[i] = INT8_MIN;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_FORECAST
+
+#include <math.h>
+#include <string.h>
+#include <esp_log.h>
+#include "forecast.h"
+#include "forecast_tflm.h"
+#include "forecast_model.h"
+
+static const char *TAG = "FORECAST";
+
+_Static_assert(FORECAST_MODEL_INPUT_LEN == FORECAST_WINDOW * FORECAST_FEATURES, "Model input does not match the feature window");
+_Static_assert(FORECAST_MODEL_OUTPUT_LEN == FORECAST_CLASSES, "Model output does not match the class list");
+
+/* Quantized rows pushed with forecast_push(), oldest first. */
+static int8_t stream_window[FORECAST_WINDOW * FORECAST_FEATURES];
+static int stream_rows;
+
+static void quantize_row(const float *row, int8_t *q_row)
+{
+    for (int f = 0; f < FORECAST_FEATURES; f++) {
+        int32_t q = (int32_t)lroundf(row[f] / FORECAST_MODEL_INPUT_SCALE) + FORECAST_MODEL_INPUT_ZP;
+        q = q < -128 ? -128 : (q > 127 ? 127 : q);
+        q_row[f] = (int8_t)q;
+    }
+}
+
+static void dequantize_output(const int8_t *q_out, float *probs)
+{
+    for (int c = 0; c < FORECAST_CLASSES; c++)
+        probs[c] = (q_out[c] - FORECAST_MODEL_OUTPUT_ZP) * FORECAST_MODEL_OUTPUT_SCALE;
+}
+
+esp_err_t forecast_init(void)
+{
+#ifdef CONFIG_METEO_FORECAST_ENGINE_TFLM
+    return forecast_tflm_init();
+#else
+    ESP_LOGI(TAG, "Generated model ready, %d bytes of constants, %d bytes scratch",
+        FORECAST_MODEL_CONST_BYTES, FORECAST_MODEL_SCRATCH_BYTES);
+    return ESP_OK;
+#endif
+}
+
+esp_err_t forecast_predict_q(const int8_t *in, int8_t *out)
+{
+#ifdef CONFIG_METEO_FORECAST_ENGINE_TFLM
+    return forecast_tflm_predict_q(in, out);
+#else
+    forecast_model_invoke(in, out);
+    return ESP_OK;
+#endif
+}
+
+esp_err_t forecast_predict(const float window[FORECAST_WINDOW][FORECAST_FEATURES], float probs[FORECAST_CLASSES])
+{
+    int8_t q_in[FORECAST_WINDOW * FORECAST_FEATURES];
+    int8_t q_out[FORECAST_CLASSES];
+
+    for (int t = 0; t < FORECAST_WINDOW; t++)
+        quantize_row(window[t], q_in + t * FORECAST_FEATURES);
+
+    esp_err_t err = forecast_predict_q(q_in, q_out);
+    if (err != ESP_OK)
+        return err;
+
+    dequantize_output(q_out, probs);
+    return ESP_OK;
+}
+
+esp_err_t forecast_push(const int8_t row[FORECAST_FEATURES], float probs[FORECAST_CLASSES])
+{
+    int8_t q_out[FORECAST_CLASSES];
+
+    memmove(stream_window, stream_window + FORECAST_FEATURES, sizeof(stream_window) - FORECAST_FEATURES);
+    memcpy(stream_window + sizeof(stream_window) - FORECAST_FEATURES, row, FORECAST_FEATURES);
+
+    if (stream_rows < FORECAST_WINDOW)
+        stream_rows++;
+    if (stream_rows < FORECAST_WINDOW)
+        return ESP_ERR_NOT_FINISHED;
+
+#ifdef CONFIG_METEO_FORECAST_ENGINE_TFLM
+    esp_err_t err = forecast_tflm_predict_q(stream_window, q_out);
+    if (err != ESP_OK)
+        return err;
+#else
+    forecast_model_invoke_stream(stream_window, q_out);
+#endif
+
+    dequantize_output(q_out, probs);
+    return ESP_OK;
+}
+
+void forecast_reset(void)
+{
+    stream_rows = 0;
+}
+
+size_t forecast_arena_used(void)
+{
+#ifdef CONFIG_METEO_FORECAST_ENGINE_TFLM
+    return forecast_tflm_arena_used();
+#else
+    return FORECAST_MODEL_SCRATCH_BYTES;
+#endif
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef _FORECAST_H
+#define _FORECAST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FORECAST_WINDOW   4
+#define FORECAST_FEATURES 8
+#define FORECAST_CLASSES  6
+
+typedef enum {
+    FORECAST_CLEAR,
+    FORECAST_FOG,
+    FORECAST_DRIZZLE,
+    FORECAST_RAIN,
+    FORECAST_SNOW,
+    FORECAST_OTHER,
+} forecast_class_t;
+
+/*
+ * Prepares the selected inference engine: the C code generated from the model
+ * at build time, or TensorFlow Lite Micro. No heap is used either way.
+ */
+esp_err_t forecast_init(void);
+
+/*
+ * window holds FORECAST_WINDOW hourly rows of min-max scaled features, oldest
+ * first, in training column order. probs receives the class probabilities.
+ */
+esp_err_t forecast_predict(const float window[FORECAST_WINDOW][FORECAST_FEATURES], float probs[FORECAST_CLASSES]);
+
+/*
+ * Streaming form for hourly use: push one quantized row (features_quantize())
+ * per call, the oldest row drops out. Until FORECAST_WINDOW rows have been
+ * pushed it returns ESP_ERR_NOT_FINISHED; after that probs holds the forecast
+ * for the last FORECAST_WINDOW rows, while the generated engine only
+ * recomputes what the new row changed.
+ */
+esp_err_t forecast_push(const int8_t row[FORECAST_FEATURES], float probs[FORECAST_CLASSES]);
+
+/*
+ * Drops the pushed rows. At a gap in the hourly series, call it after pushing
+ * the last row before the gap: that row still ends a valid window.
+ */
+void forecast_reset(void);
+
+/* Same on the model's int8 input/output tensors, for bit-exact comparisons. Not reentrant. */
+esp_err_t forecast_predict_q(const int8_t *in, int8_t *out);
+
+/* Working memory of the engine: the planned tensor arena, or the generated scratch buffers. */
+size_t forecast_arena_used(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,107 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_FORECAST_TFLM
+
+#include <new>
+#include <string.h>
+#include <esp_log.h>
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "forecast.h"
+#include "forecast_tflm.h"
+
+#define FORECAST_ARENA_SIZE CONFIG_METEO_FORECAST_ARENA_SIZE
+#define FORECAST_OPS        6
+
+static const char *TAG = "FORECAST_TFLM";
+
+/* Embedded by EMBED_FILES in CMakeLists.txt. */
+extern const uint8_t model_start[] asm("_binary_weather_forecast_conv1d_esp32s3_tflite_start");
+
+namespace {
+
+using op_resolver_t = tflite::MicroMutableOpResolver<FORECAST_OPS>;
+
+alignas(16) uint8_t tensor_arena[FORECAST_ARENA_SIZE];
+alignas(op_resolver_t) uint8_t resolver_storage[sizeof(op_resolver_t)];
+alignas(tflite::MicroInterpreter) uint8_t interpreter_storage[sizeof(tflite::MicroInterpreter)];
+
+tflite::MicroInterpreter *interpreter = nullptr;
+TfLiteTensor *input = nullptr;
+TfLiteTensor *output = nullptr;
+
+bool register_ops(op_resolver_t *resolver)
+{
+    return resolver->AddExpandDims() == kTfLiteOk &&
+           resolver->AddConv2D() == kTfLiteOk &&
+           resolver->AddReshape() == kTfLiteOk &&
+           resolver->AddMean() == kTfLiteOk &&
+           resolver->AddFullyConnected() == kTfLiteOk &&
+           resolver->AddSoftmax() == kTfLiteOk;
+}
+
+}
+
+esp_err_t forecast_tflm_init(void)
+{
+    if (interpreter)
+        return ESP_OK;
+
+    const tflite::Model *model = tflite::GetModel(model_start);
+    if (model->version() != TFLITE_SCHEMA_VERSION) {
+        ESP_LOGE(TAG, "Model schema %u, expected %d", (unsigned)model->version(), TFLITE_SCHEMA_VERSION);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    op_resolver_t *resolver = new (resolver_storage) op_resolver_t();
+    if (!register_ops(resolver))
+        return ESP_FAIL;
+
+    tflite::MicroInterpreter *interp =
+        new (interpreter_storage) tflite::MicroInterpreter(model, *resolver, tensor_arena, FORECAST_ARENA_SIZE);
+
+    if (interp->AllocateTensors() != kTfLiteOk) {
+        ESP_LOGE(TAG, "Tensor arena of %d bytes is too small", FORECAST_ARENA_SIZE);
+        interp->~MicroInterpreter();
+        return ESP_ERR_NO_MEM;
+    }
+
+    TfLiteTensor *in = interp->input(0);
+    TfLiteTensor *out = interp->output(0);
+    if (in->type != kTfLiteInt8 || in->bytes != FORECAST_WINDOW * FORECAST_FEATURES ||
+        out->type != kTfLiteInt8 || out->bytes != FORECAST_CLASSES) {
+        ESP_LOGE(TAG, "Unexpected model signature");
+        interp->~MicroInterpreter();
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    interpreter = interp;
+    input = in;
+    output = out;
+
+    ESP_LOGI(TAG, "Model ready, arena %u of %d bytes used",
+        (unsigned)interpreter->arena_used_bytes(), FORECAST_ARENA_SIZE);
+    return ESP_OK;
+}
+
+esp_err_t forecast_tflm_predict_q(const int8_t *in, int8_t *out)
+{
+    if (!interpreter)
+        return ESP_ERR_INVALID_STATE;
+
+    memcpy(input->data.int8, in, FORECAST_WINDOW * FORECAST_FEATURES);
+
+    if (interpreter->Invoke() != kTfLiteOk)
+        return ESP_FAIL;
+
+    memcpy(out, output->data.int8, FORECAST_CLASSES);
+    return ESP_OK;
+}
+
+size_t forecast_tflm_arena_used(void)
+{
+    return interpreter ? interpreter->arena_used_bytes() : 0;
+}
+
+#endif
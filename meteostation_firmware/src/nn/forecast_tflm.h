@@ -0,0 +1,25 @@
+#ifndef _FORECAST_TFLM_H
+#define _FORECAST_TFLM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * TensorFlow Lite Micro backend of forecast.h. It is the inference engine
+ * when METEO_FORECAST_ENGINE_TFLM is selected, and otherwise only built as
+ * the reference the generated kernels are checked against.
+ */
+esp_err_t forecast_tflm_init(void);
+esp_err_t forecast_tflm_predict_q(const int8_t *in, int8_t *out);
+size_t forecast_tflm_arena_used(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,446 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_REPLAY
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <esp_log.h>
+#include "replay.h"
+#include "../hw/bus/sim_bme280.h"
+#include "../hw/driver/bme280/bme_280.h"
+#include "../acq/acquisition.h"
+#include "../acq/feature_pipeline.h"
+#include "../nn/forecast.h"
+#include "../util/clock.h"
+
+#define HOUR_US     3600000000LL
+#define NO_LABEL    -1
+#define MAX_COLUMNS 16
+
+static const char *TAG = "REPLAY";
+
+static const char *class_names[FORECAST_CLASSES] = { "clear", "fog", "drizzle", "rain", "snow", "other" };
+
+typedef struct {
+    int64_t timestamp_us;
+    bme280_data_t data;     /* pressure at station level */
+    float cloud_cover;
+    float precipitation;
+    int8_t label;           /* forecast_class_t of this hour */
+    uint8_t month;          /* 0 when unknown */
+} replay_row_t;
+
+typedef struct {
+    int time;
+    int temp;
+    int humidity;
+    int code;
+    int pressure;
+    int cloud_cover;
+    int precipitation;
+} csv_columns_t;
+
+typedef enum {
+    STAGE_ENCODE,
+    STAGE_SENSOR,
+    STAGE_FEATURES,
+    STAGE_QUANTIZE,
+    STAGE_FORECAST,
+    STAGE_COUNT,
+} replay_stage_id_t;
+
+typedef struct {
+    const char *name;
+    uint32_t calls;
+    uint64_t ns;
+} replay_stage_t;
+
+static replay_stage_t stages[STAGE_COUNT] = {
+    [STAGE_ENCODE] = { "sim_encode" },
+    [STAGE_SENSOR] = { "acquisition_sample" },
+    [STAGE_FEATURES] = { "features_add" },
+    [STAGE_QUANTIZE] = { "features_quantize" },
+    [STAGE_FORECAST] = { "forecast_push" },
+};
+
+static uint32_t confusion[FORECAST_CLASSES][FORECAST_CLASSES];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void stage_add(replay_stage_id_t id, uint64_t start)
+{
+    stages[id].ns += now_ns() - start;
+    stages[id].calls++;
+}
+
+/* WMO code groups of load_forecast_data(); any other code is FORECAST_OTHER. */
+static int8_t wmo_group(int code)
+{
+    switch (code) {
+    case 0: case 1: case 2: case 3:
+        return FORECAST_CLEAR;
+    case 45: case 48:
+        return FORECAST_FOG;
+    case 51: case 53: case 55: case 56: case 57:
+        return FORECAST_DRIZZLE;
+    case 61: case 63: case 65: case 80: case 81: case 82:
+        return FORECAST_RAIN;
+    case 66: case 67: case 71: case 73: case 75: case 77: case 85: case 86:
+        return FORECAST_SNOW;
+    default:
+        return FORECAST_OTHER;
+    }
+}
+
+/* Splits in place; empty fields stay as empty strings. */
+static int split_fields(char *line, char *fields[MAX_COLUMNS])
+{
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    while (n < MAX_COLUMNS) {
+        fields[n++] = line;
+        char *comma = strchr(line, ',');
+        if (!comma)
+            break;
+        *comma = '\0';
+        line = comma + 1;
+    }
+    return n;
+}
+
+static bool find_columns(char *header, csv_columns_t *col)
+{
+    char *fields[MAX_COLUMNS];
+    int n = split_fields(header, fields);
+
+    memset(col, -1, sizeof(*col));
+    for (int i = 0; i < n; i++) {
+        if (strcmp(fields[i], "time") == 0)
+            col->time = i;
+        else if (strncmp(fields[i], "temperature_2m", 14) == 0)
+            col->temp = i;
+        else if (strncmp(fields[i], "relative_humidity_2m", 20) == 0)
+            col->humidity = i;
+        else if (strncmp(fields[i], "weather_code", 12) == 0)
+            col->code = i;
+        else if (strncmp(fields[i], "pressure_msl", 12) == 0)
+            col->pressure = i;
+        else if (strncmp(fields[i], "cloud_cover", 11) == 0)
+            col->cloud_cover = i;
+        else if (strncmp(fields[i], "precipitation", 13) == 0)
+            col->precipitation = i;
+    }
+
+    return col->time >= 0 && col->temp >= 0 && col->humidity >= 0 && col->pressure >= 0;
+}
+
+static const char *field(char *fields[], int n, int col)
+{
+    return col >= 0 && col < n ? fields[col] : "";
+}
+
+/* Rows without temperature, humidity or pressure are left out and become gaps. */
+static size_t load_csv(const char *path, replay_row_t **out)
+{
+    char line[512];
+    char *fields[MAX_COLUMNS];
+    csv_columns_t col;
+
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+
+    if (!fgets(line, sizeof(line), f) || !find_columns(line, &col)) {
+        ESP_LOGE(TAG, "%s lacks time, temperature, humidity or pressure columns", path);
+        fclose(f);
+        return 0;
+    }
+
+    replay_row_t *rows = NULL;
+    size_t n = 0, cap = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        int count = split_fields(line, fields);
+        const char *temp = field(fields, count, col.temp);
+        const char *humidity = field(fields, count, col.humidity);
+        const char *pressure = field(fields, count, col.pressure);
+        const char *code = field(fields, count, col.code);
+        const char *cloud = field(fields, count, col.cloud_cover);
+        const char *precip = field(fields, count, col.precipitation);
+
+        int y, mo, d, h, mi;
+        if (sscanf(field(fields, count, col.time), "%d-%d-%dT%d:%d", &y, &mo, &d, &h, &mi) != 5)
+            continue;
+        if (!*temp || !*humidity || !*pressure)
+            continue;
+
+        if (n == cap) {
+            cap = cap ? cap * 2 : 4096;
+            replay_row_t *grown = realloc(rows, cap * sizeof(*rows));
+            if (!grown)
+                break;
+            rows = grown;
+        }
+
+        replay_row_t *r = &rows[n++];
+        r->timestamp_us = ((clock_days_from_civil(y, mo, d) * 24 + h) * 60 + mi) * 60 * 1000000LL;
+        r->month = (uint8_t)mo;
+        r->data.temp = strtof(temp, NULL);
+        r->data.humidity = strtof(humidity, NULL);
+        /* The dataset is at sea level; features_pressure_msl() scales linearly. */
+        r->data.pressure = strtof(pressure, NULL) /
+            features_pressure_msl(1.0f, r->data.temp, CONFIG_METEO_STATION_ALTITUDE_M);
+        r->cloud_cover = *cloud ? strtof(cloud, NULL) : FEATURE_FALLBACK_CLOUD_COVER;
+        r->precipitation = *precip ? strtof(precip, NULL) : FEATURE_FALLBACK_PRECIPITATION;
+        r->label = *code ? wmo_group(atoi(code)) : NO_LABEL;
+    }
+
+    fclose(f);
+    *out = rows;
+    return n;
+}
+
+/* A raw trace carries neither time nor labels: one sample per acquisition period. */
+static size_t load_trace(const char *path, replay_row_t **out)
+{
+    if (sim_bme280_load_trace_file(path) != ESP_OK)
+        return 0;
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 0;
+    fseek(f, 0, SEEK_END);
+    size_t n = (size_t)ftell(f) / SIM_BME280_SAMPLE_LEN;
+    fclose(f);
+
+    replay_row_t *rows = calloc(n, sizeof(*rows));
+    if (!rows)
+        return 0;
+
+    for (size_t i = 0; i < n; i++) {
+        rows[i].timestamp_us = (int64_t)i * CONFIG_METEO_ACQ_PERIOD_MS * 1000;
+        rows[i].label = NO_LABEL;
+    }
+
+    *out = rows;
+    return n;
+}
+
+/* The simulated sensor serves the rows in order; the buffer stays with the bus. */
+static esp_err_t encode_rows(const replay_row_t *rows, size_t n)
+{
+    uint8_t (*trace)[SIM_BME280_SAMPLE_LEN] = malloc(n * SIM_BME280_SAMPLE_LEN);
+    if (!trace)
+        return ESP_ERR_NO_MEM;
+
+    for (size_t i = 0; i < n; i++) {
+        uint64_t start = now_ns();
+        sim_bme280_encode_sample(&rows[i].data, trace[i]);
+        stage_add(STAGE_ENCODE, start);
+    }
+
+    sim_bme280_set_trace((const uint8_t (*)[SIM_BME280_SAMPLE_LEN])trace, n);
+    return ESP_OK;
+}
+
+/* The device takes the month from its wall clock; here the dataset is the clock. */
+static void apply_dataset(const replay_row_t *last, feature_row_t *row)
+{
+    if (last->month) {
+        features_month(last->month, &row->v[FEATURE_MONTH_SIN], &row->v[FEATURE_MONTH_COS]);
+        row->fallback &= ~((1u << FEATURE_MONTH_SIN) | (1u << FEATURE_MONTH_COS));
+    }
+#ifdef CONFIG_METEO_REPLAY_DATASET_FEATURES
+    row->v[FEATURE_CLOUD_COVER] = last->cloud_cover;
+    row->v[FEATURE_PRECIPITATION] = last->precipitation;
+    row->fallback &= ~((1u << FEATURE_CLOUD_COVER) | (1u << FEATURE_PRECIPITATION));
+#endif
+}
+
+#ifdef CONFIG_METEO_FORECAST
+/* Mirrors forecast_row() in main.c; the forecast is scored against the next hour. */
+static void forecast_step(const feature_row_t *row, int8_t label)
+{
+    int8_t q[FEATURE_COUNT];
+    float probs[FORECAST_CLASSES];
+
+    uint64_t start = now_ns();
+    features_quantize(row, q);
+    stage_add(STAGE_QUANTIZE, start);
+
+    start = now_ns();
+    esp_err_t err = forecast_push(q, probs);
+    stage_add(STAGE_FORECAST, start);
+
+    if (err == ESP_OK && !row->skipped && label != NO_LABEL) {
+        int best = 0;
+        for (int c = 1; c < FORECAST_CLASSES; c++)
+            if (probs[c] > probs[best])
+                best = c;
+        confusion[label][best]++;
+    }
+
+    if (row->skipped)
+        forecast_reset();
+}
+
+static double report_accuracy(void)
+{
+    uint32_t total = 0, correct = 0;
+    uint32_t predicted[FORECAST_CLASSES] = { 0 };
+
+    for (int t = 0; t < FORECAST_CLASSES; t++) {
+        for (int p = 0; p < FORECAST_CLASSES; p++) {
+            total += confusion[t][p];
+            predicted[p] += confusion[t][p];
+        }
+        correct += confusion[t][t];
+    }
+
+    double accuracy = total ? 100.0 * correct / total : 0.0;
+    printf("forecast: %u scored windows, accuracy %.2f %%\n", (unsigned)total, accuracy);
+
+    printf("%-10s %8s %8s %8s   predicted:", "class", "count", "recall", "prec");
+    for (int p = 0; p < FORECAST_CLASSES; p++)
+        printf(" %7s", class_names[p]);
+    printf("\n");
+
+    for (int t = 0; t < FORECAST_CLASSES; t++) {
+        uint32_t count = 0;
+        for (int p = 0; p < FORECAST_CLASSES; p++)
+            count += confusion[t][p];
+
+        printf("%-10s %8u %7.1f%% %7.1f%%             ", class_names[t], (unsigned)count,
+            count ? 100.0 * confusion[t][t] / count : 0.0,
+            predicted[t] ? 100.0 * confusion[t][t] / predicted[t] : 0.0);
+        for (int p = 0; p < FORECAST_CLASSES; p++)
+            printf(" %7u", (unsigned)confusion[t][p]);
+        printf("\n");
+    }
+
+    return accuracy;
+}
+#endif
+
+static float track(float worst, float got, float want)
+{
+    float d = fabsf(got - want);
+    return d > worst ? d : worst;
+}
+
+int replay_run(void)
+{
+    const char *trace_path = CONFIG_METEO_REPLAY_TRACE;
+    bool from_trace = trace_path[0] != '\0';
+    const char *source = from_trace ? trace_path : CONFIG_METEO_REPLAY_CSV;
+
+    replay_row_t *rows = NULL;
+    size_t n = from_trace ? load_trace(trace_path, &rows) : load_csv(CONFIG_METEO_REPLAY_CSV, &rows);
+    if (n < 2) {
+        printf("replay input %s not found or empty\n", source);
+        free(rows);
+        return 1;
+    }
+
+    if (!from_trace && encode_rows(rows, n) != ESP_OK) {
+        free(rows);
+        return 1;
+    }
+
+    /* The dataset is hourly whatever the device's feature period is. */
+    features_acc_t acc;
+    features_init(&acc, from_trace ? (int64_t)CONFIG_METEO_FEATURE_PERIOD_S * 1000000 : HOUR_US,
+                  CONFIG_METEO_STATION_ALTITUDE_M);
+
+    uint32_t feature_rows = 0, gaps = 0, read_errors = 0;
+    float err_temp = 0, err_humidity = 0, err_pressure = 0;
+
+    uint64_t wall = now_ns();
+    for (size_t i = 0; i < n; i++) {
+        acq_sample_t sample;
+        uint32_t failed = 0;
+
+        /* The round the acquisition task runs: all instances, submitted, median. */
+        uint64_t start = now_ns();
+        esp_err_t err = acquisition_sample(&sample, &failed);
+        stage_add(STAGE_SENSOR, start);
+        read_errors += failed;
+        if (err != ESP_OK)
+            continue;
+
+        /* The dataset is the clock. */
+        sample.timestamp_us = rows[i].timestamp_us;
+
+        if (!from_trace) {
+            err_temp = track(err_temp, sample.data.temp, rows[i].data.temp);
+            err_humidity = track(err_humidity, sample.data.humidity, rows[i].data.humidity);
+            err_pressure = track(err_pressure, sample.data.pressure, rows[i].data.pressure);
+        }
+
+        feature_row_t row;
+        start = now_ns();
+        bool closed = features_add(&acc, &sample, &row);
+        stage_add(STAGE_FEATURES, start);
+        if (!closed)
+            continue;
+
+        /* With one sample per period, the previous row closed this one. */
+        feature_rows++;
+        gaps += row.skipped != 0;
+        if (!from_trace)
+            apply_dataset(&rows[i - 1], &row);
+
+#ifdef CONFIG_METEO_FORECAST
+        forecast_step(&row, rows[i].label);
+#endif
+    }
+    wall = now_ns() - wall;
+
+    printf("replay: %u samples from %s, %u feature rows, %u gaps, %u read errors\n",
+        (unsigned)n, source, (unsigned)feature_rows, (unsigned)gaps, (unsigned)read_errors);
+
+    printf("%-20s %10s %12s %10s\n", "stage", "calls", "ns/call", "ms");
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        if (!stages[s].calls)
+            continue;
+        printf("%-20s %10u %12.1f %10.1f\n", stages[s].name, (unsigned)stages[s].calls,
+            (double)stages[s].ns / stages[s].calls, stages[s].ns / 1e6);
+    }
+    double rate = n / (wall / 1e9);
+    printf("pipeline: %.0f samples/s, %.1f ms\n", rate, wall / 1e6);
+
+    if (!from_trace)
+        printf("sensor round trip: max |d| temp %.4f degC, hum %.4f %%RH, press %.4f hPa\n",
+            err_temp, err_humidity, err_pressure);
+
+    int status = read_errors ? 1 : 0;
+
+    if (rate < CONFIG_METEO_REPLAY_MIN_RATE) {
+        printf("throughput below the %d samples/s gate\n", CONFIG_METEO_REPLAY_MIN_RATE);
+        status = 1;
+    }
+
+#ifdef CONFIG_METEO_FORECAST
+    if (!from_trace) {
+        double accuracy = report_accuracy();
+        if (accuracy < CONFIG_METEO_REPLAY_MIN_ACCURACY) {
+            printf("accuracy below the %d %% gate\n", CONFIG_METEO_REPLAY_MIN_ACCURACY);
+            status = 1;
+        }
+    }
+#endif
+
+    free(rows);
+    return status;
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+/*
+ * Host-only regression run: a dataset goes through the simulated sensor, the
+ * BME280 driver, feature aggregation, quantization and the forecast as fast
+ * as the machine allows. Prints time per stage and forecast accuracy against
+ * the WMO groups of load_forecast_data() in meteostation_nn/main.py.
+ * Buses and drivers must be initialized.
+ *
+ * Returns the process exit status: 1 if the input cannot be read or the
+ * accuracy is below CONFIG_METEO_REPLAY_MIN_ACCURACY, else 0.
+ */
+int replay_run(void);
+
+#endif
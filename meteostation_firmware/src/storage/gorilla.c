@@ -0,0 +1,223 @@
+#include <string.h>
+#include "gorilla.h"
+
+/* No previous run of meaningful bits yet. */
+#define NO_WINDOW 0xFF
+
+typedef struct {
+    uint8_t prefix;
+    uint8_t prefix_bits;
+    uint8_t value_bits;
+} dod_bucket_t;
+
+/* Delta-of-delta buckets, tried in order; the last one takes anything. */
+static const dod_bucket_t dod_buckets[] = {
+    { 0x2, 2, 7 },
+    { 0x6, 3, 9 },
+    { 0xE, 4, 12 },
+    { 0x1E, 5, 32 },
+    { 0x1F, 5, 64 },
+};
+
+#define DOD_BUCKETS (sizeof(dod_buckets) / sizeof(dod_buckets[0]))
+
+static void sample_bits(const acq_sample_t *sample, uint32_t v[GORILLA_VALUES])
+{
+    memcpy(&v[0], &sample->data.temp, sizeof(v[0]));
+    memcpy(&v[1], &sample->data.pressure, sizeof(v[1]));
+    memcpy(&v[2], &sample->data.humidity, sizeof(v[2]));
+}
+
+static void sample_from_bits(const uint32_t v[GORILLA_VALUES], acq_sample_t *sample)
+{
+    memcpy(&sample->data.temp, &v[0], sizeof(v[0]));
+    memcpy(&sample->data.pressure, &v[1], sizeof(v[1]));
+    memcpy(&sample->data.humidity, &v[2], sizeof(v[2]));
+}
+
+/* MSB first; the buffer was cleared by gorilla_enc_init(). */
+static void put_bits(gorilla_enc_t *enc, uint64_t v, int n)
+{
+    while (n > 0) {
+        int room = 8 - (int)(enc->bits & 7);
+        int take = n < room ? n : room;
+        uint8_t chunk = (uint8_t)((v >> (n - take)) & ((1u << take) - 1));
+
+        enc->buf[enc->bits >> 3] |= (uint8_t)(chunk << (room - take));
+        enc->bits += take;
+        n -= take;
+    }
+}
+
+static uint64_t get_bits(gorilla_dec_t *dec, int n)
+{
+    uint64_t v = 0;
+
+    while (n > 0) {
+        int room = 8 - (int)(dec->bits & 7);
+        int take = n < room ? n : room;
+        /* Past the end reads as zeros; gorilla_dec_next() then fails. */
+        uint8_t byte = dec->bits < dec->len_bits ? dec->buf[dec->bits >> 3] : 0;
+
+        v = (v << take) | ((byte >> (room - take)) & ((1u << take) - 1));
+        dec->bits += take;
+        n -= take;
+    }
+
+    return v;
+}
+
+static bool fits(int64_t v, int bits)
+{
+    if (bits >= 64)
+        return true;
+    int64_t lim = (int64_t)1 << (bits - 1);
+    return v >= -lim && v < lim;
+}
+
+static int64_t sign_extend(uint64_t v, int bits)
+{
+    if (bits >= 64)
+        return (int64_t)v;
+    uint64_t sign = 1ull << (bits - 1);
+    return (int64_t)((v ^ sign) - sign);
+}
+
+void gorilla_enc_init(gorilla_enc_t *enc, uint8_t *buf, size_t len)
+{
+    memset(enc, 0, sizeof(*enc));
+    memset(buf, 0, len);
+    enc->buf = buf;
+    enc->cap_bits = len * 8;
+    memset(enc->lead, NO_WINDOW, sizeof(enc->lead));
+}
+
+bool gorilla_enc_add(gorilla_enc_t *enc, const acq_sample_t *sample)
+{
+    uint32_t v[GORILLA_VALUES];
+    sample_bits(sample, v);
+
+    if (enc->count == 0) {
+        enc->first = *sample;
+        enc->prev_us = sample->timestamp_us;
+        memcpy(enc->prev, v, sizeof(v));
+        enc->count = 1;
+        return true;
+    }
+
+    if (enc->bits + GORILLA_MAX_SAMPLE_BITS > enc->cap_bits)
+        return false;
+
+    int64_t delta = sample->timestamp_us - enc->prev_us;
+    int64_t dod = delta - enc->prev_delta;
+
+    if (dod == 0) {
+        put_bits(enc, 0, 1);
+    } else {
+        for (size_t b = 0; b < DOD_BUCKETS; b++) {
+            if (fits(dod, dod_buckets[b].value_bits)) {
+                put_bits(enc, dod_buckets[b].prefix, dod_buckets[b].prefix_bits);
+                put_bits(enc, (uint64_t)dod, dod_buckets[b].value_bits);
+                break;
+            }
+        }
+    }
+    enc->prev_us = sample->timestamp_us;
+    enc->prev_delta = delta;
+
+    for (int i = 0; i < GORILLA_VALUES; i++) {
+        uint32_t x = v[i] ^ enc->prev[i];
+        enc->prev[i] = v[i];
+
+        if (x == 0) {
+            put_bits(enc, 0, 1);
+            continue;
+        }
+
+        int lead = __builtin_clz(x);
+        int trail = __builtin_ctz(x);
+
+        if (enc->lead[i] != NO_WINDOW && lead >= enc->lead[i] && trail >= enc->trail[i]) {
+            put_bits(enc, 0x2, 2);
+            put_bits(enc, x >> enc->trail[i], 32 - enc->lead[i] - enc->trail[i]);
+        } else {
+            int sig = 32 - lead - trail;
+            put_bits(enc, 0x3, 2);
+            put_bits(enc, (uint64_t)lead, 5);
+            put_bits(enc, (uint64_t)(sig - 1), 5);
+            put_bits(enc, x >> trail, sig);
+            enc->lead[i] = (uint8_t)lead;
+            enc->trail[i] = (uint8_t)trail;
+        }
+    }
+
+    enc->count++;
+    return true;
+}
+
+size_t gorilla_enc_bytes(const gorilla_enc_t *enc)
+{
+    return (enc->bits + 7) / 8;
+}
+
+void gorilla_dec_init(gorilla_dec_t *dec, const acq_sample_t *first, const uint8_t *buf, size_t len, uint32_t count)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->buf = buf;
+    dec->len_bits = len * 8;
+    dec->count = count;
+    dec->first = *first;
+    memset(dec->lead, NO_WINDOW, sizeof(dec->lead));
+}
+
+bool gorilla_dec_next(gorilla_dec_t *dec, acq_sample_t *sample)
+{
+    if (dec->index >= dec->count)
+        return false;
+
+    if (dec->index == 0) {
+        *sample = dec->first;
+        dec->prev_us = sample->timestamp_us;
+        sample_bits(sample, dec->prev);
+        dec->index = 1;
+        return true;
+    }
+
+    int64_t dod = 0;
+    if (get_bits(dec, 1)) {
+        size_t b = 0;
+        while (b < DOD_BUCKETS - 1 && get_bits(dec, 1))
+            b++;
+        dod = sign_extend(get_bits(dec, dod_buckets[b].value_bits), dod_buckets[b].value_bits);
+    }
+    dec->prev_delta += dod;
+    dec->prev_us += dec->prev_delta;
+    sample->timestamp_us = dec->prev_us;
+
+    for (int i = 0; i < GORILLA_VALUES; i++) {
+        if (!get_bits(dec, 1))
+            continue;
+
+        uint32_t x;
+        if (!get_bits(dec, 1)) {
+            if (dec->lead[i] == NO_WINDOW)
+                return false;
+            int sig = 32 - dec->lead[i] - dec->trail[i];
+            x = (uint32_t)get_bits(dec, sig) << dec->trail[i];
+        } else {
+            int lead = (int)get_bits(dec, 5);
+            int sig = (int)get_bits(dec, 5) + 1;
+            int trail = 32 - lead - sig;
+            if (trail < 0)
+                return false;
+            x = (uint32_t)get_bits(dec, sig) << trail;
+            dec->lead[i] = (uint8_t)lead;
+            dec->trail[i] = (uint8_t)trail;
+        }
+        dec->prev[i] ^= x;
+    }
+    sample_from_bits(dec->prev, sample);
+
+    dec->index++;
+    return dec->bits <= dec->len_bits;
+}
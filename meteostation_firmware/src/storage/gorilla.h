@@ -0,0 +1,63 @@
+#ifndef _GORILLA_H
+#define _GORILLA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "../acq/sample_ring.h"
+
+#define GORILLA_VALUES 3
+
+/* Worst case for one sample: 64-bit timestamp escape plus three raw values. */
+#define GORILLA_MAX_SAMPLE_BITS (5 + 64 + GORILLA_VALUES * (2 + 5 + 5 + 32))
+
+/*
+ * Gorilla-style stream of samples (Pelkonen et al., VLDB 2015): timestamps
+ * as delta-of-delta with variable-width buckets, each float as the XOR with
+ * its previous value, reusing the previous run of meaningful bits when the
+ * new one fits inside it. The first sample is kept raw in `first` and is not
+ * part of the bit stream.
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t cap_bits;
+    size_t bits;
+    uint32_t count;
+    acq_sample_t first;
+    int64_t prev_us;
+    int64_t prev_delta;
+    uint32_t prev[GORILLA_VALUES];
+    uint8_t lead[GORILLA_VALUES];
+    uint8_t trail[GORILLA_VALUES];
+} gorilla_enc_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len_bits;
+    size_t bits;
+    uint32_t count;
+    uint32_t index;
+    acq_sample_t first;
+    int64_t prev_us;
+    int64_t prev_delta;
+    uint32_t prev[GORILLA_VALUES];
+    uint8_t lead[GORILLA_VALUES];
+    uint8_t trail[GORILLA_VALUES];
+} gorilla_dec_t;
+
+/* Starts an empty stream in buf, which is cleared. */
+void gorilla_enc_init(gorilla_enc_t *enc, uint8_t *buf, size_t len);
+
+/* Returns false, leaving the stream untouched, if the sample might not fit. */
+bool gorilla_enc_add(gorilla_enc_t *enc, const acq_sample_t *sample);
+
+/* Bytes of buf holding the stream. */
+size_t gorilla_enc_bytes(const gorilla_enc_t *enc);
+
+/* count includes the first sample. */
+void gorilla_dec_init(gorilla_dec_t *dec, const acq_sample_t *first, const uint8_t *buf, size_t len, uint32_t count);
+
+/* Returns false after the last sample or on a stream that runs past len. */
+bool gorilla_dec_next(gorilla_dec_t *dec, acq_sample_t *sample);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef _LOG_FLASH_H
+#define _LOG_FLASH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sdkconfig.h>
+#include <esp_err.h>
+
+#ifndef CONFIG_IDF_TARGET_LINUX
+#include <esp_partition.h>
+#endif
+
+#define LOG_FLASH_SECTOR_SIZE 4096
+
+/*
+ * Raw storage under the sample log: a data partition on the device, a file
+ * of the same layout on the linux target. The file keeps NOR semantics, so
+ * writes can only clear bits and erased sectors read back as 0xFF.
+ */
+typedef struct {
+#ifdef CONFIG_IDF_TARGET_LINUX
+    FILE *file;
+#else
+    const esp_partition_t *part;
+#endif
+    size_t size;
+} log_flash_t;
+
+/* name is the partition label; on the linux target "<name>.bin" is used. */
+esp_err_t log_flash_open(log_flash_t *flash, const char *name);
+void log_flash_close(log_flash_t *flash);
+
+esp_err_t log_flash_read(log_flash_t *flash, size_t offset, void *dst, size_t len);
+esp_err_t log_flash_write(log_flash_t *flash, size_t offset, const void *src, size_t len);
+esp_err_t log_flash_erase_sector(log_flash_t *flash, size_t offset);
+
+#endif
@@ -0,0 +1,107 @@
+#include <sdkconfig.h>
+
+#if defined(CONFIG_METEO_LOG) && defined(CONFIG_IDF_TARGET_LINUX)
+
+#include <string.h>
+#include <esp_log.h>
+#include "log_flash.h"
+
+static const char *TAG = "LOG_FLASH";
+
+static esp_err_t file_read(FILE *f, size_t offset, void *dst, size_t len)
+{
+    if (fseek(f, (long)offset, SEEK_SET) != 0 || fread(dst, 1, len, f) != len)
+        return ESP_FAIL;
+    return ESP_OK;
+}
+
+static esp_err_t file_write(FILE *f, size_t offset, const void *src, size_t len)
+{
+    /* Flushed right away, so a killed process leaves what flash would hold. */
+    if (fseek(f, (long)offset, SEEK_SET) != 0 || fwrite(src, 1, len, f) != len || fflush(f) != 0)
+        return ESP_FAIL;
+    return ESP_OK;
+}
+
+esp_err_t log_flash_open(log_flash_t *flash, const char *name)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s.bin", name);
+
+    flash->size = (size_t)CONFIG_METEO_LOG_HOST_SIZE_KB * 1024;
+    flash->file = fopen(path, "r+b");
+    if (!flash->file)
+        flash->file = fopen(path, "w+b");
+    if (!flash->file) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* A new or shorter file is extended with erased sectors. */
+    fseek(flash->file, 0, SEEK_END);
+    long len = ftell(flash->file);
+    uint8_t erased[LOG_FLASH_SECTOR_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+    for (size_t off = len < 0 ? 0 : (size_t)len / LOG_FLASH_SECTOR_SIZE * LOG_FLASH_SECTOR_SIZE; off < flash->size; off += LOG_FLASH_SECTOR_SIZE) {
+        if (file_write(flash->file, off, erased, sizeof(erased)) != ESP_OK) {
+            log_flash_close(flash);
+            return ESP_FAIL;
+        }
+    }
+
+    return ESP_OK;
+}
+
+void log_flash_close(log_flash_t *flash)
+{
+    if (flash->file)
+        fclose(flash->file);
+    flash->file = NULL;
+}
+
+esp_err_t log_flash_read(log_flash_t *flash, size_t offset, void *dst, size_t len)
+{
+    if (offset + len > flash->size)
+        return ESP_ERR_INVALID_SIZE;
+    return file_read(flash->file, offset, dst, len);
+}
+
+esp_err_t log_flash_write(log_flash_t *flash, size_t offset, const void *src, size_t len)
+{
+    uint8_t cur[256];
+    const uint8_t *p = src;
+
+    if (offset + len > flash->size)
+        return ESP_ERR_INVALID_SIZE;
+
+    /* Programming clears bits only, as on NOR flash. */
+    while (len > 0) {
+        size_t n = len < sizeof(cur) ? len : sizeof(cur);
+        esp_err_t err = file_read(flash->file, offset, cur, n);
+        if (err != ESP_OK)
+            return err;
+        for (size_t i = 0; i < n; i++)
+            cur[i] &= p[i];
+        err = file_write(flash->file, offset, cur, n);
+        if (err != ESP_OK)
+            return err;
+        offset += n;
+        p += n;
+        len -= n;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t log_flash_erase_sector(log_flash_t *flash, size_t offset)
+{
+    uint8_t erased[LOG_FLASH_SECTOR_SIZE];
+
+    if (offset % LOG_FLASH_SECTOR_SIZE != 0 || offset >= flash->size)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(erased, 0xFF, sizeof(erased));
+    return file_write(flash->file, offset, erased, sizeof(erased));
+}
+
+#endif
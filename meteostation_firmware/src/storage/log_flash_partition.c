@@ -0,0 +1,42 @@
+#include <sdkconfig.h>
+
+#if defined(CONFIG_METEO_LOG) && !defined(CONFIG_IDF_TARGET_LINUX)
+
+#include <esp_log.h>
+#include "log_flash.h"
+
+static const char *TAG = "LOG_FLASH";
+
+esp_err_t log_flash_open(log_flash_t *flash, const char *name)
+{
+    flash->part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, name);
+    if (!flash->part) {
+        ESP_LOGE(TAG, "Partition \"%s\" not found", name);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    flash->size = flash->part->size - flash->part->size % LOG_FLASH_SECTOR_SIZE;
+    return ESP_OK;
+}
+
+void log_flash_close(log_flash_t *flash)
+{
+    flash->part = NULL;
+}
+
+esp_err_t log_flash_read(log_flash_t *flash, size_t offset, void *dst, size_t len)
+{
+    return esp_partition_read(flash->part, offset, dst, len);
+}
+
+esp_err_t log_flash_write(log_flash_t *flash, size_t offset, const void *src, size_t len)
+{
+    return esp_partition_write(flash->part, offset, src, len);
+}
+
+esp_err_t log_flash_erase_sector(log_flash_t *flash, size_t offset)
+{
+    return esp_partition_erase_range(flash->part, offset, LOG_FLASH_SECTOR_SIZE);
+}
+
+#endif
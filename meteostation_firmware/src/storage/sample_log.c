@@ -0,0 +1,323 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_LOG
+
+#include <stddef.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include "sample_log.h"
+#include "../util/clock.h"
+
+#define SEGMENT_MAGIC       0x474F4C53  /* "SLOG" */
+#define ERASED_MAGIC        0xFFFFFFFF
+/* The wall clock was set when the segment's samples were appended. */
+#define SEGMENT_WALL_CLOCK  0x00000001
+/* A sector with less room than this left is closed. */
+#define MIN_SEGMENT_PAYLOAD 64
+
+static const char *TAG = "SAMPLE_LOG";
+
+typedef struct {
+    uint32_t magic;
+    /* Over the rest of the header and the payload. */
+    uint32_t crc;
+    uint32_t seq;
+    uint16_t count;
+    uint16_t len;
+    int64_t first_us;
+    bme280_data_t first;
+    uint32_t flags;
+} segment_header_t;
+
+_Static_assert(sizeof(segment_header_t) == SAMPLE_LOG_HEADER_SIZE, "Segment header size changed");
+
+static uint32_t segment_crc(const segment_header_t *hdr, const uint8_t *payload)
+{
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&hdr->seq, sizeof(*hdr) - offsetof(segment_header_t, seq));
+    return esp_rom_crc32_le(crc, payload, hdr->len);
+}
+
+static size_t sector_base(const sample_log_t *log, uint32_t sector)
+{
+    return (size_t)sector * LOG_FLASH_SECTOR_SIZE;
+}
+
+/* ESP_ERR_NOT_FOUND on erased flash, ESP_ERR_INVALID_CRC on anything else that is not a segment. */
+static esp_err_t read_segment(sample_log_t *log, uint32_t sector, uint32_t offset, segment_header_t *hdr, uint8_t *payload)
+{
+    size_t base = sector_base(log, sector) + offset;
+    esp_err_t err = log_flash_read(&log->flash, base, hdr, sizeof(*hdr));
+    if (err != ESP_OK)
+        return err;
+
+    if (hdr->magic == ERASED_MAGIC)
+        return ESP_ERR_NOT_FOUND;
+    if (hdr->magic != SEGMENT_MAGIC || hdr->count == 0 || hdr->len > LOG_FLASH_SECTOR_SIZE - offset - sizeof(*hdr))
+        return ESP_ERR_INVALID_CRC;
+
+    err = log_flash_read(&log->flash, base + sizeof(*hdr), payload, hdr->len);
+    if (err != ESP_OK)
+        return err;
+
+    return segment_crc(hdr, payload) == hdr->crc ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+/* Opens the RAM segment at the write position, moving to the next sector when this one is full. */
+static void start_segment(sample_log_t *log)
+{
+    if (LOG_FLASH_SECTOR_SIZE - log->head_offset < SAMPLE_LOG_HEADER_SIZE + MIN_SEGMENT_PAYLOAD) {
+        log->head = (log->head + 1) % log->sectors;
+        log->head_offset = 0;
+    }
+
+    gorilla_enc_init(&log->enc, log->payload, LOG_FLASH_SECTOR_SIZE - log->head_offset - SAMPLE_LOG_HEADER_SIZE);
+}
+
+/* Finds the oldest and newest sectors and the end of the newest one. */
+static esp_err_t mount(sample_log_t *log)
+{
+    segment_header_t hdr;
+    bool found = false;
+    uint32_t head_seq = 0, tail_seq = 0;
+
+    for (uint32_t s = 0; s < log->sectors; s++) {
+        esp_err_t err = read_segment(log, s, 0, &hdr, log->payload);
+        if (err == ESP_ERR_NOT_FOUND || err == ESP_ERR_INVALID_CRC)
+            continue;
+        if (err != ESP_OK)
+            return err;
+
+        if (!found || hdr.seq > head_seq) {
+            head_seq = hdr.seq;
+            log->head = s;
+        }
+        if (!found || hdr.seq < tail_seq) {
+            tail_seq = hdr.seq;
+            log->tail = s;
+        }
+        found = true;
+    }
+
+    if (!found) {
+        log->head = log->tail = 0;
+        log->head_offset = 0;
+        log->used = 0;
+        log->seq = 1;
+        return ESP_OK;
+    }
+
+    log->used = (log->head + log->sectors - log->tail) % log->sectors + 1;
+    log->seq = head_seq + 1;
+
+    uint32_t offset = 0;
+    while (offset + SAMPLE_LOG_HEADER_SIZE <= LOG_FLASH_SECTOR_SIZE) {
+        esp_err_t err = read_segment(log, log->head, offset, &hdr, log->payload);
+        if (err == ESP_ERR_NOT_FOUND)
+            break;
+        if (err != ESP_OK) {
+            /* A torn write: nothing more goes into this sector. */
+            ESP_LOGW(TAG, "Damaged segment in sector %u at %u", (unsigned)log->head, (unsigned)offset);
+            offset = LOG_FLASH_SECTOR_SIZE;
+            break;
+        }
+        log->seq = hdr.seq + 1;
+        offset += SAMPLE_LOG_HEADER_SIZE + hdr.len;
+    }
+    log->head_offset = offset;
+
+    return ESP_OK;
+}
+
+esp_err_t sample_log_open(sample_log_t *log, const char *name)
+{
+    memset(log, 0, offsetof(sample_log_t, enc));
+
+    esp_err_t err = log_flash_open(&log->flash, name);
+    if (err != ESP_OK)
+        return err;
+
+    log->sectors = log->flash.size / LOG_FLASH_SECTOR_SIZE;
+    if (log->sectors < 2) {
+        ESP_LOGE(TAG, "Partition \"%s\" needs at least two sectors", name);
+        log_flash_close(&log->flash);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    err = mount(log);
+    if (err != ESP_OK) {
+        log_flash_close(&log->flash);
+        return err;
+    }
+
+    start_segment(log);
+
+    ESP_LOGI(TAG, "%u of %u sectors in use, next segment %u", (unsigned)log->used,
+        (unsigned)log->sectors, (unsigned)log->seq);
+    return ESP_OK;
+}
+
+esp_err_t sample_log_close(sample_log_t *log)
+{
+    esp_err_t err = sample_log_flush(log);
+    log_flash_close(&log->flash);
+    return err;
+}
+
+esp_err_t sample_log_flush(sample_log_t *log)
+{
+    if (log->enc.count == 0)
+        return ESP_OK;
+
+    segment_header_t hdr = {
+        .magic = SEGMENT_MAGIC,
+        .seq = log->seq,
+        .count = (uint16_t)log->enc.count,
+        .len = (uint16_t)((gorilla_enc_bytes(&log->enc) + 3) & ~3u),
+        .first_us = log->enc.first.timestamp_us,
+        .first = log->enc.first.data,
+        .flags = log->wall_clock ? SEGMENT_WALL_CLOCK : 0,
+    };
+    hdr.crc = segment_crc(&hdr, log->payload);
+
+    size_t base = sector_base(log, log->head);
+    esp_err_t err = ESP_OK;
+
+    if (log->head_offset == 0) {
+        err = log_flash_erase_sector(&log->flash, base);
+        if (err == ESP_OK) {
+            log->erases++;
+            if (log->used == 0) {
+                log->tail = log->head;
+                log->used = 1;
+            } else if (log->used == log->sectors) {
+                log->tail = (log->head + 1) % log->sectors;
+            } else {
+                log->used++;
+            }
+        }
+    }
+
+    /* Header first: a payload without one would read as free space. */
+    if (err == ESP_OK)
+        err = log_flash_write(&log->flash, base + log->head_offset, &hdr, sizeof(hdr));
+    if (err == ESP_OK)
+        err = log_flash_write(&log->flash, base + log->head_offset + sizeof(hdr), log->payload, hdr.len);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Segment %u lost: %s", (unsigned)log->seq, esp_err_to_name(err));
+        log->head_offset = LOG_FLASH_SECTOR_SIZE;
+    } else {
+        log->head_offset += sizeof(hdr) + hdr.len;
+        log->segments++;
+        log->bytes_written += sizeof(hdr) + hdr.len;
+    }
+
+    log->seq++;
+    start_segment(log);
+    return err;
+}
+
+esp_err_t sample_log_append(sample_log_t *log, const acq_sample_t *sample)
+{
+    bool wall_clock = clock_wall_set();
+
+    /* Setting the clock closes the segment, so its flag holds for every sample. */
+    if (log->enc.count && wall_clock != log->wall_clock) {
+        esp_err_t err = sample_log_flush(log);
+        if (err != ESP_OK)
+            return err;
+    }
+
+    if (!gorilla_enc_add(&log->enc, sample)) {
+        esp_err_t err = sample_log_flush(log);
+        if (err != ESP_OK)
+            return err;
+        gorilla_enc_add(&log->enc, sample);
+    }
+
+    if (log->enc.count == 1)
+        log->wall_clock = wall_clock;
+
+    log->samples++;
+    return ESP_OK;
+}
+
+esp_err_t sample_log_format(sample_log_t *log)
+{
+    for (uint32_t s = 0; s < log->sectors; s++) {
+        esp_err_t err = log_flash_erase_sector(&log->flash, sector_base(log, s));
+        if (err != ESP_OK)
+            return err;
+        log->erases++;
+    }
+
+    log->head = log->tail = 0;
+    log->head_offset = 0;
+    log->used = 0;
+    log->seq = 1;
+    start_segment(log);
+    return ESP_OK;
+}
+
+void sample_log_get_stats(const sample_log_t *log, sample_log_stats_t *stats)
+{
+    stats->sectors = log->sectors;
+    stats->used_sectors = log->used;
+    stats->samples = log->samples;
+    stats->segments = log->segments;
+    stats->erases = log->erases;
+    stats->bytes_written = log->bytes_written;
+    stats->pending = log->enc.count;
+}
+
+void sample_log_iter_begin(sample_log_t *log, sample_log_iter_t *it)
+{
+    it->log = log;
+    it->sector = log->tail;
+    it->remaining = log->used;
+    it->offset = 0;
+    it->wall_clock = false;
+    memset(&it->dec, 0, sizeof(it->dec));
+}
+
+/* Loads the next valid segment, skipping damaged ones and the rest of their sector. */
+static esp_err_t next_segment(sample_log_iter_t *it)
+{
+    sample_log_t *log = it->log;
+    segment_header_t hdr;
+
+    while (it->remaining > 0) {
+        if (it->offset + SAMPLE_LOG_HEADER_SIZE <= LOG_FLASH_SECTOR_SIZE) {
+            esp_err_t err = read_segment(log, it->sector, it->offset, &hdr, it->payload);
+            if (err == ESP_OK) {
+                acq_sample_t first = { .timestamp_us = hdr.first_us, .data = hdr.first };
+                gorilla_dec_init(&it->dec, &first, it->payload, hdr.len, hdr.count);
+                it->wall_clock = hdr.flags & SEGMENT_WALL_CLOCK;
+                it->offset += SAMPLE_LOG_HEADER_SIZE + hdr.len;
+                return ESP_OK;
+            }
+            if (err != ESP_ERR_NOT_FOUND && err != ESP_ERR_INVALID_CRC)
+                return err;
+        }
+
+        it->sector = (it->sector + 1) % log->sectors;
+        it->offset = 0;
+        it->remaining--;
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t sample_log_iter_next(sample_log_iter_t *it, acq_sample_t *sample)
+{
+    while (!gorilla_dec_next(&it->dec, sample)) {
+        esp_err_t err = next_segment(it);
+        if (err != ESP_OK)
+            return err;
+    }
+
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef _SAMPLE_LOG_H
+#define _SAMPLE_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "../acq/sample_ring.h"
+#include "gorilla.h"
+#include "log_flash.h"
+
+#define SAMPLE_LOG_HEADER_SIZE  40
+#define SAMPLE_LOG_PAYLOAD_MAX  (LOG_FLASH_SECTOR_SIZE - SAMPLE_LOG_HEADER_SIZE)
+
+/*
+ * Compressed sample history in a ring of flash sectors. Samples are encoded
+ * into a RAM segment (gorilla.h) that is written on sample_log_flush() or
+ * when it fills; several segments share a sector, each with its own header
+ * and CRC. Sectors are used strictly in turn and only erased right before
+ * reuse, so every sector sees the same number of erase cycles and the
+ * oldest sector is the one given up when the ring is full.
+ *
+ * Timestamps are microseconds since the Unix epoch (clock_epoch_us()), so
+ * they stay meaningful across resets. A segment never mixes samples
+ * appended before and after the wall clock was set; the earlier ones count
+ * from power-on instead and their segments are not marked.
+ *
+ * Not thread safe: one task appends, flushes and iterates.
+ */
+typedef struct {
+    log_flash_t flash;
+    uint32_t sectors;
+    uint32_t head;
+    uint32_t head_offset;
+    uint32_t tail;
+    uint32_t used;
+    uint32_t seq;
+
+    uint32_t samples;
+    uint32_t segments;
+    uint32_t erases;
+    uint64_t bytes_written;
+
+    gorilla_enc_t enc;
+    /* clock_wall_set() when the RAM segment's first sample was added. */
+    bool wall_clock;
+    uint8_t payload[SAMPLE_LOG_PAYLOAD_MAX];
+} sample_log_t;
+
+typedef struct {
+    uint32_t sectors;
+    uint32_t used_sectors;
+    /* Since sample_log_open(). */
+    uint32_t samples;
+    uint32_t segments;
+    uint32_t erases;
+    uint64_t bytes_written;
+    /* Appended but not yet on flash. */
+    uint32_t pending;
+} sample_log_stats_t;
+
+/* Streaming reader, oldest sample first. Holds one segment, so keep it static. */
+typedef struct {
+    sample_log_t *log;
+    uint32_t sector;
+    uint32_t remaining;
+    uint32_t offset;
+    /* The last sample was appended with the wall clock set. */
+    bool wall_clock;
+    gorilla_dec_t dec;
+    uint8_t payload[SAMPLE_LOG_PAYLOAD_MAX];
+} sample_log_iter_t;
+
+/* Opens the partition (see log_flash_open()) and finds the newest segment. */
+esp_err_t sample_log_open(sample_log_t *log, const char *name);
+
+/* Flushes pending samples. */
+esp_err_t sample_log_close(sample_log_t *log);
+
+esp_err_t sample_log_append(sample_log_t *log, const acq_sample_t *sample);
+
+/* Writes the pending samples as a segment; they are lost on reset until then. */
+esp_err_t sample_log_flush(sample_log_t *log);
+
+/* Erases every sector and drops pending samples. */
+esp_err_t sample_log_format(sample_log_t *log);
+
+void sample_log_get_stats(const sample_log_t *log, sample_log_stats_t *stats);
+
+/* Iterates the flushed samples; the log must not be appended to meanwhile. */
+void sample_log_iter_begin(sample_log_t *log, sample_log_iter_t *it);
+
+/* ESP_ERR_NOT_FOUND after the last sample. */
+esp_err_t sample_log_iter_next(sample_log_iter_t *it, acq_sample_t *sample);
+
+#endif
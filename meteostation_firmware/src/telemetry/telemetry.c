@@ -0,0 +1,194 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_TELEMETRY
+
+#include <stdio.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include "telemetry.h"
+
+#ifndef CONFIG_IDF_TARGET_LINUX
+#include <driver/uart.h>
+#endif
+
+#define TELEMETRY_UART       CONFIG_ESP_CONSOLE_UART_NUM
+#define TELEMETRY_TX_BUFFER  2048
+#define TELEMETRY_RX_BUFFER  256
+#define HEADER_LEN           4
+#define CRC_LEN              4
+#define MAX_RECORD           128
+#define MAX_FRAME            (HEADER_LEN + MAX_RECORD + CRC_LEN)
+/* COBS adds one byte per 254, plus the two delimiters. */
+#define MAX_ENCODED          (MAX_FRAME + MAX_FRAME / 254 + 1 + 2)
+
+_Static_assert(sizeof(telemetry_features_t) <= MAX_RECORD, "Features record too long");
+_Static_assert(sizeof(telemetry_forecast_t) <= MAX_RECORD, "Forecast record too long");
+_Static_assert(sizeof(telemetry_instr_t) <= MAX_RECORD, "Instrumentation record too long");
+
+static const char *TAG = "TELEMETRY";
+
+static uint16_t seq;
+static uint32_t dropped;
+#ifndef CONFIG_IDF_TARGET_LINUX
+static size_t tx_buffer;    /* TX ring size; 0 if writes wait for the FIFO */
+#endif
+static uint8_t frame[MAX_FRAME];
+static uint8_t encoded[MAX_ENCODED];
+
+/* Consistent overhead byte stuffing: no 0x00 in the output. Returns the encoded length. */
+static size_t cobs_encode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+    size_t code_pos = 0;
+    size_t out = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+            continue;
+        }
+        dst[out++] = src[i];
+        if (++code == 0xFF) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+        }
+    }
+    dst[code_pos] = code;
+
+    return out;
+}
+
+static esp_err_t transport_write(const uint8_t *data, size_t len)
+{
+#ifdef CONFIG_IDF_TARGET_LINUX
+    if (fwrite(data, 1, len, stdout) != len)
+        return ESP_FAIL;
+    fflush(stdout);
+    return ESP_OK;
+#else
+    /* A frame that does not fit is dropped whole rather than stalling the sender. */
+    size_t room;
+    if (tx_buffer && (uart_get_tx_buffer_free_size(TELEMETRY_UART, &room) != ESP_OK || room < len))
+        return ESP_ERR_NO_MEM;
+    return uart_write_bytes(TELEMETRY_UART, data, len) == (int)len ? ESP_OK : ESP_FAIL;
+#endif
+}
+
+esp_err_t telemetry_init(void)
+{
+#ifndef CONFIG_IDF_TARGET_LINUX
+    /* Raw driver writes: the console VFS would expand every 0x0A. */
+    if (!uart_is_driver_installed(TELEMETRY_UART)) {
+        esp_err_t err = uart_driver_install(TELEMETRY_UART, TELEMETRY_RX_BUFFER, TELEMETRY_TX_BUFFER, 0, NULL, 0);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "UART%d driver: %s", TELEMETRY_UART, esp_err_to_name(err));
+            return err;
+        }
+    }
+    /* Nothing is queued yet, so the free space is the whole TX ring. */
+    if (uart_get_tx_buffer_free_size(TELEMETRY_UART, &tx_buffer) != ESP_OK)
+        tx_buffer = 0;
+    if (!tx_buffer)
+        ESP_LOGW(TAG, "UART%d has no TX buffer, frames wait for the FIFO instead of dropping", TELEMETRY_UART);
+#endif
+    seq = 0;
+    dropped = 0;
+    ESP_LOGI(TAG, "Binary telemetry v%d, text between frames is ignored by the decoder", TELEMETRY_VERSION);
+    return ESP_OK;
+}
+
+esp_err_t telemetry_send(telemetry_type_t type, const void *record, size_t len)
+{
+    if (len > MAX_RECORD)
+        return ESP_ERR_INVALID_SIZE;
+
+    frame[0] = (uint8_t)type;
+    frame[1] = TELEMETRY_VERSION;
+    frame[2] = (uint8_t)seq;
+    frame[3] = (uint8_t)(seq >> 8);
+    memcpy(frame + HEADER_LEN, record, len);
+
+    uint32_t crc = esp_rom_crc32_le(0, frame, HEADER_LEN + len);
+    memcpy(frame + HEADER_LEN + len, &crc, CRC_LEN);
+
+    encoded[0] = 0;
+    size_t n = 1 + cobs_encode(frame, HEADER_LEN + len + CRC_LEN, encoded + 1);
+    encoded[n++] = 0;
+
+    /* The sequence number advances even for lost frames, so the receiver sees the gap. */
+    seq++;
+    esp_err_t err = transport_write(encoded, n);
+    if (err != ESP_OK)
+        dropped++;
+    return err;
+}
+
+esp_err_t telemetry_send_sample(const acq_sample_t *sample)
+{
+    telemetry_sample_t rec = {
+        .timestamp_us = sample->timestamp_us,
+        .temp = sample->data.temp,
+        .pressure = sample->data.pressure,
+        .humidity = sample->data.humidity,
+    };
+    return telemetry_send(TELEMETRY_SAMPLE, &rec, sizeof(rec));
+}
+
+esp_err_t telemetry_send_features(const feature_row_t *row)
+{
+    telemetry_features_t rec = {
+        .samples = row->samples,
+        .fallback = row->fallback,
+        .skipped = row->skipped,
+    };
+    memcpy(rec.v, row->v, sizeof(rec.v));
+    return telemetry_send(TELEMETRY_FEATURES, &rec, sizeof(rec));
+}
+
+esp_err_t telemetry_send_forecast(const float probs[FORECAST_CLASSES])
+{
+    telemetry_forecast_t rec = { 0 };
+
+    for (int c = 0; c < FORECAST_CLASSES; c++) {
+        rec.probs[c] = probs[c];
+        if (probs[c] > probs[rec.best])
+            rec.best = (uint8_t)c;
+    }
+    return telemetry_send(TELEMETRY_FORECAST, &rec, sizeof(rec));
+}
+
+esp_err_t telemetry_send_stats(const acq_stats_t *stats)
+{
+    telemetry_stats_t rec = {
+        .samples = stats->samples,
+        .read_errors = stats->read_errors,
+        .overruns = stats->overruns,
+        .high_water = stats->high_water,
+        .dropped = dropped,
+    };
+    return telemetry_send(TELEMETRY_STATS, &rec, sizeof(rec));
+}
+
+esp_err_t telemetry_send_instr(instr_kind_t kind, uint8_t id, uint8_t op, const instr_snapshot_t *snap)
+{
+    telemetry_instr_t rec = {
+        .kind = (uint8_t)kind,
+        .id = id,
+        .op = op,
+        .cycles_per_us = INSTR_CYCLES_PER_US,
+        .calls = snap->calls,
+        .errors = snap->errors,
+        .retries = snap->retries,
+        .bytes = snap->bytes,
+        .cycles = snap->cycles,
+        .max_cycles = snap->max_cycles,
+    };
+    memcpy(rec.hist, snap->hist, sizeof(rec.hist));
+    return telemetry_send(TELEMETRY_INSTR, &rec, sizeof(rec));
+}
+
+#endif
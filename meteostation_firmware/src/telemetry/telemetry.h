@@ -0,0 +1,90 @@
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include "../acq/acquisition.h"
+#include "../acq/feature_pipeline.h"
+#include "../nn/forecast.h"
+#include "../util/instr.h"
+
+/*
+ * Binary telemetry on the console UART (stdout on the linux target). Each
+ * frame is COBS encoded between two 0x00 delimiters, so text that lands in
+ * between is dropped by the receiver as one bad frame:
+ *
+ *   type u8 | version u8 | seq u16 | record | crc32 (zlib) over all before
+ *
+ * All fields are little endian. meteostation_nn/telemetry_decode.py turns a
+ * capture into CSV; its record layouts must follow the structs below.
+ */
+#define TELEMETRY_VERSION 1
+
+typedef enum {
+    TELEMETRY_SAMPLE = 1,
+    TELEMETRY_FEATURES = 2,
+    TELEMETRY_FORECAST = 3,
+    TELEMETRY_STATS = 4,
+    TELEMETRY_INSTR = 5,
+} telemetry_type_t;
+
+typedef struct __attribute__((packed)) {
+    int64_t timestamp_us;
+    float temp;
+    float pressure;
+    float humidity;
+} telemetry_sample_t;
+
+typedef struct __attribute__((packed)) {
+    float v[FEATURE_COUNT];
+    uint32_t samples;
+    uint32_t fallback;
+    uint32_t skipped;
+} telemetry_features_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t best;
+    float probs[FORECAST_CLASSES];
+} telemetry_forecast_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t samples;
+    uint32_t read_errors;
+    uint32_t overruns;
+    uint32_t high_water;
+    /* Frames the transport did not take. */
+    uint32_t dropped;
+} telemetry_stats_t;
+
+/* Counters of one instrumented operation since boot; they wrap at 2^32. */
+typedef struct __attribute__((packed)) {
+    uint8_t kind;               /* instr_kind_t */
+    uint8_t id;
+    uint8_t op;                 /* bus_op_t or driver_op_t */
+    uint16_t cycles_per_us;     /* 0 when unknown */
+    uint32_t calls;
+    uint32_t errors;
+    uint32_t retries;
+    uint32_t bytes;
+    uint32_t cycles;
+    uint32_t max_cycles;
+    uint32_t hist[INSTR_HIST_BUCKETS];
+} telemetry_instr_t;
+
+esp_err_t telemetry_init(void);
+
+/*
+ * Frames and sends one record. Not thread safe: one task sends. Never waits
+ * for the UART: ESP_ERR_NO_MEM, and the frame counted as dropped, if its TX
+ * buffer has no room.
+ */
+esp_err_t telemetry_send(telemetry_type_t type, const void *record, size_t len);
+
+esp_err_t telemetry_send_sample(const acq_sample_t *sample);
+esp_err_t telemetry_send_features(const feature_row_t *row);
+esp_err_t telemetry_send_forecast(const float probs[FORECAST_CLASSES]);
+esp_err_t telemetry_send_stats(const acq_stats_t *stats);
+esp_err_t telemetry_send_instr(instr_kind_t kind, uint8_t id, uint8_t op, const instr_snapshot_t *snap);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef _CLOCK_H
+#define _CLOCK_H
+
+#include <stdint.h>
+#include <sdkconfig.h>
+
+#include <stdbool.h>
+#include <sys/time.h>
+
+#ifdef CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include <esp_timer.h>
+#endif
+
+/* The wall clock counts as set (SNTP, RTC) once it is past 2024-01-01. */
+#define CLOCK_MIN_VALID_EPOCH_S 1704067200
+
+/* Monotonic microseconds since boot. */
+static inline int64_t clock_now_us(void)
+{
+#ifdef CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+/* Microseconds since the Unix epoch of a clock_now_us() reading, by the wall clock. */
+static inline int64_t clock_epoch_us(int64_t now_us)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return now_us + (int64_t)tv.tv_sec * 1000000 + tv.tv_usec - clock_now_us();
+}
+
+/* False while the wall clock still counts from the epoch since power-on. */
+static inline bool clock_wall_set(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec >= CLOCK_MIN_VALID_EPOCH_S;
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date. */
+static inline int64_t clock_days_from_civil(int y, int m, int d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include <sdkconfig.h>
+
+#ifdef CONFIG_METEO_INSTR
+
+#include "instr.h"
+
+#define RELAXED memory_order_relaxed
+
+static unsigned bucket_of(uint32_t cycles)
+{
+    if (cycles < (2u << INSTR_HIST_SHIFT))
+        return 0;
+
+    unsigned b = 31 - __builtin_clz(cycles) - INSTR_HIST_SHIFT;
+    return b < INSTR_HIST_BUCKETS ? b : INSTR_HIST_BUCKETS - 1;
+}
+
+/* Relaxed load and store rather than read-modify-write; see instr_stat_t. */
+static inline void bump(_Atomic uint32_t *v, uint32_t n)
+{
+    atomic_store_explicit(v, atomic_load_explicit(v, RELAXED) + n, RELAXED);
+}
+
+void instr_record(instr_stat_t *stat, uint32_t start, size_t bytes, esp_err_t err)
+{
+    uint32_t cycles = instr_cycles() - start;
+
+    bump(&stat->calls, 1);
+    if (err != ESP_OK)
+        bump(&stat->errors, 1);
+    bump(&stat->bytes, (uint32_t)bytes);
+    bump(&stat->cycles, cycles);
+    bump(&stat->hist[bucket_of(cycles)], 1);
+    if (cycles > atomic_load_explicit(&stat->max_cycles, RELAXED))
+        atomic_store_explicit(&stat->max_cycles, cycles, RELAXED);
+}
+
+void instr_retry(instr_stat_t *stat)
+{
+    bump(&stat->retries, 1);
+}
+
+/* Fields are read one by one; a call in progress may be half counted. */
+void instr_snapshot(const instr_stat_t *stat, instr_snapshot_t *out)
+{
+    out->calls = atomic_load_explicit(&stat->calls, RELAXED);
+    out->errors = atomic_load_explicit(&stat->errors, RELAXED);
+    out->retries = atomic_load_explicit(&stat->retries, RELAXED);
+    out->bytes = atomic_load_explicit(&stat->bytes, RELAXED);
+    out->cycles = atomic_load_explicit(&stat->cycles, RELAXED);
+    out->max_cycles = atomic_load_explicit(&stat->max_cycles, RELAXED);
+    for (int b = 0; b < INSTR_HIST_BUCKETS; b++)
+        out->hist[b] = atomic_load_explicit(&stat->hist[b], RELAXED);
+}
+
+uint32_t instr_percentile(const instr_snapshot_t *snap, unsigned pct)
+{
+    uint64_t total = 0;
+    for (int b = 0; b < INSTR_HIST_BUCKETS; b++)
+        total += snap->hist[b];
+    if (total == 0)
+        return 0;
+
+    uint64_t want = (total * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (int b = 0; b < INSTR_HIST_BUCKETS - 1; b++) {
+        seen += snap->hist[b];
+        uint32_t bound = (2u << (b + INSTR_HIST_SHIFT)) - 1;
+        if (seen >= want)
+            return bound < snap->max_cycles ? bound : snap->max_cycles;
+    }
+    return snap->max_cycles;
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef _INSTR_H
+#define _INSTR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sdkconfig.h>
+#include <esp_err.h>
+
+#ifdef CONFIG_IDF_TARGET_LINUX
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+#else
+#include <esp_cpu.h>
+#endif
+
+/*
+ * Latency histogram buckets in CPU cycles: bucket 0 holds everything below
+ * 2^(INSTR_HIST_SHIFT + 1), bucket b > 0 holds [2^(b + SHIFT), 2^(b + SHIFT + 1)),
+ * the last one everything above.
+ */
+#define INSTR_HIST_BUCKETS 16
+#define INSTR_HIST_SHIFT   6
+
+#if defined(CONFIG_IDF_TARGET_LINUX)
+#define INSTR_CYCLES_PER_US 0   /* TSC rate is not known */
+#else
+#define INSTR_CYCLES_PER_US CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#endif
+
+typedef enum {
+    INSTR_BUS = 0,
+    INSTR_DRIVER = 1,
+    INSTR_FORECAST = 2,
+} instr_kind_t;
+
+/*
+ * Counters of one operation. Updates are plain relaxed loads and stores, so
+ * readers never see a torn value but two tasks running the same operation at
+ * the same instant may lose a count. All counters are 32-bit and wrap;
+ * readers take differences between snapshots.
+ */
+typedef struct {
+    _Atomic uint32_t calls;
+    _Atomic uint32_t errors;
+    _Atomic uint32_t retries;
+    _Atomic uint32_t bytes;
+    _Atomic uint32_t cycles;
+    _Atomic uint32_t max_cycles;
+    _Atomic uint32_t hist[INSTR_HIST_BUCKETS];
+} instr_stat_t;
+
+typedef struct {
+    uint32_t calls;
+    uint32_t errors;
+    uint32_t retries;
+    uint32_t bytes;
+    uint32_t cycles;
+    uint32_t max_cycles;
+    uint32_t hist[INSTR_HIST_BUCKETS];
+} instr_snapshot_t;
+
+/* Free-running cycle counter; nanoseconds on hosts without a TSC. */
+static inline uint32_t instr_cycles(void)
+{
+#ifdef CONFIG_IDF_TARGET_LINUX
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec);
+#endif
+#else
+    return esp_cpu_get_cycle_count();
+#endif
+}
+
+/* Counts one call that started at `start` (instr_cycles()). */
+void instr_record(instr_stat_t *stat, uint32_t start, size_t bytes, esp_err_t err);
+
+void instr_retry(instr_stat_t *stat);
+
+void instr_snapshot(const instr_stat_t *stat, instr_snapshot_t *out);
+
+/* Upper bound in cycles of the pct-th percentile: its bucket edge or the max. 0 without calls. */
+uint32_t instr_percentile(const instr_snapshot_t *snap, unsigned pct);
+
+/* Timing around code that is not a bus or driver op; compiled out with the rest. */
+#ifdef CONFIG_METEO_INSTR
+#define INSTR_BEGIN(start)                   uint32_t start = instr_cycles()
+#define INSTR_END(stat, start, bytes, err)   instr_record((stat), (start), (bytes), (err))
+#else
+#define INSTR_BEGIN(start)
+#define INSTR_END(stat, start, bytes, err)
+#endif
+
+#endif
@@ -0,0 +1,77 @@
+# export_features.py
+# Эталон для конвейера признаков прошивки (acq/feature_pipeline.c, bench_features).
+# Только стандартная библиотека, как и tflite_to_c.py.
+import argparse
+import csv
+import math
+import struct
+from datetime import datetime
+
+import feature_quant
+
+LAPSE_RATE = 0.0065
+BARO_EXPONENT = 5.257
+
+# ============================
+# 1. Параметры
+# ============================
+def parse_args():
+    parser = argparse.ArgumentParser(description="Hourly rows + expected features for the firmware bench")
+    parser.add_argument("--data", default="weather_data1.csv")
+    parser.add_argument("--model", default="weather_forecast_conv1d_esp32s3.tflite")
+    parser.add_argument("--out", default="features_ref.bin")
+    parser.add_argument("--altitude", type=float, default=150.0, help="station altitude, m")
+    parser.add_argument("--limit", type=int, default=0, help="number of rows, 0 = all")
+    return parser.parse_args()
+
+# ============================
+# 2. Признаки как в load_forecast_data (main.py)
+# ============================
+def month_encoding(month):
+    return math.sin(2 * math.pi * month / 12), math.cos(2 * math.pi * month / 12)
+
+def station_pressure(msl, temp, altitude):
+    # Обратное приведение к уровню моря: давление на высоте станции.
+    lapse = LAPSE_RATE * altitude
+    return msl * (1 - lapse / (temp + lapse + 273.15)) ** BARO_EXPONENT
+
+# ============================
+# 3. Основной сценарий
+# ============================
+def main():
+    args = parse_args()
+
+    # Диапазоны и квантование те же, что в acq/feature_quant.h.
+    mins, maxs = feature_quant.fit_ranges(feature_quant.csv_features(args.data))
+    scale, zero_point = feature_quant.model_input_quantization(args.model)
+
+    rows = 0
+    with open(args.data, newline="") as src, open(args.out, "wb") as f:
+        # Заголовок: высота станции; запись: вход (T, RH, P станции, месяц),
+        # ожидаемые признаки (точка росы, P на уровне моря, sin, cos),
+        # облачность и осадки из CSV, затем вход модели int8 после
+        # MinMaxScaler и квантования.
+        f.write(struct.pack("<f", args.altitude))
+        for r in csv.DictReader(src):
+            if any(v == "" for v in r.values()):
+                continue
+            temp = float(r["temperature_2m (°C)"])
+            hum = float(r["relative_humidity_2m (%)"])
+            dew = float(r["dew_point_2m (°C)"])
+            msl = float(r["pressure_msl (hPa)"])
+            cloud = float(r["cloud_cover (%)"])
+            precip = float(r["precipitation (mm)"])
+            month = datetime.fromisoformat(r["time"]).month
+            m_sin, m_cos = month_encoding(month)
+            q = feature_quant.quantize([temp, hum, dew, msl, cloud, precip, m_sin, m_cos],
+                                       mins, maxs, scale, zero_point)
+            f.write(struct.pack("<fffi6f8b", temp, hum, station_pressure(msl, temp, args.altitude), month,
+                                dew, msl, m_sin, m_cos, cloud, precip, *q))
+            rows += 1
+            if args.limit and rows >= args.limit:
+                break
+
+    print(f"✅ {rows} строк записано в {args.out}")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,58 @@
+# export_reference.py
+# Эталонные векторы для проверки инференса в прошивке (bench_forecast).
+import argparse
+import numpy as np
+import tensorflow as tf
+from sklearn.preprocessing import MinMaxScaler
+
+from main import load_forecast_data, make_sequence_data, WINDOW_SIZE, MODEL_NAME
+
+# ============================
+# 1. Параметры
+# ============================
+def parse_args():
+    parser = argparse.ArgumentParser(description="int8 windows + TFLite outputs for the firmware bench")
+    parser.add_argument("--data", default="weather_data1.csv")
+    parser.add_argument("--model", default=MODEL_NAME)
+    parser.add_argument("--out", default="forecast_ref.bin")
+    parser.add_argument("--limit", type=int, default=1000, help="number of windows, 0 = all")
+    return parser.parse_args()
+
+# ============================
+# 2. Квантование входа
+# ============================
+def quantize(x, details):
+    scale, zero_point = details["quantization"]
+    q = np.round(x / scale) + zero_point
+    return np.clip(q, -128, 127).astype(np.int8)
+
+# ============================
+# 3. Основной сценарий
+# ============================
+def main():
+    args = parse_args()
+
+    X, y, _, _ = load_forecast_data(args.data)
+    X_scaled = MinMaxScaler().fit_transform(X)
+    X_seq, _ = make_sequence_data(X_scaled, y, WINDOW_SIZE)
+    if args.limit:
+        X_seq = X_seq[:args.limit]
+
+    interpreter = tf.lite.Interpreter(model_path=args.model)
+    interpreter.allocate_tensors()
+    inp = interpreter.get_input_details()[0]
+    out = interpreter.get_output_details()[0]
+
+    # Запись: окно int8 [WINDOW_SIZE x признаки], затем выход int8 [классы]
+    with open(args.out, "wb") as f:
+        for window in X_seq:
+            q = quantize(window.astype(np.float32), inp)[np.newaxis, ...]
+            interpreter.set_tensor(inp["index"], q)
+            interpreter.invoke()
+            f.write(q.tobytes())
+            f.write(interpreter.get_tensor(out["index"]).astype(np.int8).tobytes())
+
+    print(f"✅ {len(X_seq)} окон записано в {args.out}")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,143 @@
+# feature_quant.py
+# MinMaxScaler + квантование входа модели, свёрнутые в одно аффинное
+# преобразование на признак, и экспорт констант в заголовок прошивки
+# (meteostation_firmware/src/acq/feature_quant.h).
+#
+# main.py вызывает write_header() после конвертации; без TensorFlow заголовок
+# можно пересобрать из CSV и готовой .tflite:
+#   python feature_quant.py --data weather_data1.csv
+import argparse
+import csv
+import math
+from datetime import datetime
+
+# Порядок признаков как в load_forecast_data (main.py).
+FEATURES = [
+    "temperature_2m (°C)",
+    "relative_humidity_2m (%)",
+    "dew_point_2m (°C)",
+    "pressure_msl (hPa)",
+    "cloud_cover (%)",
+    "precipitation (mm)",
+    "month_sin",
+    "month_cos",
+]
+
+# Признаки в прошивке: фиксированная точка Q16.
+FRAC_BITS = 16
+# Константы: q = (x * mult + offset) >> ACC_SHIFT, с округлением.
+# mult держит 32 дробных бита: иначе у почти-половинок результат расходится
+# с эталоном на 1 LSB.
+ACC_SHIFT = 48
+
+HEADER_PATH = "../meteostation_firmware/src/acq/feature_quant.h"
+
+# ============================
+# 1. Диапазоны MinMaxScaler и квантование входа
+# ============================
+def csv_features(path):
+    """Строки признаков как в load_forecast_data (строки с пропусками отбрасываются)."""
+    rows = []
+    with open(path, newline="") as f:
+        for r in csv.DictReader(f):
+            if any(v == "" for v in r.values()):
+                continue
+            month = datetime.fromisoformat(r["time"]).month
+            row = [float(r[c]) for c in FEATURES[:6]]
+            row += [math.sin(2 * math.pi * month / 12), math.cos(2 * math.pi * month / 12)]
+            rows.append(row)
+    return rows
+
+
+def fit_ranges(rows):
+    return [min(col) for col in zip(*rows)], [max(col) for col in zip(*rows)]
+
+
+def model_input_quantization(model_path):
+    from tflite_to_c import Model
+    with open(model_path, "rb") as f:
+        model = Model(f.read())
+    t = model.tensors[model.inputs[0]]
+    return t.scale, t.zero_point
+
+
+def span(lo, hi):
+    # MinMaxScaler: нулевой диапазон масштабируется как 1.
+    return hi - lo if hi > lo else 1.0
+
+
+def round_half_away(v):
+    # Как TfLiteRound в операторе Quantize (round() в Python округляет к чётному).
+    return int(math.copysign(math.floor(abs(v) + 0.5), v))
+
+
+def quantize(row, mins, maxs, scale, zero_point):
+    """Эталон: MinMaxScaler.transform, затем квантование входа int8."""
+    out = []
+    for x, lo, hi in zip(row, mins, maxs):
+        k = 1.0 / span(lo, hi)
+        q = round_half_away((x * k - lo * k) / scale) + zero_point
+        out.append(max(-128, min(127, q)))
+    return out
+
+
+def fused_constants(mins, maxs, scale, zero_point):
+    consts = []
+    for lo, hi in zip(mins, maxs):
+        a = 1.0 / (span(lo, hi) * scale)
+        mult = round(a * 2 ** (ACC_SHIFT - FRAC_BITS))
+        offset = round((zero_point - lo * a) * 2 ** ACC_SHIFT)
+        # Накопитель int64 не должен переполняться во всём диапазоне признака.
+        x_max = max(abs(lo), abs(hi)) * 2 ** FRAC_BITS
+        assert x_max * mult + abs(offset) < 2 ** 62, "feature range too wide for int64"
+        consts.append((mult, offset))
+    return consts
+
+# ============================
+# 2. Заголовок
+# ============================
+def write_header(path, mins, maxs, scale, zero_point, source):
+    mins, maxs = [float(v) for v in mins], [float(v) for v in maxs]
+    scale, zero_point = float(scale), int(zero_point)
+    consts = fused_constants(mins, maxs, scale, zero_point)
+    lines = [
+        "/* Generated by meteostation_nn/feature_quant.py from %s. Do not edit. */" % source,
+        "#ifndef _FEATURE_QUANT_H",
+        "#define _FEATURE_QUANT_H",
+        "",
+        "#include <stdint.h>",
+        "",
+        "/* Model input: scale %r, zero point %d. */" % (scale, zero_point),
+        "#define FEATURE_QUANT_FRAC_BITS %d" % FRAC_BITS,
+        "#define FEATURE_QUANT_SHIFT     %d" % ACC_SHIFT,
+        "",
+        "typedef struct {",
+        "    int64_t mult;",
+        "    int64_t offset;",
+        "} feature_quant_t;",
+        "",
+        "static const feature_quant_t feature_quant[%d] = {" % len(consts),
+    ]
+    for name, lo, hi, (mult, offset) in zip(FEATURES, mins, maxs, consts):
+        lines.append("    { %dll, %dll },  /* %s: %r .. %r */" % (mult, offset, name, lo, hi))
+    lines += ["};", "", "#endif", ""]
+    with open(path, "w") as f:
+        f.write("\n".join(lines))
+
+# ============================
+# 3. Запуск без обучения
+# ============================
+def main():
+    parser = argparse.ArgumentParser(description="Fused scaler + input quantization header for the firmware")
+    parser.add_argument("--data", default="weather_data1.csv")
+    parser.add_argument("--model", default="weather_forecast_conv1d_esp32s3.tflite")
+    parser.add_argument("--out", default=HEADER_PATH)
+    args = parser.parse_args()
+
+    mins, maxs = fit_ranges(csv_features(args.data))
+    scale, zero_point = model_input_quantization(args.model)
+    write_header(args.out, mins, maxs, scale, zero_point, args.data)
+    print(f"✅ Заголовок записан: {args.out}")
+
+if __name__ == "__main__":
+    main()
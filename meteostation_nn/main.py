@@ -7,6 +7,8 @@ import matplotlib.pyplot as plt
 from sklearn.model_selection import train_test_split
 from sklearn.preprocessing import MinMaxScaler
 
+import feature_quant
+
 # ============================
 # 1. Параметры и пути
 # ============================
@@ -186,7 +188,14 @@ def main_weather_forecast():
     plt.show()
 
     # Сохранение TFLite-модели
-    convert_to_tflite_esp32(model, X_train, MODEL_NAME)
+    tflite_model = convert_to_tflite_esp32(model, X_train, MODEL_NAME)
+
+    # Масштабирование + квантование входа для прошивки одним заголовком
+    interpreter = tf.lite.Interpreter(model_content=tflite_model)
+    in_scale, in_zero_point = interpreter.get_input_details()[0]["quantization"]
+    feature_quant.write_header(feature_quant.HEADER_PATH, scaler.data_min_, scaler.data_max_,
+                               in_scale, in_zero_point, DATA_PATH)
+    print(f"✅ Константы входа записаны: {feature_quant.HEADER_PATH}")
 
     print("\n✅ Модель готова. Для перевода предсказания обратно в WMO-код используйте:")
     print(f"index_to_group = {{v: k for k, v in code_to_group.items()}}")
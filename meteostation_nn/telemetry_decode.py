@@ -0,0 +1,144 @@
+# telemetry_decode.py
+# Разбор бинарной телеметрии прошивки (telemetry/telemetry.h) в CSV.
+# Кадр: 0x00, COBS(type u8, version u8, seq u16, запись, crc32), 0x00.
+#
+#   ./fw | python telemetry_decode.py -             (linux-сборка прошивки)
+#   python telemetry_decode.py capture.bin
+#   python telemetry_decode.py --port /dev/ttyUSB0  (нужен pyserial)
+import argparse
+import csv
+import os
+import struct
+import sys
+import zlib
+
+VERSION = 1
+
+FEATURES = ["temp", "humidity", "dew_point", "pressure_msl", "cloud_cover",
+            "precipitation", "month_sin", "month_cos"]
+CLASSES = ["clear", "fog", "drizzle", "rain", "snow", "other"]
+
+# Раскладка записей повторяет упакованные структуры telemetry_*_t.
+RECORDS = {
+    1: ("samples", "<q3f", ["timestamp_us", "temp", "pressure", "humidity"]),
+    2: ("features", "<8f3I", FEATURES + ["samples", "fallback", "skipped"]),
+    3: ("forecast", "<B6f", ["best"] + CLASSES),
+    4: ("stats", "<5I", ["samples", "read_errors", "overruns", "high_water", "dropped"]),
+    # Счётчики растут с загрузки и переполняются на 2^32: берите разности.
+    5: ("instr", "<3BH6I16I", ["kind", "id", "op", "cycles_per_us", "calls", "errors", "retries",
+                               "bytes", "cycles", "max_cycles"] + [f"hist{b}" for b in range(16)]),
+}
+
+# ============================
+# 1. Кадры
+# ============================
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def split_frames(chunks):
+    """Содержимое между разделителями 0x00; пустые куски пропускаются."""
+    buf = bytearray()
+    for chunk in chunks:
+        buf += chunk
+        while True:
+            end = buf.find(b"\x00")
+            if end < 0:
+                break
+            if end > 0:
+                yield bytes(buf[:end])
+            del buf[:end + 1]
+
+
+def parse_frame(raw):
+    """(type, seq, запись) или None, если кадр повреждён."""
+    frame = cobs_decode(raw)
+    if frame is None or len(frame) < 8:
+        return None
+    body, crc = frame[:-4], struct.unpack("<I", frame[-4:])[0]
+    if zlib.crc32(body) != crc:
+        return None
+    rec_type, version, seq = struct.unpack("<BBH", body[:4])
+    if version != VERSION or rec_type not in RECORDS:
+        return None
+    _, fmt, _ = RECORDS[rec_type]
+    if len(body) - 4 != struct.calcsize(fmt):
+        return None
+    return rec_type, seq, struct.unpack(fmt, body[4:])
+
+# ============================
+# 2. Источники
+# ============================
+def read_chunks(stream, follow):
+    # read1 отдаёт то, что уже пришло, и не ждёт полного блока.
+    read = getattr(stream, "read1", stream.read)
+    while True:
+        chunk = read(4096)
+        if chunk:
+            yield chunk
+        elif not follow:
+            return
+
+
+def open_source(args):
+    if args.port:
+        import serial
+        return serial.Serial(args.port, args.baud, timeout=1)
+    if args.input == "-":
+        return sys.stdin.buffer
+    return open(args.input, "rb")
+
+# ============================
+# 3. Запуск
+# ============================
+def main():
+    parser = argparse.ArgumentParser(description="Firmware telemetry frames to CSV")
+    parser.add_argument("input", nargs="?", default="-", help="capture file, - for stdin")
+    parser.add_argument("--port", help="serial port instead of a file")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--out", default="telemetry", help="directory for the CSV files")
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    files, writers = {}, {}
+    for rec_type, (name, _, columns) in RECORDS.items():
+        files[rec_type] = open(os.path.join(args.out, name + ".csv"), "w", newline="")
+        writers[rec_type] = csv.writer(files[rec_type])
+        writers[rec_type].writerow(["seq"] + columns)
+
+    frames = bad = lost = 0
+    last_seq = None
+    source = open_source(args)
+    try:
+        for raw in split_frames(read_chunks(source, follow=bool(args.port))):
+            parsed = parse_frame(raw)
+            if parsed is None:
+                # Текст консоли между кадрами тоже попадает сюда.
+                bad += 1
+                continue
+            rec_type, seq, values = parsed
+            if last_seq is not None:
+                lost += (seq - last_seq - 1) & 0xFFFF
+            last_seq = seq
+            writers[rec_type].writerow([seq] + list(values))
+            frames += 1
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for f in files.values():
+            f.close()
+
+    print(f"✅ Кадров: {frames}, отброшено: {bad}, потеряно по seq: {lost} -> {args.out}/", file=sys.stderr)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,421 @@
+# tflite_to_c.py
+# Генератор C-кода для прошивки: int8-модель .tflite -> константные массивы
+# во flash и вызовы ядер из nn/aot_kernels.h с размерами, известными при сборке.
+# Только стандартная библиотека: запускается из сборки ESP-IDF.
+#
+# Арифметика повторяет эталонные int8-ядра TFLite Micro (множители
+# QuantizeMultiplier, смещение входа свёрнуто в bias), поэтому выход
+# совпадает с интерпретатором бит в бит.
+import argparse
+import math
+import os
+import struct
+
+# ============================
+# 1. Чтение flatbuffer (schema.fbs)
+# ============================
+class Table:
+    def __init__(self, buf, pos):
+        self.buf = buf
+        self.pos = pos
+        self.vtable = pos - struct.unpack_from("<i", buf, pos)[0]
+        self.vlen = struct.unpack_from("<H", buf, self.vtable)[0]
+
+    def _field(self, i):
+        if 4 + 2 * i >= self.vlen:
+            return 0
+        return struct.unpack_from("<H", self.buf, self.vtable + 4 + 2 * i)[0]
+
+    def scalar(self, i, fmt, default=0):
+        o = self._field(i)
+        return struct.unpack_from("<" + fmt, self.buf, self.pos + o)[0] if o else default
+
+    def _ref(self, i):
+        o = self._field(i)
+        if not o:
+            return None
+        p = self.pos + o
+        return p + struct.unpack_from("<I", self.buf, p)[0]
+
+    def table(self, i):
+        r = self._ref(i)
+        return Table(self.buf, r) if r is not None else None
+
+    def vector(self, i):
+        r = self._ref(i)
+        if r is None:
+            return None, 0
+        return r + 4, struct.unpack_from("<I", self.buf, r)[0]
+
+    def tables(self, i):
+        base, n = self.vector(i)
+        return [Table(self.buf, base + 4 * k + struct.unpack_from("<I", self.buf, base + 4 * k)[0])
+                for k in range(n)]
+
+    def scalars(self, i, fmt):
+        base, n = self.vector(i)
+        if base is None:
+            return []
+        return list(struct.unpack_from("<%d%s" % (n, fmt), self.buf, base))
+
+    def raw(self, i):
+        base, n = self.vector(i)
+        return self.buf[base:base + n] if base is not None else b""
+
+
+# BuiltinOperator
+OP_CONV_2D, OP_FULLY_CONNECTED, OP_RESHAPE, OP_SOFTMAX = 3, 9, 22, 25
+OP_MEAN, OP_EXPAND_DIMS = 40, 70
+# TensorType
+TYPE_INT32, TYPE_INT8 = 2, 9
+# ActivationFunctionType
+ACT_NONE, ACT_RELU = 0, 1
+# Padding
+PAD_SAME, PAD_VALID = 0, 1
+
+
+class Tensor:
+    def __init__(self, model, t):
+        self.shape = t.scalars(0, "i")
+        self.type = t.scalar(1, "b")
+        self.data = model.buffers[t.scalar(2, "I")].raw(0)
+        q = t.table(4)
+        self.scales = q.scalars(2, "f") if q else []
+        self.zero_points = q.scalars(3, "q") if q else []
+
+    @property
+    def scale(self):
+        return self.scales[0]
+
+    @property
+    def zero_point(self):
+        return self.zero_points[0] if self.zero_points else 0
+
+    def numel(self):
+        return math.prod(self.shape)
+
+    def values(self):
+        fmt = {TYPE_INT8: "b", TYPE_INT32: "i"}[self.type]
+        return list(struct.unpack("<%d%s" % (len(self.data) // struct.calcsize(fmt), fmt), self.data))
+
+
+class Model:
+    def __init__(self, data):
+        root = Table(data, struct.unpack_from("<I", data, 0)[0])
+        if root.scalar(0, "I") != 3:
+            raise ValueError("unsupported tflite schema version")
+        self.buffers = root.tables(4)
+        codes = [max(c.scalar(0, "b"), c.scalar(3, "i")) for c in root.tables(1)]
+        graph = root.tables(2)
+        if len(graph) != 1:
+            raise ValueError("exactly one subgraph expected")
+        graph = graph[0]
+        self.tensors = [Tensor(self, t) for t in graph.tables(0)]
+        self.inputs = graph.scalars(1, "i")
+        self.outputs = graph.scalars(2, "i")
+        self.ops = [(codes[op.scalar(0, "I")], op.scalars(1, "i"), op.scalars(2, "i"), op.table(4))
+                    for op in graph.tables(3)]
+
+
+# ============================
+# 2. Квантование (tensorflow/lite/kernels/internal/quantization_util.cc)
+# ============================
+def quantize_multiplier(m):
+    if m == 0.0:
+        return 0, 0
+    q, shift = math.frexp(m)
+    q_fixed = math.floor(q * (1 << 31) + 0.5)   # TfLiteRound: половина от нуля
+    if q_fixed == 1 << 31:
+        q_fixed //= 2
+        shift += 1
+    if shift < -31:
+        return 0, 0
+    return q_fixed, shift
+
+
+def activation_range(act, out):
+    if act == ACT_NONE:
+        return -128, 127
+    if act == ACT_RELU:
+        return max(-128, out.zero_point), 127
+    raise ValueError("unsupported fused activation %d" % act)
+
+
+# ============================
+# 3. Слои
+# ============================
+class Emitter:
+    def __init__(self, model):
+        self.model = model
+        self.arrays = []
+        self.calls = []
+        self.stream_calls = []
+        self.stream_macs = []
+        self.stream_state = []
+        self.max_activation = 0
+        self.const_bytes = 0
+        self.stream_bytes = 0
+        self.macs = 0
+        self.fixed_macs = 0
+
+    def array(self, ctype, name, values, per_line=16):
+        lines = []
+        for i in range(0, len(values), per_line):
+            lines.append("    " + ", ".join(str(v) for v in values[i:i + per_line]) + ",")
+        self.const_bytes += len(values) * (4 if ctype == "int32_t" else 1)
+        self.arrays.append("static const %s %s[%d] = {\n%s\n};\n" % (ctype, name, len(values), "\n".join(lines)))
+        return name
+
+    def per_channel(self, name, inp, filt, out, channels):
+        scales = filt.scales if len(filt.scales) == channels else [filt.scale] * channels
+        mults, shifts = [], []
+        for s in scales:
+            m, sh = quantize_multiplier(inp.scale * s / out.scale)
+            mults.append(m)
+            shifts.append(sh)
+        return self.array("int32_t", name + "_mult", mults, 8), self.array("int8_t", name + "_shift", shifts)
+
+    def conv(self, n, inp, filt, bias, out, opt):
+        pad_mode = opt.scalar(0, "b")
+        stride_w, stride_h = opt.scalar(1, "i"), opt.scalar(2, "i")
+        act = opt.scalar(3, "b")
+        dil_w, dil_h = opt.scalar(4, "i", 1), opt.scalar(5, "i", 1)
+        cout, kh, k, cin = filt.shape
+        width = inp.numel() // cin
+        if kh != 1 or inp.numel() != width * cin or (stride_w, stride_h, dil_w, dil_h) != (1, 1, 1, 1):
+            raise ValueError("conv %d: only 1xK stride-1 convolutions over one row are supported" % n)
+        if pad_mode != PAD_SAME or out.numel() != width * cout or k > 8:
+            raise ValueError("conv %d: only SAME padding with K <= 8 is supported" % n)
+        pad = (k - 1) // 2
+
+        w = filt.values()
+        b = bias.values() if bias else [0] * cout
+        # Смещение входа (-zp) умножается на веса заранее; для краёв
+        # учитываются только отводы, попадающие во вход (SAME-паддинг).
+        in_offset = -inp.zero_point
+        folded = []
+        taps = 0
+        for x in range(width):
+            for co in range(cout):
+                acc = b[co]
+                for t in range(k):
+                    ix = x + t - pad
+                    if 0 <= ix < width:
+                        taps += co == 0
+                        acc += in_offset * sum(w[(co * k + t) * cin:(co * k + t + 1) * cin])
+                folded.append(acc)
+
+        name = "conv%d" % n
+        self.array("int8_t", name + "_filter", w)
+        self.array("int32_t", name + "_bias", folded, 8)
+        mult, shift = self.per_channel(name, inp, filt, out, cout)
+        lo, hi = activation_range(act, out)
+        args = ("{in}, %d, %d, %s_filter, %d, %d, %s_bias, %s, %s, %d, %d, %d, %d, {out}"
+                % (width, cin, name, k, pad, name, mult, shift, cout, out.zero_point, lo, hi))
+
+        # Потоковый режим: произведения по отводам для каждого входного
+        # столбца кешируются и переиспользуются после сдвига окна.
+        self.stream_state.append(
+            "static int32_t %s_taps[%d];\n"
+            "static int8_t %s_cols[%d];\n"
+            "static uint8_t %s_have[%d];\n"
+            "static aot_conv_stream_t %s_stream = { %s_taps, %s_cols, %s_have, 0, 0 };\n"
+            % (name, width * k * cout, name, width * cin, name, width, name, name, name, name))
+        self.stream_bytes += width * k * cout * 4 + width * cin + width
+        self.stream_macs.append("%s_stream.macs" % name)
+        return ("aot_conv1d_s8(%s);" % args, "aot_conv1d_stream_s8(&%s_stream, %s);" % (name, args),
+                width * cout, taps * cin * cout)
+
+    def mean(self, n, inp, axis, out, opt):
+        if opt.scalar(0, "b"):
+            raise ValueError("mean %d: keep_dims is not supported" % n)
+        axes = [a % len(inp.shape) for a in axis.values()]
+        if len(axes) != 1 or math.prod(inp.shape[:axes[0]]) != 1:
+            raise ValueError("mean %d: only a single leading axis can be reduced" % n)
+        count = inp.shape[axes[0]]
+        channels = math.prod(inp.shape[axes[0] + 1:])
+        # reduce.h: множитель 1/N встраивается в выходной множитель.
+        mult, shift = quantize_multiplier(inp.scale / out.scale)
+        extra = min(count.bit_length() - 1, 32, 31 + shift)
+        mult = (mult << extra) // count
+        shift -= extra
+        call = ("aot_mean_s8({in}, %d, %d, %d, %d, %d, %d, {out});"
+                % (count, channels, inp.zero_point, mult, shift, out.zero_point))
+        return call, call, channels, 0
+
+    def fully_connected(self, n, inp, filt, bias, out, opt):
+        act = opt.scalar(0, "b") if opt else ACT_NONE
+        nout, nin = filt.shape
+        if inp.numel() != nin:
+            raise ValueError("fully_connected %d: batch > 1 is not supported" % n)
+        w = filt.values()
+        b = bias.values() if bias else [0] * nout
+        in_offset = -inp.zero_point
+        folded = [b[o] + in_offset * sum(w[o * nin:(o + 1) * nin]) for o in range(nout)]
+
+        name = "fc%d" % n
+        self.array("int8_t", name + "_weights", w)
+        self.array("int32_t", name + "_bias", folded, 8)
+        mult, shift = self.per_channel(name, inp, filt, out, nout)
+        lo, hi = activation_range(act, out)
+        call = ("aot_fully_connected_s8({in}, %d, %s_weights, %s_bias, %s, %s, %d, %d, %d, %d, {out});"
+                % (nin, name, name, mult, shift, nout, out.zero_point, lo, hi))
+        self.fixed_macs += nin * nout
+        return call, call, nout, nin * nout
+
+    def softmax(self, n, inp, out, opt):
+        beta = opt.scalar(0, "f", 1.0) if opt else 1.0
+        if out.scale != 1.0 / 256 or out.zero_point != -128:
+            raise ValueError("softmax %d: output must be scale 1/256, zero point -128" % n)
+        # softmax_common.cc: вход в формате Q5.26.
+        int_bits = 5
+        real = min(beta * inp.scale * (1 << (31 - int_bits)), (1 << 31) - 1.0)
+        mult, left_shift = quantize_multiplier(real)
+        radius = math.floor(((1 << int_bits) - 1) * (1 << (31 - int_bits)) / (1 << left_shift))
+        call = ("aot_softmax_s8({in}, %d, %d, %d, %d, {out});"
+                % (inp.numel(), mult, left_shift, -radius))
+        return call, call, inp.numel(), 0
+
+    def build(self):
+        tensors = self.model.tensors
+        alias = {}
+
+        def resolve(i):
+            while i in alias:
+                i = alias[i]
+            return i
+
+        steps = []
+        for n, (code, ins, outs, opt) in enumerate(self.model.ops):
+            t = [tensors[i] if i >= 0 else None for i in ins]
+            out = tensors[outs[0]]
+            if code in (OP_EXPAND_DIMS, OP_RESHAPE):
+                if (t[0].scale, t[0].zero_point) != (out.scale, out.zero_point):
+                    raise ValueError("op %d: requantizing reshape" % n)
+                alias[outs[0]] = ins[0]
+                continue
+            if code == OP_CONV_2D:
+                call, stream_call, size, macs = self.conv(n, t[0], t[1], t[2], out, opt)
+            elif code == OP_MEAN:
+                call, stream_call, size, macs = self.mean(n, t[0], t[1], out, opt)
+            elif code == OP_FULLY_CONNECTED:
+                call, stream_call, size, macs = self.fully_connected(n, t[0], t[1], t[2] if len(t) > 2 else None, out, opt)
+            elif code == OP_SOFTMAX:
+                call, stream_call, size, macs = self.softmax(n, t[0], out, opt)
+            else:
+                raise ValueError("op %d: builtin operator %d is not supported" % (n, code))
+            if any(x is not None and x.type not in (TYPE_INT8, TYPE_INT32) for x in t):
+                raise ValueError("op %d: only int8 models are supported" % n)
+            steps.append((resolve(ins[0]), outs[0], call, stream_call))
+            self.max_activation = max(self.max_activation, size)
+            self.macs += macs
+
+        # Линейная цепочка: активации по очереди в двух буферах.
+        model_in, model_out = self.model.inputs[0], self.model.outputs[0]
+        if steps[0][0] != model_in or steps[-1][1] != model_out:
+            raise ValueError("model is not a single chain of operators")
+        for i, (src, dst, call, stream_call) in enumerate(steps):
+            if i and src != steps[i - 1][1]:
+                raise ValueError("model is not a single chain of operators")
+            src_name = "in" if i == 0 else "scratch[%d]" % ((i - 1) % 2)
+            dst_name = "out" if i == len(steps) - 1 else "scratch[%d]" % (i % 2)
+            self.calls.append("    " + call.format(**{"in": src_name, "out": dst_name}))
+            self.stream_calls.append("    " + stream_call.format(**{"in": src_name, "out": dst_name}))
+
+
+# ============================
+# 4. Вывод
+# ============================
+HEADER = """/* Generated by meteostation_nn/tflite_to_c.py from {model}. Do not edit. */
+#ifndef _FORECAST_MODEL_H
+#define _FORECAST_MODEL_H
+
+#include <stdint.h>
+
+#define FORECAST_MODEL_INPUT_LEN     {in_len}
+#define FORECAST_MODEL_OUTPUT_LEN    {out_len}
+#define FORECAST_MODEL_INPUT_SCALE   {in_scale!r}f
+#define FORECAST_MODEL_INPUT_ZP      {in_zp}
+#define FORECAST_MODEL_OUTPUT_SCALE  {out_scale!r}f
+#define FORECAST_MODEL_OUTPUT_ZP     {out_zp}
+#define FORECAST_MODEL_SCRATCH_BYTES {scratch}
+#define FORECAST_MODEL_CONST_BYTES   {weights}
+#define FORECAST_MODEL_STREAM_BYTES  {stream}
+#define FORECAST_MODEL_MACS          {macs}
+
+/* Not reentrant: activations live in a static scratch buffer. */
+void forecast_model_invoke(const int8_t *in, int8_t *out);
+
+/*
+ * Same result as forecast_model_invoke(), but convolution work is cached per
+ * input column: after the window slides by one row only the columns whose
+ * inputs changed are multiplied again.
+ */
+void forecast_model_invoke_stream(const int8_t *in, int8_t *out);
+
+/* Multiply-accumulates done by forecast_model_invoke_stream() so far. */
+uint32_t forecast_model_stream_macs(void);
+
+#endif
+"""
+
+SOURCE = """/* Generated by meteostation_nn/tflite_to_c.py from {model}. Do not edit. */
+#include "forecast_model.h"
+#include "aot_kernels.h"
+
+{arrays}
+static int8_t scratch[2][{act}];
+
+{stream_state}
+static uint32_t stream_calls;
+
+void forecast_model_invoke(const int8_t *in, int8_t *out)
+{{
+{calls}
+}}
+
+void forecast_model_invoke_stream(const int8_t *in, int8_t *out)
+{{
+{stream_calls}
+    stream_calls++;
+}}
+
+uint32_t forecast_model_stream_macs(void)
+{{
+    return {stream_macs} + stream_calls * {fixed_macs}u;
+}}
+"""
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compile an int8 .tflite model to C for the firmware")
+    parser.add_argument("model")
+    parser.add_argument("out_dir")
+    args = parser.parse_args()
+
+    with open(args.model, "rb") as f:
+        model = Model(f.read())
+
+    em = Emitter(model)
+    em.build()
+
+    inp = model.tensors[model.inputs[0]]
+    out = model.tensors[model.outputs[0]]
+    name = os.path.basename(args.model)
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    with open(os.path.join(args.out_dir, "forecast_model.h"), "w") as f:
+        f.write(HEADER.format(model=name, in_len=inp.numel(), out_len=out.numel(),
+                              in_scale=inp.scale, in_zp=inp.zero_point,
+                              out_scale=out.scale, out_zp=out.zero_point,
+                              scratch=2 * em.max_activation, weights=em.const_bytes,
+                              stream=em.stream_bytes, macs=em.macs))
+    with open(os.path.join(args.out_dir, "forecast_model.c"), "w") as f:
+        f.write(SOURCE.format(model=name, arrays="\n".join(em.arrays), act=em.max_activation,
+                              calls="\n".join(em.calls), stream_state="\n".join(em.stream_state),
+                              stream_calls="\n".join(em.stream_calls),
+                              stream_macs=" + ".join(em.stream_macs) or "0", fixed_macs=em.fixed_macs))
+
+
+if __name__ == "__main__":
+    main()